@@ -13,6 +13,7 @@ SOURCES += \
     src/globals.cpp \
     src/ecs/camera.cpp \
     src/ecs/scene.cpp  \
+    src/ecs/scenebvh.cpp \
     src/ecs/entity.cpp \
     src/ecs/components.cpp \
     src/input/input.cpp \
@@ -22,13 +23,20 @@ SOURCES += \
     src/rendering/gl.cpp \
     src/rendering/forwardrenderer.cpp \
     src/rendering/framebufferobject.cpp \
+    src/rendering/framesnapshot.cpp \
+    src/rendering/frustum.cpp \
+    src/rendering/meshletculling.cpp \
     src/rendering/miscsettings.cpp \
     src/rendering/renderer.cpp \
+    src/rendering/renderthread.cpp \
     src/resources/mesh.cpp \
+    src/resources/meshlet.cpp \
     src/resources/resource.cpp \
     src/resources/resourcemanager.cpp \
     src/resources/material.cpp \
+    src/resources/materialbuffer.cpp \
     src/resources/texture.cpp \
+    src/resources/texturearray.cpp \
     src/resources/shaderprogram.cpp \
     src/ui/resourceswidget.cpp \
     src/ui/mainwindow.cpp \
@@ -47,14 +55,23 @@ SOURCES += \
     src/ui/materialwidget.cpp \
     src/ui/lightsourcewidget.cpp \
     src/ui/miscsettingswidget.cpp \
-    src/util/modelimporter.cpp
+    src/util/hash.cpp \
+    src/util/hdrconverter.cpp \
+    src/util/modelimporter.cpp \
+    src/util/normalmap.cpp \
+    src/util/objloader.cpp \
+    src/util/profiler.cpp \
+    src/util/jobsystem.cpp \
+    src/util/texturecompressor.cpp
 
 HEADERS += \
     src/globals.h \
     src/ecs/camera.h \
     src/ecs/scene.h \
+    src/ecs/scenebvh.h \
     src/ecs/entity.h \
     src/ecs/components.h \
+    src/ecs/componentstorage.h \
     src/input/input.h \
     src/input/interaction.h \
     src/input/selection.h \
@@ -62,13 +79,21 @@ HEADERS += \
     src/rendering/gl.h \
     src/rendering/miscsettings.h \
     src/rendering/renderer.h \
+    src/rendering/renderthread.h \
     src/rendering/forwardrenderer.h \
     src/rendering/framebufferobject.h \
+    src/rendering/framesnapshot.h \
+    src/rendering/frustum.h \
+    src/rendering/meshletculling.h \
     src/resources/mesh.h \
+    src/resources/meshlet.h \
     src/resources/resource.h \
     src/resources/resourcemanager.h \
+    src/resources/resourcepool.h \
     src/resources/material.h \
+    src/resources/materialbuffer.h \
     src/resources/texture.h \
+    src/resources/texturearray.h \
     src/resources/shaderprogram.h \
     src/ui/mainwindow.h \
     src/ui/inspectorwidget.h \
@@ -87,8 +112,15 @@ HEADERS += \
     src/ui/materialwidget.h \
     src/ui/lightsourcewidget.h \
     src/ui/miscsettingswidget.h \
+    src/util/hash.h \
+    src/util/hdrconverter.h \
     src/util/modelimporter.h \
-    src/util/stb_image.h
+    src/util/normalmap.h \
+    src/util/objloader.h \
+    src/util/profiler.h \
+    src/util/jobsystem.h \
+    src/util/stb_image.h \
+    src/util/texturecompressor.h
 
 FORMS += \
     ui/mainwindow.ui \
@@ -122,6 +154,8 @@ DEPENDPATH += $$PWD/../ThirdParty/Assimp/include
 DISTFILES += \
     res/shaders/blit/blit.frag \
     res/shaders/blit/blit.vert \
+    res/shaders/common/depth.glsl \
+    res/shaders/common/material.glsl \
     res/shaders/dof/dof.frag \
     res/shaders/dof/dof.vert \
     res/shaders/final_mix/final_mix.frag \
@@ -135,6 +169,7 @@ DISTFILES += \
     res/shaders/lighting/deferred_lighting.frag \
     res/shaders/mouse_picking/mousePicking.frag \
     res/shaders/mouse_picking/mousePicking.vert \
+    res/shaders/normal_from_bump/normal_from_bump.frag \
     res/shaders/outline/mask.frag \
     res/shaders/outline/outline.frag \
     res/shaders/outline/outline.vert \
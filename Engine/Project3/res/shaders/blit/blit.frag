@@ -1,37 +1,32 @@
 #version 330 core
 
 uniform sampler2D colorTexture;
-uniform bool blitAlpha;
-uniform bool blitDepth;
-uniform bool blitSimple;
 
 in vec2 texCoord;
 
 out vec4 outColor;
 
+#ifdef BLIT_DEPTH
+#include "../common/depth.glsl"
+#endif
+
 void main(void)
 {
     vec4 texel = texture(colorTexture, texCoord);
 
-    if(blitSimple){
-        outColor = texel;
-        return;
-    }
-
-    if (blitAlpha) {
-        outColor.rgb = vec3(texel.a);
-    } else if (blitDepth) {
-        float f = 10000.0;
-        float n = 0.01;
-        float z = abs((2 * f * n) / ((texel.r * 2.0 - 1.0) *(f-n)-(f+n)));
-        outColor.rgb = vec3(z / 50.0);
-    } else {
-        outColor.rgb = texel.rgb;
-    }
+#ifdef BLIT_SIMPLE
+    outColor = texel;
+#else
+#if defined(BLIT_ALPHA)
+    outColor.rgb = vec3(texel.a);
+#elif defined(BLIT_DEPTH)
+    outColor.rgb = vec3(linearizeDepth(texel.r) / 50.0);
+#else
+    outColor.rgb = texel.rgb;
+#endif
 
     // Gamma correction
     outColor = pow(outColor, vec4(1.0/2.2));
     outColor.a = 1.0;
-
-
+#endif
 }
@@ -0,0 +1,11 @@
+// Distance to the camera of a depth buffer value
+
+// Should be uniforms
+const float near = 0.01;
+const float far = 10000.0;
+
+float linearizeDepth(float rawDepth)
+{
+    float z = rawDepth * 2.0 - 1.0;
+    return (2.0 * near * far) / (far + near - z * (far - near));
+}
@@ -0,0 +1,56 @@
+// Parameters of the materials, fetched with the index stored in the
+// G-buffer (see MaterialBuffer)
+
+uniform samplerBuffer materialParameters;
+
+struct MaterialParameters
+{
+    vec3 albedo;
+    vec3 specular;
+    vec3 emissive;
+    float smoothness;
+    float metalness;
+    float bumpiness;
+};
+
+// Pool slot of the material plus one (zero where nothing was drawn), split
+// in the alpha of the position and normal (half floats hold integers up to
+// 2048 exactly)
+void encodeMaterialIndex(int materialIndex, inout vec4 position, inout vec4 normal)
+{
+    position.a = float(materialIndex / 2048);
+    normal.a = float(materialIndex % 2048);
+}
+
+MaterialParameters fetchMaterial(vec4 position, vec4 normal)
+{
+    MaterialParameters m;
+    int index = int(position.a + 0.5) * 2048 + int(normal.a + 0.5) - 1;
+    if (index < 0 || index * 3 + 2 >= textureSize(materialParameters))
+    {
+        m.albedo = vec3(1.0);
+        m.specular = vec3(0.0);
+        m.emissive = vec3(0.0);
+        m.smoothness = 0.0;
+        m.metalness = 0.0;
+        m.bumpiness = 0.0;
+        return m;
+    }
+
+    vec4 texel0 = texelFetch(materialParameters, index * 3);
+    vec4 texel1 = texelFetch(materialParameters, index * 3 + 1);
+    vec4 texel2 = texelFetch(materialParameters, index * 3 + 2);
+    m.albedo = texel0.rgb;
+    m.smoothness = texel0.a;
+    m.specular = texel1.rgb;
+    m.metalness = texel1.a;
+    m.emissive = texel2.rgb;
+    m.bumpiness = texel2.a;
+    return m;
+}
+
+// Exponent of the specular highlights, from 2 to 2048
+float shininess(MaterialParameters m)
+{
+    return exp2(1.0 + 10.0 * m.smoothness);
+}
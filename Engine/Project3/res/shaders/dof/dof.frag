@@ -13,25 +13,15 @@ uniform float fallofEndMargin;
 in vec2 texCoord;
 out vec4 outColor;
 
-// Should be uniforms
-float near = 0.01;
-float far = 10000.0;
-
-float LinearizeDepth(float rawDepth){
-    float z = rawDepth * 2.0 - 1.0;
-    return (2.0 * near * far) / (far + near - z * (far - near));
-
-}
+#include "../common/depth.glsl"
 
 void main(void){
 
     outColor = texture(color, texCoord);
 
-    // DOF is disabled
-    if(depthFocus < 0)
-        return;
-
-    float pixelDepth = LinearizeDepth(texture(depth, texCoord).r);
+    // Only blurred when DOF is enabled (the focus is not negative)
+#ifdef DEPTH_OF_FIELD
+    float pixelDepth = linearizeDepth(texture(depth, texCoord).r);
     float depthDiff = abs(pixelDepth - depthFocus);
 
     float blurCoeficient = 1.0f;
@@ -74,4 +64,5 @@ void main(void){
 
 
     outColor = vec4(blurredColor, 1.0);
+#endif
 }
@@ -10,11 +10,21 @@ uniform vec4 specular;
 uniform vec4 emissive;
 uniform float smoothness;
 uniform float bumpiness;
+uniform sampler2DArray albedoArray;
 uniform sampler2D albedoTexture;
+uniform int albedoLayer;
+uniform sampler2DArray specularArray;
 uniform sampler2D specularTexture;
+uniform int specularLayer;
+uniform sampler2DArray emissiveArray;
 uniform sampler2D emissiveTexture;
+uniform int emissiveLayer;
+uniform sampler2DArray normalArray;
 uniform sampler2D normalTexture;
+uniform int normalLayer;
+uniform sampler2DArray bumpArray;
 uniform sampler2D bumpTexture;
+uniform int bumpLayer;
 
 // Lights
 #define MAX_LIGHTS 8
@@ -30,6 +40,17 @@ in vec3 vPosition;
 
 out vec4 outColor;
 
+// Material textures are either a layer of a texture array (layer >= 0),
+// a 2D texture (layer == -1) or missing (layer == -2, the fallback is used)
+vec4 sampleMaterialTexture(sampler2DArray array, sampler2D tex, int layer, vec2 uv, vec4 fallback)
+{
+    if (layer >= 0)
+        return texture(array, vec3(uv, float(layer)));
+    if (layer == -1)
+        return texture(tex, uv);
+    return fallback;
+}
+
 void main(void)
 {
     // TODO: Local illumination
@@ -56,6 +77,7 @@ void main(void)
         }
     }
 
-    outColor.rgb = texture(albedoTexture, vTexCoords).rgb*(ambient+diffuse+specular);
+    vec3 albedoColor = sampleMaterialTexture(albedoArray, albedoTexture, albedoLayer, vTexCoords, vec4(1.0)).rgb;
+    outColor.rgb = albedoColor*(ambient+diffuse+specular);
     //outColor.rgb = vNormal;
 }
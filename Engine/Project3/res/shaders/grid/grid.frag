@@ -11,7 +11,6 @@ uniform mat4 projectionMatrix;
 
 // Background
 uniform vec4 backgroundColor;
-uniform bool drawGrid;
 
 // Models depth
 uniform sampler2D depth;
@@ -49,19 +48,14 @@ vec4 computeBackgroundColor(){
 
 void main(void)
 {
-    outColor = computeBackgroundColor();
     float fragmentDepth = texture(depth, texCoord).r;
 
-    if (drawGrid == false)
-    {
-        if (fragmentDepth < 1.0)
-            discard;
-        else{
-            outColor = vec4(pow(backgroundColor.rgb, vec3(2,2,2)), 1.0);
-            return;
-        }
-
-    }
+#ifndef DRAW_GRID
+    if (fragmentDepth < 1.0)
+        discard;
+    outColor = vec4(pow(backgroundColor.rgb, vec3(2,2,2)), 1.0);
+#else
+    outColor = computeBackgroundColor();
 
     // Eye direction
     vec3 eyedirEyespace;
@@ -117,4 +111,5 @@ void main(void)
         // If there is a model discard the background
         discard;
     }
+#endif
 }
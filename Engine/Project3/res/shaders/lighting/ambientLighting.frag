@@ -2,18 +2,25 @@
 
 out vec4 ambientLight;
 
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
 uniform sampler2D gColor;
 uniform sampler2D ssao;
 
 uniform float ambientValue;
-uniform bool applyOcclusion;
+
+#include "../common/material.glsl"
 
 void main(void)
 {
     vec2 viewportSize = textureSize(gColor, 0);
     vec2 texCoords = gl_FragCoord.xy/viewportSize;
 
-    ambientLight = texture2D(gColor, texCoords) * ambientValue;
-    if (applyOcclusion)
-        ambientLight *= texture2D(ssao, texCoords);
+    MaterialParameters m = fetchMaterial(texture2D(gPosition, texCoords), texture2D(gNormal, texCoords));
+
+    ambientLight = texture2D(gColor, texCoords) * vec4(m.albedo, 1.0) * ambientValue;
+#ifdef APPLY_OCCLUSION
+    ambientLight *= texture2D(ssao, texCoords);
+#endif
+    ambientLight.rgb += m.emissive;
 }
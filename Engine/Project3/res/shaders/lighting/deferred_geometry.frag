@@ -1,7 +1,10 @@
 #version 330 core
 
+uniform sampler2DArray albedoArray;
 uniform sampler2D albedoTexture;
+uniform int albedoLayer;
 uniform sampler2D Depth;
+uniform int materialIndex; // Pool slot plus one
 
 in vec3 vPosition;
 in vec3 vNormal;
@@ -11,9 +14,23 @@ layout (location = 0) out vec4 position;
 layout (location = 1) out vec4 normal;
 layout (location = 2) out vec4 color;
 
+#include "../common/material.glsl"
+
+// Material textures are either a layer of a texture array (layer >= 0),
+// a 2D texture (layer == -1) or missing (layer == -2, the fallback is used)
+vec4 sampleMaterialTexture(sampler2DArray array, sampler2D tex, int layer, vec2 uv, vec4 fallback)
+{
+    if (layer >= 0)
+        return texture(array, vec3(uv, float(layer)));
+    if (layer == -1)
+        return texture(tex, uv);
+    return fallback;
+}
+
 void main(void)
 {
     position.rgb = vPosition;
     normal.rgb = normalize(vNormal);
-    color.rgb = texture(albedoTexture, vTexCoords).rgb;
+    color.rgb = sampleMaterialTexture(albedoArray, albedoTexture, albedoLayer, vTexCoords, vec4(1.0)).rgb;
+    encodeMaterialIndex(materialIndex, position, normal);
 }
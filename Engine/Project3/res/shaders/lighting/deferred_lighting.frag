@@ -10,8 +10,7 @@ uniform sampler2D gPosition;
 uniform sampler2D gNormal;
 uniform sampler2D gColor;
 
-// Light info
-uniform int lightType;
+// Light info (point lights unless DIRECTIONAL_LIGHT is defined)
 uniform vec3 lightPosition;
 uniform vec3 lightDirection;
 uniform vec3 lightColor;
@@ -21,27 +20,35 @@ uniform float lightRange;
 uniform vec3 cameraPos;
 uniform vec2 viewportSize;
 
+#include "../common/material.glsl"
+
 void main(void)
 {
     vec2 pixelCoords= gl_FragCoord.xy/viewportSize;
 
-    vec3 position = texture2D(gPosition, pixelCoords).xyz;
-    vec3 normal = texture2D(gNormal, pixelCoords).xyz;
+    vec4 gBufferPosition = texture2D(gPosition, pixelCoords);
+    vec4 gBufferNormal = texture2D(gNormal, pixelCoords);
+    vec3 position = gBufferPosition.xyz;
+    vec3 normal = gBufferNormal.xyz;
     vec3 color = texture2D(gColor, pixelCoords).xyz;
+    MaterialParameters m = fetchMaterial(gBufferPosition, gBufferNormal);
 
     lightCircles.rgb = lightColor;
 
+#ifdef DIRECTIONAL_LIGHT
+    vec3 ray = lightDirection;
+    float attenuation = 1.0f;
+#else
     float pointDst = length(position-lightPosition);
-    if (lightType == 0 && pointDst > lightRange)
+    if (pointDst > lightRange)
         discard;
+    vec3 ray = normalize(lightPosition-position);
+    float attenuation = pow((1.0f-pointDst/lightRange),2.0f);
+#endif
 
     vec3 diffuse = vec3(0.0f);
     vec3 specular = vec3(0.0f);
 
-    vec3 ray = normalize(lightPosition-position);
-    if (lightType == 1)
-        ray = lightDirection;
-
     diffuse += max(dot(ray, normal),0.0f);
     if (length(diffuse) > 0.0f)
     {
@@ -49,11 +56,8 @@ void main(void)
         vec3 V = normalize(cameraPos-position); //Vector to viewer
 
         float specFactor = max(dot(R,V),0.0f);
-        specular += pow(specFactor, 32.0f);
+        specular += pow(specFactor, shininess(m));
     }
 
-    float attenuation = pow((1.0f-pointDst/lightRange),2.0f);
-    if (lightType == 1)
-        attenuation = 1.0f;
-    finalRender.rgb = color*(diffuse+specular)*lightIntensity*attenuation*lightColor;
+    finalRender.rgb = (color*m.albedo*diffuse + m.specular*specular)*lightIntensity*attenuation*lightColor;
 }
@@ -0,0 +1,39 @@
+#version 330 core
+
+// Bump map (array layer >= 0 or 2D texture when -1)
+uniform sampler2DArray bumpArray;
+uniform sampler2D bumpTexture;
+uniform int bumpLayer;
+uniform vec2 texelSize;
+uniform float bumpiness;
+
+in vec2 texCoord;
+
+out vec4 outColor;
+
+float height(float x, float y)
+{
+    // Texel centers of the base level, the repeat wrap mode tiles the borders
+    vec2 uv = texCoord + vec2(x, y) * texelSize;
+    if (bumpLayer >= 0)
+        return textureLod(bumpArray, vec3(uv, float(bumpLayer)), 0.0).r;
+    return textureLod(bumpTexture, uv, 0.0).r;
+}
+
+void main(void)
+{
+    float tl = height(-1.0,  1.0);
+    float  l = height(-1.0,  0.0);
+    float bl = height(-1.0, -1.0);
+    float  t = height( 0.0,  1.0);
+    float  b = height( 0.0, -1.0);
+    float tr = height( 1.0,  1.0);
+    float  r = height( 1.0,  0.0);
+    float br = height( 1.0, -1.0);
+
+    // Sobel filter, same as NormalMap::fromBump
+    float dX = (tl + 2.0 * l + bl) - (tr + 2.0 * r + br);
+    float dY = (bl + 2.0 * b + br) - (tl + 2.0 * t + tr);
+    vec3 n = normalize(vec3(dX, dY, 1.0 / bumpiness));
+    outColor = vec4(n * 0.5 + vec3(0.5), 1.0);
+}
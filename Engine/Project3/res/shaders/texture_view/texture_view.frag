@@ -1,6 +1,8 @@
 #version 330 core
 
+uniform sampler2DArray colorMapArray;
 uniform sampler2D colorMap;
+uniform int colorMapLayer; // Layer of colorMapArray (-1 to sample colorMap)
 
 in vec2 outTexCoord;
 
@@ -9,7 +11,10 @@ out vec4 outColor;
 void main(void)
 {
     //outColor = vec4(outTexCoord.r, outTexCoord.g, 1.0, 1.0);
-    outColor = texture(colorMap, outTexCoord);
+    if (colorMapLayer >= 0)
+        outColor = texture(colorMapArray, vec3(outTexCoord, float(colorMapLayer)));
+    else
+        outColor = texture(colorMap, outTexCoord);
     outColor.a = 1.0;
 
     // Gamma correction
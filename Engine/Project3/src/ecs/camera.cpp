@@ -9,7 +9,7 @@ Camera::Camera()
     position = QVector3D(0.0, 2.0, 6.0);
 }
 
-QVector4D Camera::getLeftRightBottomTop()
+QVector4D Camera::getLeftRightBottomTop() const
 {
     const float aspectRatio = float(viewportWidth) / viewportHeight;
     const float alpha = qDegreesToRadians(fovy * 0.5);
@@ -70,6 +70,7 @@ void Camera::prepareMatrices()
     worldMatrix.rotate(pitch, QVector3D(1.0, 0.0, 0.0));
 
     viewMatrix = worldMatrix.inverted();
+    viewNormalMatrix = viewMatrix.normalMatrix();
 
     projectionMatrix.setToIdentity();
     projectionMatrix.perspective(fovy, float(viewportWidth) / viewportHeight, znear, zfar);
@@ -17,7 +17,7 @@ public:
 
     Camera();
 
-    QVector4D getLeftRightBottomTop();
+    QVector4D getLeftRightBottomTop() const;
 
     QVector3D screenPointToWorldRay(int x, int y);
     QVector3D screenDisplacementToWorldVector(int x0, int y0, int x1, int y1, const QVector3D &worldPoint);
@@ -52,6 +52,7 @@ public:
     // Derived matrices
     QMatrix4x4 worldMatrix; // From camera space to world space
     QMatrix4x4 viewMatrix; // From world space to camera space
+    QMatrix3x3 viewNormalMatrix; // Normals from world space to camera space
     QMatrix4x4 projectionMatrix; // From view space to clip space
 };
 
@@ -1,4 +1,6 @@
 #include "components.h"
+#include "entity.h"
+#include "scene.h"
 #include "resources/mesh.h"
 #include "resources/material.h"
 
@@ -13,13 +15,148 @@ Transform::Transform() :
 
 }
 
-QMatrix4x4 Transform::matrix() const
+const QMatrix4x4 &Transform::matrix() const
 {
-    QMatrix4x4 mat;
-    mat.translate(position);
-    mat.rotate(rotation);
-    mat.scale(scale);
-    return mat;
+    Q_ASSERT(!dirty);
+    return worldMatrix;
+}
+
+const QMatrix3x3 &Transform::normalMatrix() const
+{
+    Q_ASSERT(!dirty);
+    return worldNormalMatrix;
+}
+
+const QMatrix4x4 &Transform::inverseMatrix() const
+{
+    Q_ASSERT(!dirty);
+    return worldInverseMatrix;
+}
+
+float Transform::determinant() const
+{
+    Q_ASSERT(!dirty);
+    return worldDeterminant;
+}
+
+void Transform::updateWorld(const Transform *parent)
+{
+    if (parent != nullptr)
+    {
+        worldMatrix = parent->worldMatrix * localMatrix;
+        worldNormalMatrix = parent->worldNormalMatrix * localNormalMatrix;
+        worldInverseMatrix = localInverseMatrix * parent->worldInverseMatrix;
+        worldDeterminant = parent->worldDeterminant * localDeterminant;
+    }
+    else
+    {
+        worldMatrix = localMatrix;
+        worldNormalMatrix = localNormalMatrix;
+        worldInverseMatrix = localInverseMatrix;
+        worldDeterminant = localDeterminant;
+    }
+}
+
+void Transform::setPosition(const QVector3D &p)
+{
+    position = p;
+    markDirty();
+}
+
+void Transform::setRotation(const QQuaternion &r)
+{
+    rotation = r;
+    markDirty();
+}
+
+void Transform::setScale(const QVector3D &s)
+{
+    scale = s;
+    markDirty();
+}
+
+void Transform::markDirty()
+{
+    if (!dirty && entity != nullptr)
+    {
+        dirty = true;
+        entity->owner->markTransformDirty(entity);
+    }
+}
+
+void Transform::computeMatrices(Transform *const *transforms, int count)
+{
+    // Gather position, rotation and scale into one array per channel
+    enum { PX, PY, PZ, QX, QY, QZ, QW, SX, SY, SZ, InputChannels };
+    QVector<float> trs(InputChannels * count);
+    float *in[InputChannels];
+    for (int c = 0; c < InputChannels; ++c) in[c] = trs.data() + c * count;
+    for (int i = 0; i < count; ++i)
+    {
+        const Transform *t = transforms[i];
+        in[PX][i] = t->position.x(); in[PY][i] = t->position.y(); in[PZ][i] = t->position.z();
+        in[QX][i] = t->rotation.x(); in[QY][i] = t->rotation.y(); in[QZ][i] = t->rotation.z(); in[QW][i] = t->rotation.scalar();
+        in[SX][i] = t->scale.x(); in[SY][i] = t->scale.y(); in[SZ][i] = t->scale.z();
+    }
+
+    // Rotation columns scaled (matrix) and divided (normals) by the scale:
+    // (R * S)^-T = R * S^-1, and the inverse is its transpose with -p moved.
+    // Branchless, so the compiler vectorizes it.
+    enum { R00, R10, R20, R01, R11, R21, R02, R12, R22, InvSX, InvSY, InvSZ, OutputChannels };
+    QVector<float> result(OutputChannels * count);
+    float *out[OutputChannels];
+    for (int c = 0; c < OutputChannels; ++c) out[c] = result.data() + c * count;
+    for (int i = 0; i < count; ++i)
+    {
+        const float x = in[QX][i], y = in[QY][i], z = in[QZ][i], w = in[QW][i];
+        out[R00][i] = 1.0f - 2.0f * (y * y + z * z);
+        out[R10][i] = 2.0f * (x * y + z * w);
+        out[R20][i] = 2.0f * (x * z - y * w);
+        out[R01][i] = 2.0f * (x * y - z * w);
+        out[R11][i] = 1.0f - 2.0f * (x * x + z * z);
+        out[R21][i] = 2.0f * (y * z + x * w);
+        out[R02][i] = 2.0f * (x * z + y * w);
+        out[R12][i] = 2.0f * (y * z - x * w);
+        out[R22][i] = 1.0f - 2.0f * (x * x + y * y);
+        out[InvSX][i] = in[SX][i] != 0.0f ? 1.0f / in[SX][i] : 0.0f;
+        out[InvSY][i] = in[SY][i] != 0.0f ? 1.0f / in[SY][i] : 0.0f;
+        out[InvSZ][i] = in[SZ][i] != 0.0f ? 1.0f / in[SZ][i] : 0.0f;
+    }
+
+    // Scatter into the column major matrices
+    for (int i = 0; i < count; ++i)
+    {
+        Transform *t = transforms[i];
+        const float columns[3][3] = {
+            { out[R00][i], out[R10][i], out[R20][i] },
+            { out[R01][i], out[R11][i], out[R21][i] },
+            { out[R02][i], out[R12][i], out[R22][i] } };
+        const float scale[3] = { in[SX][i], in[SY][i], in[SZ][i] };
+        const float invScale[3] = { out[InvSX][i], out[InvSY][i], out[InvSZ][i] };
+
+        const float p[3] = { in[PX][i], in[PY][i], in[PZ][i] };
+
+        float *local = t->localMatrix.data();
+        float *normal = t->localNormalMatrix.data();
+        float *inverse = t->localInverseMatrix.data();
+        for (int col = 0; col < 3; ++col)
+        {
+            float inverseTranslation = 0.0f;
+            for (int row = 0; row < 3; ++row)
+            {
+                local[col * 4 + row] = columns[col][row] * scale[col];
+                normal[col * 3 + row] = columns[col][row] * invScale[col];
+                inverse[row * 4 + col] = columns[col][row] * invScale[col];
+                inverseTranslation -= columns[col][row] * p[row];
+            }
+            local[col * 4 + 3] = 0.0f;
+            inverse[col * 4 + 3] = 0.0f;
+            inverse[12 + col] = inverseTranslation * invScale[col];
+        }
+        local[12] = p[0]; local[13] = p[1]; local[14] = p[2]; local[15] = 1.0f;
+        inverse[15] = 1.0f;
+        t->localDeterminant = scale[0] * scale[1] * scale[2];
+    }
 }
 
 void Transform::read(const QJsonObject &json)
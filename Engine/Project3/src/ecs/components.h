@@ -38,16 +38,53 @@ class Transform : public Component
 public:
     Transform();
 
-    QMatrix4x4 matrix() const;
-
-    ComponentType componentType() const override { return ComponentType::Transform; }
+    // Cached world matrices (parents included), recomputed in batches by
+    // Scene::updateTransforms. It runs once per frame before they are read,
+    // code outside of the frame calls it first.
+    const QMatrix4x4 &matrix() const;
+    const QMatrix3x3 &normalMatrix() const;
+    const QMatrix4x4 &inverseMatrix() const; // Zero if the scale has a zero component
+    float determinant() const; // Negative if the transform mirrors
+
+    // Position, rotation and scale are relative to the parent entity
+    void setPosition(const QVector3D &p);
+    void setRotation(const QQuaternion &r);
+    void setScale(const QVector3D &s);
+    void markDirty();
+    bool isDirty() const { return dirty; }
+
+    // Composes the local matrices of several transforms over packed TRS arrays
+    static void computeMatrices(Transform *const *transforms, int count);
+
+    static const ComponentType TypeId = ComponentType::Transform;
+    ComponentType componentType() const override { return TypeId; }
 
     void read(const QJsonObject &json) override;
     void write(QJsonObject &json) override;
 
+    // Write through the setters, so the matrices are refreshed
     QVector3D position;
     QQuaternion rotation;
     QVector3D scale;
+
+private:
+
+    // World matrices from the parent's ones (null for roots)
+    void updateWorld(const Transform *parent);
+
+    QMatrix4x4 localMatrix;
+    QMatrix3x3 localNormalMatrix;
+    QMatrix4x4 localInverseMatrix;
+    float localDeterminant = 1.0f;
+
+    QMatrix4x4 worldMatrix;
+    QMatrix3x3 worldNormalMatrix;
+    QMatrix4x4 worldInverseMatrix;
+    float worldDeterminant = 1.0f;
+
+    bool dirty = false; // Identity matrices match the default position, rotation and scale
+
+    friend class Scene;
 };
 
 class MeshRenderer : public Component
@@ -58,7 +95,8 @@ public:
 
     void handleResourcesAboutToDie();
 
-    ComponentType componentType() const override { return ComponentType::MeshRenderer; }
+    static const ComponentType TypeId = ComponentType::MeshRenderer;
+    ComponentType componentType() const override { return TypeId; }
 
     void read(const QJsonObject &json) override;
     void write(QJsonObject &json) override;
@@ -75,7 +113,8 @@ public:
 
     LightSource();
 
-    ComponentType componentType() const override { return ComponentType::LightSource; }
+    static const ComponentType TypeId = ComponentType::LightSource;
+    ComponentType componentType() const override { return TypeId; }
 
     void read(const QJsonObject &json) override;
     void write(QJsonObject &json) override;
@@ -0,0 +1,77 @@
+#ifndef COMPONENTSTORAGE_H
+#define COMPONENTSTORAGE_H
+
+#include <QVector>
+
+// Dense array with all the components of one type (sparse set: the entities
+// are the sparse side, their component pointers point into the array).
+// Components move when the array grows or one is removed, the pointers of
+// their entities are updated, so they must not be kept across adds/removes.
+template <typename T>
+class ComponentStorage
+{
+public:
+
+    ComponentStorage() { }
+
+    ComponentStorage(const ComponentStorage &) = delete;
+    ComponentStorage &operator=(const ComponentStorage &) = delete;
+
+    T *add(Entity *entity)
+    {
+        const T *oldData = components.constData();
+        components.push_back(T());
+        components.last().entity = entity;
+        relink(components.constData() == oldData ? components.size() - 1 : 0);
+        return &components.last();
+    }
+
+    // Swaps the last component into the hole
+    void remove(T *component)
+    {
+        const int index = int(component - components.data());
+        Q_ASSERT(index >= 0 && index < components.size());
+        component->entity->components[int(T::TypeId)] = nullptr;
+        if (index != components.size() - 1)
+        {
+            components[index] = components.last();
+            relink(index, index + 1);
+        }
+        components.removeLast();
+    }
+
+    // Calls function(transform, component) for the components of the
+    // active entities, in memory order
+    template <typename Function>
+    void forEachActive(Function function)
+    {
+        for (T &component : components)
+        {
+            if (component.entity->active)
+            {
+                function(*component.entity->transform, component);
+            }
+        }
+    }
+
+    int size() const { return components.size(); }
+    T &operator[](int index) { return components[index]; }
+
+    typename QVector<T>::iterator begin() { return components.begin(); }
+    typename QVector<T>::iterator end() { return components.end(); }
+
+private:
+
+    void relink(int from, int to = -1)
+    {
+        if (to < 0) to = components.size();
+        for (int i = from; i < to; ++i)
+        {
+            components[i].entity->components[int(T::TypeId)] = &components[i];
+        }
+    }
+
+    QVector<T> components;
+};
+
+#endif // COMPONENTSTORAGE_H
@@ -4,12 +4,13 @@
 #include <QRandomGenerator>
 #include <time.h>
 
-Entity::Entity() :
-    name("Entity")
+Entity::Entity(Scene *owner) :
+    name("Entity"),
+    owner(owner)
 {
     for (int i = 0; i < MAX_COMPONENTS; ++i)
         components[i] = nullptr;
-    transform = new Transform;
+    owner->transforms.add(this);
 
     QRandomGenerator generator;
     generator.seed((time(NULL)));
@@ -19,9 +20,12 @@ Entity::Entity() :
 
 Entity::~Entity()
 {
-    delete transform;
-    delete meshRenderer;
-    delete lightSource;
+    if (parent != nullptr) parent->children.removeOne(this);
+    for (auto child : children) child->parent = nullptr;
+
+    if (transform != nullptr) owner->transforms.remove(transform);
+    if (meshRenderer != nullptr) owner->meshRenderers.remove(meshRenderer);
+    if (lightSource != nullptr) owner->lightSources.remove(lightSource);
 }
 
 Component *Entity::addComponent(ComponentType componentType)
@@ -32,21 +36,21 @@ Component *Entity::addComponent(ComponentType componentType)
     {
     case ComponentType::Transform:
         Q_ASSERT(transform == nullptr);
-        component = transform = new Transform;
+        component = owner->transforms.add(this);
+        transform->markDirty();
         break;
     case ComponentType::LightSource:
         Q_ASSERT(lightSource == nullptr);
-        component = lightSource = new LightSource;
-        break;;
+        component = owner->lightSources.add(this);
+        break;
     case ComponentType::MeshRenderer:
         Q_ASSERT(meshRenderer == nullptr);
-        component = meshRenderer = new MeshRenderer;
+        component = owner->meshRenderers.add(this);
         break;
     default:
         Q_ASSERT(false && "Invalid code path");
     }
 
-    component->entity = this;
     return component;
 }
 
@@ -54,18 +58,19 @@ void Entity::removeComponent(Component *component)
 {
     if (transform == component)
     {
-        delete transform;
-        transform = nullptr;
+        owner->transforms.remove(transform);
+        for (auto child : children)
+        {
+            if (child->transform != nullptr) child->transform->markDirty();
+        }
     }
     else if (component == meshRenderer)
     {
-        delete meshRenderer;
-        meshRenderer = nullptr;
+        owner->meshRenderers.remove(meshRenderer);
     }
     else if (component == lightSource)
     {
-        delete lightSource;
-        lightSource = nullptr;
+        owner->lightSources.remove(lightSource);
     }
 }
 
@@ -83,13 +88,14 @@ Component *Entity::findComponent(ComponentType ctype)
 
 Entity *Entity::clone() const
 {
-    Entity *entity = scene->addEntity(); // Global scene
+    Entity *entity = owner->addEntity();
     entity->name = name;
     entity->active = active;
     if (transform != nullptr) {
         //entity->addComponent(ComponentType::Transform); // transforms are created by default
-        *entity->transform = *transform;
-        entity->transform->entity = entity;
+        entity->transform->setPosition(transform->position);
+        entity->transform->setRotation(transform->rotation);
+        entity->transform->setScale(transform->scale);
     }
     if (meshRenderer != nullptr) {
         entity->addComponent(ComponentType::MeshRenderer);
@@ -101,9 +107,30 @@ Entity *Entity::clone() const
         *entity->lightSource = *lightSource;
         entity->lightSource->entity = entity;
     }
+    entity->setParent(parent);
+    const QVector<Entity*> originals = children; // Cloning adds to them first
+    for (auto child : originals) {
+        child->clone()->setParent(entity);
+    }
     return entity;
 }
 
+void Entity::setParent(Entity *newParent)
+{
+    if (newParent == parent) return;
+    for (Entity *ancestor = newParent; ancestor != nullptr; ancestor = ancestor->parent)
+    {
+        if (ancestor == this) return; // It would create a cycle
+    }
+
+    if (parent != nullptr) parent->children.removeOne(this);
+    parent = newParent;
+    if (parent != nullptr) parent->children.push_back(this);
+
+    owner->markHierarchyDirty();
+    if (transform != nullptr) transform->markDirty();
+}
+
 void Entity::read(const QJsonObject &json)
 {
 }
@@ -2,21 +2,29 @@
 #define ENTITY_H
 
 #include "components.h"
+#include <QVector>
 
 #define MAX_COMPONENTS 8
 
+class Scene;
+
+// Facade over the components of an entity, which live in the dense arrays
+// of its scene (slot order matches ComponentType)
 class Entity
 {
 public:
 
-    Entity();
+    Entity(Scene *owner);
     ~Entity();
 
     Component *addComponent(ComponentType ctype);
     Component *findComponent(ComponentType ctype);
     void removeComponent(Component *component);
 
-    Entity *clone() const;
+    Entity *clone() const; // With its children, under the same parent
+
+    // Local transforms are relative to the parent (null for roots)
+    void setParent(Entity *parent);
 
     void read(const QJsonObject &json);
     void write(QJsonObject &json);
@@ -36,7 +44,17 @@ public:
         Component *components[MAX_COMPONENTS];
     };
 
+    Scene *owner;
+
+    Entity *parent = nullptr;
+    QVector<Entity*> children;
+
+    // Range of the subtree in the depth first order of the scene
+    int hierarchyIndex = -1;
+    int subtreeSize = 1;
+
     bool active = true;
+    bool boundsDirty = false; // Queued for a refit of the spatial index
 
     unsigned int id = 0;
 };
@@ -5,6 +5,8 @@
 #include "resources/material.h"
 #include "globals.h"
 #include <QJsonArray>
+#include <QSet>
+#include <algorithm>
 
 
 // Scene //////////////////////////////////////////////////////////////////
@@ -28,8 +30,13 @@ int Scene::numEntities() const
 
 Entity *Scene::addEntity()
 {
-    Entity *entity = new Entity;
+    Entity *entity = new Entity(this);
     entities.push_back(entity);
+    bvhNeedsRebuild = true;
+
+    // New roots go at the end of the order
+    entity->hierarchyIndex = hierarchyOrder.size();
+    hierarchyOrder.push_back(entity);
     return entity;
 }
 
@@ -40,8 +47,30 @@ Entity *Scene::entityAt(int index)
 
 void Scene::removeEntityAt(int index)
 {
-    delete entities[index];
-    entities.removeAt(index);
+    removeEntity(entities[index]);
+}
+
+void Scene::removeEntity(Entity *entity)
+{
+    QVector<Entity*> subtree = { entity };
+    QSet<Entity*> removed;
+    for (int i = 0; i < subtree.size(); ++i)
+    {
+        removed.insert(subtree[i]);
+        subtree += subtree[i]->children;
+    }
+    auto isRemoved = [&](Entity *e) { return removed.contains(e); };
+    entities.erase(std::remove_if(entities.begin(), entities.end(), isRemoved), entities.end());
+    dirtyEntities.erase(std::remove_if(dirtyEntities.begin(), dirtyEntities.end(), isRemoved), dirtyEntities.end());
+    dirtyTransforms.erase(std::remove_if(dirtyTransforms.begin(), dirtyTransforms.end(), isRemoved), dirtyTransforms.end());
+
+    for (auto e : subtree)
+    {
+        delete e;
+    }
+    bvh.clear();
+    bvhNeedsRebuild = true;
+    hierarchyDirty = true;
 }
 
 Component *Scene::findComponent(ComponentType ctype)
@@ -60,17 +89,154 @@ void Scene::clear()
         delete entity;
     }
     entities.clear();
+    dirtyEntities.clear();
+    dirtyTransforms.clear();
+    hierarchyOrder.clear();
+    hierarchyDirty = false;
+    bvh.clear();
+    bvhNeedsRebuild = true;
 }
 
 void Scene::handleResourcesAboutToDie()
 {
+    for (auto &meshRenderer : meshRenderers)
+    {
+        meshRenderer.handleResourcesAboutToDie();
+    }
+    markAllDirty();
+}
+
+void Scene::markDirty(Entity *entity)
+{
+    QVector<Entity*> subtree = { entity };
+    for (int i = 0; i < subtree.size(); ++i)
+    {
+        markBoundsDirty(subtree[i]);
+        subtree += subtree[i]->children;
+    }
+}
+
+void Scene::markBoundsDirty(Entity *entity)
+{
+    if (!entity->boundsDirty)
+    {
+        entity->boundsDirty = true;
+        dirtyEntities.push_back(entity);
+    }
+}
+
+void Scene::markAllDirty()
+{
+    for (auto entity : dirtyEntities)
+    {
+        entity->boundsDirty = false;
+    }
+    dirtyEntities.clear();
+    bvhNeedsRebuild = true;
+}
+
+void Scene::updateSpatialIndex()
+{
+    for (auto entity : dirtyEntities)
+    {
+        entity->boundsDirty = false;
+        if (!bvhNeedsRebuild && !bvh.refit(entity))
+        {
+            bvhNeedsRebuild = true;
+        }
+    }
+    dirtyEntities.clear();
+
+    if (bvhNeedsRebuild || bvh.isDegraded())
+    {
+        bvh.build(entities);
+        bvhNeedsRebuild = false;
+    }
+}
+
+void Scene::markTransformDirty(Entity *entity)
+{
+    dirtyTransforms.push_back(entity);
+}
+
+void Scene::updateTransforms()
+{
+    if (hierarchyDirty)
+    {
+        sortHierarchy();
+    }
+    if (dirtyTransforms.isEmpty())
+    {
+        return;
+    }
+
+    // Local matrices of the changed transforms
+    QVector<Transform*> changed;
+    changed.reserve(dirtyTransforms.size());
+    for (auto entity : dirtyTransforms)
+    {
+        if (entity->transform != nullptr)
+        {
+            changed.push_back(entity->transform);
+        }
+    }
+    const int transformsPerJob = 1024;
+    jobSystem->parallelFor("Transform matrices", changed.size(), transformsPerJob, [&changed](int begin, int end)
+    {
+        Transform::computeMatrices(changed.constData() + begin, end - begin);
+    });
+
+    // World matrices of the changed subtrees, parents first. Subtrees nested
+    // in one already walked are skipped. Their bounds are refitted next.
+    QVector<QPair<int, int>> ranges;
+    ranges.reserve(dirtyTransforms.size());
+    for (auto entity : dirtyTransforms)
+    {
+        ranges.push_back(qMakePair(entity->hierarchyIndex, entity->hierarchyIndex + entity->subtreeSize));
+    }
+    std::sort(ranges.begin(), ranges.end());
+
+    int walkedEnd = 0;
+    for (const auto &range : ranges)
+    {
+        for (int i = qMax(range.first, walkedEnd); i < range.second; ++i)
+        {
+            Entity *entity = hierarchyOrder[i];
+            if (entity->transform != nullptr)
+            {
+                const Entity *parent = entity->parent;
+                entity->transform->updateWorld(parent != nullptr ? parent->transform : nullptr);
+                entity->transform->dirty = false;
+            }
+            markBoundsDirty(entity);
+        }
+        walkedEnd = qMax(walkedEnd, range.second);
+    }
+    dirtyTransforms.clear();
+}
+
+void Scene::sortHierarchy()
+{
+    hierarchyOrder.clear();
     for (auto entity : entities)
     {
-        if (entity->meshRenderer)
+        if (entity->parent == nullptr)
         {
-            entity->meshRenderer->handleResourcesAboutToDie();
+            sortSubtree(entity);
         }
     }
+    hierarchyDirty = false;
+}
+
+void Scene::sortSubtree(Entity *entity)
+{
+    entity->hierarchyIndex = hierarchyOrder.size();
+    hierarchyOrder.push_back(entity);
+    for (auto child : entity->children)
+    {
+        sortSubtree(child);
+    }
+    entity->subtreeSize = hierarchyOrder.size() - entity->hierarchyIndex;
 }
 
 void Scene::read(const QJsonObject &json)
@@ -8,6 +8,8 @@ class Entity;
 class Component;
 
 #include "entity.h"
+#include "componentstorage.h"
+#include "scenebvh.h"
 
 class Scene
 {
@@ -19,6 +21,7 @@ public:
     Entity *addEntity();
     Entity *entityAt(int index);
     void removeEntityAt(int index);
+    void removeEntity(Entity *entity); // With its children
 
     Component *findComponent(ComponentType ctype);
 
@@ -26,10 +29,45 @@ public:
 
     void handleResourcesAboutToDie();
 
+    // Spatial index maintenance: transform or mesh changes are refitted
+    // incrementally, added or removed entities make it rebuild. Moved
+    // transforms are queued by updateTransforms, markDirty is for other
+    // changes of the bounds (as the mesh) and includes the children.
+    void markDirty(Entity *entity);
+    void markAllDirty();
+    void updateSpatialIndex();
+
+    // Recomputes the local matrices of the transforms changed since the
+    // last call in one batch, then the world matrices of their subtrees
+    // (nothing to do if the scene is static)
+    void markTransformDirty(Entity *entity);
+    void markHierarchyDirty() { hierarchyDirty = true; }
+    void updateTransforms();
+
     void read(const QJsonObject &json);
     void write(QJsonObject &json);
 
     QVector<Entity*> entities;
+
+    // Components of all the entities, passes walk these arrays
+    ComponentStorage<Transform> transforms;
+    ComponentStorage<MeshRenderer> meshRenderers;
+    ComponentStorage<LightSource> lightSources;
+
+    SceneBVH bvh;
+
+private:
+
+    void markBoundsDirty(Entity *entity);
+    QVector<Entity*> dirtyEntities;
+    bool bvhNeedsRebuild = false;
+
+    void sortHierarchy();
+    void sortSubtree(Entity *entity);
+
+    QVector<Entity*> dirtyTransforms;
+    QVector<Entity*> hierarchyOrder; // Depth first, subtrees are contiguous
+    bool hierarchyDirty = false;
 };
 
 
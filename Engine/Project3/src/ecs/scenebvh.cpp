@@ -0,0 +1,256 @@
+#include "scenebvh.h"
+#include "entity.h"
+#include "rendering/frustum.h"
+#include "resources/mesh.h"
+#include <QPair>
+#include <algorithm>
+#include <cmath>
+
+
+static float surfaceArea(const QVector3D &min, const QVector3D &max)
+{
+    const QVector3D d = max - min;
+    return 2.0f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+static QVector3D minVector(const QVector3D &a, const QVector3D &b)
+{
+    return QVector3D(std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()), std::fmin(a.z(), b.z()));
+}
+
+static QVector3D maxVector(const QVector3D &a, const QVector3D &b)
+{
+    return QVector3D(std::fmax(a.x(), b.x()), std::fmax(a.y(), b.y()), std::fmax(a.z(), b.z()));
+}
+
+SceneBVH::SceneBVH()
+{
+}
+
+bool SceneBVH::worldBounds(const Entity *entity, QVector3D &min, QVector3D &max)
+{
+    if (entity->meshRenderer == nullptr || entity->meshRenderer->mesh == nullptr || entity->transform == nullptr) {
+        return false;
+    }
+
+    const Bounds &bounds = entity->meshRenderer->mesh->bounds;
+    if (bounds.min.x() > bounds.max.x()) {
+        return false; // Empty mesh
+    }
+
+    // Transformed box as center + extents (abs of the matrix applied to the extents)
+    const QMatrix4x4 matrix = entity->transform->matrix();
+    const QVector3D center = matrix * ((bounds.min + bounds.max) * 0.5f);
+    const QVector3D extent = (bounds.max - bounds.min) * 0.5f;
+    QVector3D worldExtent;
+    for (int i = 0; i < 3; ++i)
+    {
+        worldExtent[i] =
+                std::fabs(matrix(i, 0)) * extent.x() +
+                std::fabs(matrix(i, 1)) * extent.y() +
+                std::fabs(matrix(i, 2)) * extent.z();
+    }
+    min = center - worldExtent;
+    max = center + worldExtent;
+    return true;
+}
+
+void SceneBVH::clear()
+{
+    nodes.clear();
+    leaves.clear();
+    builtArea = 0.0f;
+    currentArea = 0.0f;
+}
+
+void SceneBVH::build(const QVector<Entity*> &entities)
+{
+    clear();
+
+    QVector<BuildItem> items;
+    items.reserve(entities.size());
+    for (auto entity : entities)
+    {
+        BuildItem item;
+        item.entity = entity;
+        if (worldBounds(entity, item.min, item.max))
+        {
+            item.centroid = (item.min + item.max) * 0.5f;
+            items.push_back(item);
+        }
+    }
+
+    if (items.isEmpty()) { return; }
+
+    nodes.reserve(items.size() * 2 - 1);
+    buildNode(items.data(), items.data() + items.size(), -1);
+    builtArea = currentArea;
+}
+
+int SceneBVH::buildNode(BuildItem *first, BuildItem *last, int parent)
+{
+    const int index = nodes.size();
+    nodes.push_back(SceneBVHNode());
+    nodes[index].parent = parent;
+
+    if (last - first == 1)
+    {
+        nodes[index].min = first->min;
+        nodes[index].max = first->max;
+        nodes[index].entity = first->entity;
+        nodes[index].skip = index + 1;
+        leaves.insert(first->entity, index);
+        return index;
+    }
+
+    // Median split along the longest axis of the centroids
+    QVector3D centroidMin = first->centroid;
+    QVector3D centroidMax = first->centroid;
+    for (BuildItem *item = first + 1; item < last; ++item)
+    {
+        centroidMin = minVector(centroidMin, item->centroid);
+        centroidMax = maxVector(centroidMax, item->centroid);
+    }
+    const QVector3D size = centroidMax - centroidMin;
+    const int axis = (size.x() >= size.y() && size.x() >= size.z()) ? 0 : (size.y() >= size.z() ? 1 : 2);
+    BuildItem *middle = first + (last - first) / 2;
+    std::nth_element(first, middle, last, [axis](const BuildItem &a, const BuildItem &b) {
+        return a.centroid[axis] < b.centroid[axis];
+    });
+
+    const int left = buildNode(first, middle, index);
+    const int right = buildNode(middle, last, index);
+
+    SceneBVHNode &node = nodes[index];
+    node.min = minVector(nodes[left].min, nodes[right].min);
+    node.max = maxVector(nodes[left].max, nodes[right].max);
+    node.skip = nodes.size();
+    currentArea += surfaceArea(node.min, node.max);
+    return index;
+}
+
+bool SceneBVH::refit(Entity *entity)
+{
+    auto it = leaves.constFind(entity);
+    if (it == leaves.constEnd())
+    {
+        // Nothing to do for entities that still have no bounds
+        QVector3D min, max;
+        return !worldBounds(entity, min, max);
+    }
+
+    int index = it.value();
+    if (!worldBounds(entity, nodes[index].min, nodes[index].max)) { return false; }
+
+    // Propagate the new bounds up to the root
+    index = nodes[index].parent;
+    while (index >= 0)
+    {
+        SceneBVHNode &node = nodes[index];
+        const SceneBVHNode &left = nodes[index + 1];
+        const SceneBVHNode &right = nodes[left.skip];
+        currentArea -= surfaceArea(node.min, node.max);
+        node.min = minVector(left.min, right.min);
+        node.max = maxVector(left.max, right.max);
+        currentArea += surfaceArea(node.min, node.max);
+        index = node.parent;
+    }
+
+    return true;
+}
+
+bool SceneBVH::isDegraded() const
+{
+    return currentArea > 2.0f * builtArea;
+}
+
+template <typename Overlaps>
+void SceneBVH::query(Overlaps overlaps, QVector<Entity*> &entities) const
+{
+    int index = 0;
+    while (index < nodes.size())
+    {
+        const SceneBVHNode &node = nodes[index];
+        if (overlaps(node.min, node.max))
+        {
+            if (node.entity != nullptr) { entities.push_back(node.entity); }
+            index++;
+        }
+        else
+        {
+            index = node.skip;
+        }
+    }
+}
+
+void SceneBVH::queryFrustum(const Frustum &frustum, QVector<Entity*> &entities) const
+{
+    query([&frustum](const QVector3D &min, const QVector3D &max) {
+        return frustum.intersectsBox(min, max);
+    }, entities);
+}
+
+void SceneBVH::querySphere(const QVector3D &center, float radius, QVector<Entity*> &entities) const
+{
+    const float radius2 = radius * radius;
+    query([&center, radius2](const QVector3D &min, const QVector3D &max) {
+        const QVector3D closest = minVector(maxVector(center, min), max);
+        return (closest - center).lengthSquared() <= radius2;
+    }, entities);
+}
+
+void SceneBVH::queryBox(const QVector3D &boxMin, const QVector3D &boxMax, QVector<Entity*> &entities) const
+{
+    query([&boxMin, &boxMax](const QVector3D &min, const QVector3D &max) {
+        return min.x() <= boxMax.x() && max.x() >= boxMin.x() &&
+               min.y() <= boxMax.y() && max.y() >= boxMin.y() &&
+               min.z() <= boxMax.z() && max.z() >= boxMin.z();
+    }, entities);
+}
+
+// Distance along the ray to the box (negative if missed)
+static float rayBoxDistance(const QVector3D &origin, const QVector3D &inverseDirection, const QVector3D &min, const QVector3D &max)
+{
+    float tmin = 0.0f;
+    float tmax = INFINITY;
+    for (int i = 0; i < 3; ++i)
+    {
+        float t0 = (min[i] - origin[i]) * inverseDirection[i];
+        float t1 = (max[i] - origin[i]) * inverseDirection[i];
+        if (t0 > t1) { std::swap(t0, t1); }
+        tmin = std::fmax(tmin, t0);
+        tmax = std::fmin(tmax, t1);
+        if (tmin > tmax) { return -1.0f; }
+    }
+    return tmin;
+}
+
+void SceneBVH::queryRay(const QVector3D &origin, const QVector3D &direction, QVector<Entity*> &entities) const
+{
+    const QVector3D inverseDirection(1.0f / direction.x(), 1.0f / direction.y(), 1.0f / direction.z());
+
+    QVector<QPair<float, Entity*>> hits;
+    int index = 0;
+    while (index < nodes.size())
+    {
+        const SceneBVHNode &node = nodes[index];
+        const float distance = rayBoxDistance(origin, inverseDirection, node.min, node.max);
+        if (distance >= 0.0f)
+        {
+            if (node.entity != nullptr) { hits.push_back(qMakePair(distance, node.entity)); }
+            index++;
+        }
+        else
+        {
+            index = node.skip;
+        }
+    }
+
+    std::sort(hits.begin(), hits.end(), [](const QPair<float, Entity*> &a, const QPair<float, Entity*> &b) {
+        return a.first < b.first;
+    });
+    for (const auto &hit : hits)
+    {
+        entities.push_back(hit.second);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef SCENEBVH_H
+#define SCENEBVH_H
+
+#include <QHash>
+#include <QVector>
+#include <QVector3D>
+
+class Entity;
+class Frustum;
+
+struct SceneBVHNode
+{
+    QVector3D min;
+    QVector3D max;
+    int parent = -1;
+    int skip = 0;             // Index of the node following this subtree
+    Entity *entity = nullptr; // Only set in leaves
+};
+
+// Bounding volume hierarchy over the world bounds of the entities with a
+// mesh. Nodes are stored in depth-first order (the left child follows its
+// parent and the right child is the left child's skip node), so queries
+// walk the array front to back without a stack.
+class SceneBVH
+{
+public:
+
+    SceneBVH();
+
+    void build(const QVector<Entity*> &entities);
+    void clear();
+
+    // Recomputes the bounds of an entity already in the tree. It returns
+    // false if the entity can't be refitted (it gained bounds outside the
+    // tree or no longer has them), in which case the tree must be rebuilt.
+    bool refit(Entity *entity);
+
+    // True when refits have degraded the tree enough to rebuild it
+    bool isDegraded() const;
+
+    // The results are appended to the vectors
+    void queryFrustum(const Frustum &frustum, QVector<Entity*> &entities) const;
+    void querySphere(const QVector3D &center, float radius, QVector<Entity*> &entities) const;
+    void queryBox(const QVector3D &min, const QVector3D &max, QVector<Entity*> &entities) const;
+
+    // Entities whose bounds are hit by the ray, sorted by entry distance
+    void queryRay(const QVector3D &origin, const QVector3D &direction, QVector<Entity*> &entities) const;
+
+    static bool worldBounds(const Entity *entity, QVector3D &min, QVector3D &max);
+
+private:
+
+    struct BuildItem
+    {
+        Entity *entity;
+        QVector3D min;
+        QVector3D max;
+        QVector3D centroid;
+    };
+
+    int buildNode(BuildItem *first, BuildItem *last, int parent);
+
+    template <typename Overlaps>
+    void query(Overlaps overlaps, QVector<Entity*> &entities) const;
+
+    QVector<SceneBVHNode> nodes;
+    QHash<Entity*, int> leaves;
+
+    float builtArea = 0.0f;   // Sum of internal node areas when built
+    float currentArea = 0.0f; // Same sum after the refits
+};
+
+#endif // SCENEBVH_H
@@ -7,4 +7,5 @@ Input *input = nullptr;
 Interaction *interaction = nullptr;
 Selection *selection = nullptr;
 MiscSettings *miscSettings = nullptr;
+JobSystem *jobSystem = nullptr;
 QString projectDirectory;
@@ -7,6 +7,9 @@
 
 bool Interaction::update()
 {
+    // Before reading the matrices of the selection
+    scene->updateTransforms();
+
     bool changed = false;
 
     switch (state)
@@ -97,7 +100,7 @@ bool Interaction::navigate()
         else{
             QVector3D target(0,0,0);
             if(selection->count != 0)
-                target = selection->entities[0]->transform->position;
+                target = QVector3D(selection->entities[0]->transform->matrix().column(3));
 
             // In radiants (entretainment)
             float rotationAngleX = 0.01 * mousex_delta;
@@ -219,7 +222,7 @@ bool Interaction::focus()
             entityRadius = (maxBounds - minBounds).length();
         }
 
-        QVector3D entityPosition = entity->transform->position;
+        QVector3D entityPosition = QVector3D(entity->transform->matrix().column(3));
         QVector3D viewingDirection = QVector3D(camera->worldMatrix * QVector4D(0.0, 0.0, -1.0, 0.0));
         QVector3D displacement = - 1.5 * entityRadius * viewingDirection.normalized();
         finalCameraPosition = entityPosition + displacement;
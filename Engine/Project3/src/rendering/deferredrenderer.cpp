@@ -1,13 +1,15 @@
 #include "deferredrenderer.h"
 #include "miscsettings.h"
-#include "ecs/scene.h"
-#include "ecs/camera.h"
+#include "framesnapshot.h"
 #include "resources/material.h"
 #include "resources/mesh.h"
 #include "resources/texture.h"
+#include "resources/texturearray.h"
+#include "resources/materialbuffer.h"
 #include "resources/shaderprogram.h"
 #include "resources/resourcemanager.h"
 #include "framebufferobject.h"
+#include "meshletculling.h"
 #include "gl.h"
 #include "globals.h"
 #include <QVector>
@@ -18,25 +20,26 @@
 #include <time.h>
 
 
-static void sendLightsToProgram(QOpenGLShaderProgram &program, const QMatrix4x4 &worldMatrix)
+// Feature bits of the shader variants, in the order of ShaderProgram::features
+enum GridFeatures { DrawGrid = 1 << 0 };
+enum LightingFeatures { DirectionalLight = 1 << 0 };
+enum AmbientFeatures { ApplyOcclusion = 1 << 0 };
+enum DOFFeatures { DepthOfField = 1 << 0 };
+enum BlitFeatures { BlitSimple = 1 << 0, BlitDepth = 1 << 1, BlitAlpha = 1 << 2 };
+
+static void sendLightsToProgram(QOpenGLShaderProgram &program, const QVector<LightDraw> &lights)
 {
     QVector<int> lightType;
     QVector<QVector3D> lightPosition;
     QVector<QVector3D> lightDirection;
     QVector<QVector3D> lightColor;
-    for (auto entity : scene->entities)
+    for (const LightDraw &light : lights)
     {
-        if (entity->active && entity->lightSource != nullptr)
-        {
-            auto light = entity->lightSource;
-            auto transform = *entity->transform;
-
-            lightType.push_back(int(light->type));
-            lightPosition.push_back(QVector3D(transform.matrix() * QVector4D(0.0, 0.0, 0.0, 1.0)));
-            lightDirection.push_back(QVector3D(transform.matrix() * QVector4D(0.0, 1.0, 0.0, 0.0)));
-            QVector3D color(light->color.redF(), light->color.greenF(), light->color.blueF());
-            lightColor.push_back(color * light->intensity);
-        }
+        lightType.push_back(int(light.type));
+        lightPosition.push_back(QVector3D(light.worldMatrix.column(3)));
+        lightDirection.push_back(QVector3D(light.worldMatrix.column(1)));
+        QVector3D color(light.color.redF(), light.color.greenF(), light.color.blueF());
+        lightColor.push_back(color * light.intensity);
     }
     if (lightPosition.size() > 0)
     {
@@ -121,7 +124,7 @@ void DeferredRenderer::initialize()
     ///Selection Mask
     maskProgram = resourceManager->createShaderProgram();
     maskProgram->name = "Mask";
-    maskProgram->vertexShaderFilename = "res/shaders/forward_shader/standard_shading.vert";
+    maskProgram->vertexShaderFilename = "res/shaders/mouse_picking/mousePicking.vert";
     maskProgram->fragmentShaderFilename = "res/shaders/outline/mask.frag";
     maskProgram->includeForSerialization = false;
 
@@ -137,6 +140,7 @@ void DeferredRenderer::initialize()
     gridProgram->name = "Grid";
     gridProgram->vertexShaderFilename = "res/shaders/grid/grid.vert";
     gridProgram->fragmentShaderFilename = "res/shaders/grid/grid.frag";
+    gridProgram->features << "DRAW_GRID";
     gridProgram->includeForSerialization = false;
 
     ///Deferred Lighting
@@ -144,6 +148,7 @@ void DeferredRenderer::initialize()
     deferredLightingProgram->name = "Deferred Lighting";
     deferredLightingProgram->vertexShaderFilename = "res/shaders/forward_shader/standard_shading.vert";
     deferredLightingProgram->fragmentShaderFilename = "res/shaders/lighting/deferred_lighting.frag";
+    deferredLightingProgram->features << "DIRECTIONAL_LIGHT";
     deferredLightingProgram->includeForSerialization = false;
 
     ///Ambient Lighting
@@ -151,6 +156,7 @@ void DeferredRenderer::initialize()
     ambientLightingProgram->name = "Ambient Lighting";
     ambientLightingProgram->vertexShaderFilename = "res/shaders/lighting/ambientLighting.vert";
     ambientLightingProgram->fragmentShaderFilename = "res/shaders/lighting/ambientLighting.frag";
+    ambientLightingProgram->features << "APPLY_OCCLUSION";
     ambientLightingProgram->includeForSerialization = false;
 
     /// DOF
@@ -158,6 +164,7 @@ void DeferredRenderer::initialize()
     DOFProgram->name = "DOF";
     DOFProgram->vertexShaderFilename = "res/shaders/dof/dof.vert";
     DOFProgram->fragmentShaderFilename = "res/shaders/dof/dof.frag";
+    DOFProgram->features << "DEPTH_OF_FIELD";
     DOFProgram->includeForSerialization = false;
 
     ///Blit to screen
@@ -165,8 +172,18 @@ void DeferredRenderer::initialize()
     blitProgram->name = "Blit";
     blitProgram->vertexShaderFilename = "res/shaders/blit/blit.vert";
     blitProgram->fragmentShaderFilename = "res/shaders/blit/blit.frag";
+    blitProgram->features << "BLIT_SIMPLE" << "BLIT_DEPTH" << "BLIT_ALPHA";
     blitProgram->includeForSerialization = false;
 
+    // Variants the passes use, asked for here so the render thread only
+    // looks them up
+    gridProgram->variant(DrawGrid);
+    deferredLightingProgram->variant(DirectionalLight);
+    ambientLightingProgram->variant(ApplyOcclusion);
+    DOFProgram->variant(DepthOfField);
+    blitProgram->variant(BlitSimple);
+    blitProgram->variant(BlitDepth);
+
 
     // Create FBO
     fboInfo = new FramebufferObject;
@@ -433,26 +450,26 @@ void DeferredRenderer::resize(int w, int h)
     fboFinal->release();
 }
 
-void DeferredRenderer::render(Camera *camera)
+void DeferredRenderer::render(const FrameSnapshot &frame)
 {
     OpenGLErrorGuard guard("DeferredRenderer::render()");
 
     // Passes
     fboInfo->bind();
-    passMeshes(camera);
-    passGrid(camera);
+    passMeshes(frame);
+    passGrid(frame);
     fboInfo->release();
     fboSSAO->bind();
-    passSSAO(camera);
+    passSSAO(frame);
     fboSSAO->release();
     fboLight->bind();
-    passAmbient();
-    passLights(camera);
+    passAmbient(frame);
+    passLights(frame);
     fboLight->release();
     fboPostProcess->bind();
-    passMask(camera);
-    passOutline();
-    passDOF();
+    passMask(frame);
+    passOutline(frame);
+    passDOF(frame);
     fboPostProcess->release();
 
     fboFinal->bind();
@@ -465,10 +482,10 @@ void DeferredRenderer::render(Camera *camera)
     passBlit();
 }
 
-void DeferredRenderer::renderIdentifiers(Camera* camera)
+void DeferredRenderer::renderIdentifiers(const FrameSnapshot &frame)
 {
     fboMousePick->bind();
-    passIdentifiers(camera);
+    passIdentifiers(frame);
     fboMousePick->release();
 }
 
@@ -488,12 +505,16 @@ unsigned int DeferredRenderer::getClickedIdentifier(int x, int y)
     return (r+g*256+b*256*256);
 }
 
-void DeferredRenderer::passMeshes(Camera *camera)
+void DeferredRenderer::passMeshes(const FrameSnapshot &frame)
 {
-    QOpenGLShaderProgram &program = deferredGeometryProgram->program;
+    const Camera &camera = frame.camera;
+    QOpenGLShaderProgram &program = *deferredGeometryProgram->program;
 
     if (program.bind())
     {
+        // Consecutive materials sharing texture arrays skip the binds
+        TextureArray::resetBindings();
+
         // Set FBO buffers
         unsigned int attachments_info[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
         gl->glDrawBuffers(3, attachments_info);
@@ -503,99 +524,88 @@ void DeferredRenderer::passMeshes(Camera *camera)
         gl->glClearColor(0.0f,0.0f,0.0f,1.0);
         gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        //Set uniforms
-        program.setUniformValue("viewMatrix", camera->viewMatrix);
-        program.setUniformValue("projectionMatrix", camera->projectionMatrix);
+        // Material index zero (the alpha of the position and normal) where nothing is drawn
+        const GLfloat noMaterial[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        gl->glClearBufferfv(GL_COLOR, 0, noMaterial);
+        gl->glClearBufferfv(GL_COLOR, 1, noMaterial);
 
-        sendLightsToProgram(program, camera->worldMatrix);
+        // Backfacing meshlets are culled too, so backfaces are never visible
+        gl->glEnable(GL_CULL_FACE);
+        gl->glCullFace(GL_BACK);
 
-        QVector<MeshRenderer*> meshRenderers;
-        QVector<LightSource*> lightSources;
+        //Set uniforms
+        program.setUniformValue("viewMatrix", camera.viewMatrix);
+        program.setUniformValue("projectionMatrix", camera.projectionMatrix);
 
-        // Get components
-        for (auto entity : scene->entities)
-        {
-            if (entity->active)
-            {
-                if (entity->meshRenderer != nullptr) { meshRenderers.push_back(entity->meshRenderer); }
-                if (entity->lightSource != nullptr) { lightSources.push_back(entity->lightSource); }
-            }
-        }
+        sendLightsToProgram(program, frame.lights);
+
+        // Visible index ranges of each submesh
+        QVector<MeshletDrawList> drawLists = cullMeshlets(frame);
+        ResourcePool<Texture> &textures = resourceManager->textures();
 
         // Meshes
-        for (auto meshRenderer : meshRenderers)
+        for (const MeshDraw &draw : frame.meshes)
         {
-            auto mesh = meshRenderer->mesh;
+            QMatrix4x4 worldViewMatrix = camera.viewMatrix * draw.worldMatrix;
+            QMatrix3x3 normalMatrix = camera.viewNormalMatrix * draw.normalMatrix;
 
-            if (mesh != nullptr)
-            {
-                QMatrix4x4 worldMatrix = meshRenderer->entity->transform->matrix();
-                QMatrix4x4 worldViewMatrix = camera->viewMatrix * worldMatrix;
-                QMatrix3x3 normalMatrix = worldViewMatrix.normalMatrix();
-
-                program.setUniformValue("worldMatrix", worldMatrix);
-                program.setUniformValue("worldViewMatrix", worldViewMatrix);
-                program.setUniformValue("normalMatrix", normalMatrix);
+            program.setUniformValue("worldMatrix", draw.worldMatrix);
+            program.setUniformValue("worldViewMatrix", worldViewMatrix);
+            program.setUniformValue("normalMatrix", normalMatrix);
 
-                int materialIndex = 0;
-                for (auto submesh : mesh->submeshes)
-                {
-                    // Get material from the component
-                    Material *material = nullptr;
-                    if (materialIndex < meshRenderer->materials.size()) {
-                        material = meshRenderer->materials[materialIndex];
-                    }
-                    if (material == nullptr) {
-                        material = resourceManager->materialWhite;
-                    }
-                    materialIndex++;
-
-#define SEND_TEXTURE(uniformName, tex1, tex2, texUnit) \
-    program.setUniformValue(uniformName, texUnit); \
-    if (tex1 != nullptr) { \
-    tex1->bind(texUnit); \
-                } else { \
-    tex2->bind(texUnit); \
+            for (int i = draw.firstSubmesh; i < draw.firstSubmesh + draw.submeshCount; ++i)
+            {
+                const MeshletDrawList &drawList = drawLists[i];
+                if (!drawList.complete && drawList.counts.isEmpty()) {
+                    continue;
                 }
 
-                    // Send the material to the shader
-                    program.setUniformValue("albedo", material->albedo);
-                    program.setUniformValue("emissive", material->emissive);
-                    program.setUniformValue("specular", material->specular);
-                    program.setUniformValue("smoothness", material->smoothness);
-                    program.setUniformValue("bumpiness", material->bumpiness);
-                    program.setUniformValue("tiling", material->tiling);
-                    SEND_TEXTURE("albedoTexture", material->albedoTexture, resourceManager->texWhite, 0);
-                    SEND_TEXTURE("emissiveTexture", material->emissiveTexture, resourceManager->texBlack, 1);
-                    SEND_TEXTURE("specularTexture", material->specularTexture, resourceManager->texBlack, 2);
-                    SEND_TEXTURE("normalTexture", material->normalsTexture, resourceManager->texNormal, 3);
-                    SEND_TEXTURE("bumpTexture", material->bumpTexture, resourceManager->texWhite, 4);
-
-                    submesh->draw();
-                }
+                const MaterialSnapshot &material = frame.materials[i];
+
+#define SEND_TEXTURE(uniformName, tex, texUnit) \
+    program.setUniformValue(uniformName "Array", texUnit); \
+    program.setUniformValue(uniformName "Texture", texUnit + 5); \
+    program.setUniformValue(uniformName "Layer", Texture::bindMaterialTexture(textures.get(tex), texUnit, texUnit + 5));
+
+                // Send the material to the shader, the lighting passes
+                // read its parameters from the material buffer
+                program.setUniformValue("materialIndex", material.index);
+                program.setUniformValue("albedo", material.albedo);
+                program.setUniformValue("emissive", material.emissive);
+                program.setUniformValue("specular", material.specular);
+                program.setUniformValue("smoothness", material.smoothness);
+                program.setUniformValue("bumpiness", material.bumpiness);
+                program.setUniformValue("tiling", material.tiling);
+                SEND_TEXTURE("albedo", material.albedoTexture, 0);
+                SEND_TEXTURE("emissive", material.emissiveTexture, 1);
+                SEND_TEXTURE("specular", material.specularTexture, 2);
+                SEND_TEXTURE("normal", material.normalsTexture, 3);
+                SEND_TEXTURE("bump", material.bumpTexture, 4);
+
+                drawList.draw(frame.submeshes[i]);
             }
         }
 
         // Light spheres
-        if (miscSettings->renderLightSources)
+        if (frame.settings.renderLightSources)
         {
-            for (auto lightSource : lightSources)
+            for (const LightDraw &light : frame.lights)
             {
-                QMatrix4x4 worldMatrix = lightSource->entity->transform->matrix();
                 QMatrix4x4 scaleMatrix; scaleMatrix.scale(0.1f, 0.1f, 0.1f);
-                QMatrix4x4 worldViewMatrix = camera->viewMatrix * worldMatrix * scaleMatrix;
-                QMatrix3x3 normalMatrix = worldViewMatrix.normalMatrix();
-                program.setUniformValue("worldMatrix", worldMatrix);
+                QMatrix4x4 worldViewMatrix = camera.viewMatrix * light.worldMatrix * scaleMatrix;
+                QMatrix3x3 normalMatrix = camera.viewNormalMatrix * light.normalMatrix * 10.0f;
+                program.setUniformValue("worldMatrix", light.worldMatrix);
                 program.setUniformValue("worldViewMatrix", worldViewMatrix);
                 program.setUniformValue("normalMatrix", normalMatrix);
 
                 for (auto submesh : resourceManager->sphere->submeshes)
                 {
                     // Send the material to the shader
-                    Material *material = resourceManager->materialLight;
-                    program.setUniformValue("albedo", material->albedo);
-                    program.setUniformValue("emissive", material->emissive);
-                    program.setUniformValue("smoothness", material->smoothness);
+                    const MaterialSnapshot &material = frame.lightMaterial;
+                    program.setUniformValue("materialIndex", material.index);
+                    program.setUniformValue("albedo", material.albedo);
+                    program.setUniformValue("emissive", material.emissive);
+                    program.setUniformValue("smoothness", material.smoothness);
 
                     submesh->draw();
                 }
@@ -606,12 +616,13 @@ void DeferredRenderer::passMeshes(Camera *camera)
     }
 }
 
-void DeferredRenderer::passGrid(Camera *camera){
+void DeferredRenderer::passGrid(const FrameSnapshot &frame){
+    const Camera &camera = frame.camera;
     gl->glEnable(GL_BLEND);
     gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     gl->glDepthMask(GL_FALSE);
 
-    QOpenGLShaderProgram &program = gridProgram->program;
+    QOpenGLShaderProgram &program = *gridProgram->variant(frame.settings.grid ? DrawGrid : 0);
 
     if(program.bind()){
 
@@ -623,25 +634,24 @@ void DeferredRenderer::passGrid(Camera *camera){
         gl->glClearColor(0.0f,0.0f,0.0f,1.0);
         gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        QVector4D cameraParameters = camera->getLeftRightBottomTop();
+        QVector4D cameraParameters = camera.getLeftRightBottomTop();
 
         // Grid parameters
         program.setUniformValue("left", cameraParameters.x());
         program.setUniformValue("right", cameraParameters.y());
         program.setUniformValue("bottom", cameraParameters.z());
         program.setUniformValue("top", cameraParameters.w());
-        program.setUniformValue("znear", camera->znear);
-        program.setUniformValue("worldMatrix", camera->worldMatrix);
-        program.setUniformValue("viewMatrix", camera->viewMatrix);
-        program.setUniformValue("projectionMatrix", camera->projectionMatrix);
+        program.setUniformValue("znear", camera.znear);
+        program.setUniformValue("worldMatrix", camera.worldMatrix);
+        program.setUniformValue("viewMatrix", camera.viewMatrix);
+        program.setUniformValue("projectionMatrix", camera.projectionMatrix);
 
         // Models depth
         gl->glActiveTexture(GL_TEXTURE0);
         gl->glBindTexture(GL_TEXTURE_2D, fboDepth);
 
         // Background parameters
-        program.setUniformValue("backgroundColor", miscSettings->backgroundColor);
-        program.setUniformValue("drawGrid", miscSettings->grid);
+        program.setUniformValue("backgroundColor", frame.settings.backgroundColor);
 
         resourceManager->quad->submeshes[0]->draw();
 
@@ -653,25 +663,37 @@ void DeferredRenderer::passGrid(Camera *camera){
     gl->glDisable(GL_BLEND);
 }
 
-void DeferredRenderer::passLights(Camera *camera)
+void DeferredRenderer::passLights(const FrameSnapshot &frame)
 {
-    QOpenGLShaderProgram &program = deferredLightingProgram->program;
+    const Camera &camera = frame.camera;
 
-    if (program.bind())
-    {
-        // Set FBO buffers
-        gl->glDrawBuffer(GL_COLOR_ATTACHMENT1); //Clear only attachments 1 (light circles) as attachment 0 has been cleared in passAmbient()
+    // Set FBO buffers
+    gl->glDrawBuffer(GL_COLOR_ATTACHMENT1); //Clear only attachments 1 (light circles) as attachment 0 has been cleared in passAmbient()
 
-        // Clear color
-        gl->glClearDepth(1.0);
-        gl->glClearColor(0.0f,0.0f,0.0f,1.0);
-        gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Clear color
+    gl->glClearDepth(1.0);
+    gl->glClearColor(0.0f,0.0f,0.0f,1.0);
+    gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    unsigned int attachments_final[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    gl->glDrawBuffers(2, attachments_final);
+
+    gl->glEnable(GL_BLEND);
+    gl->glBlendFunc(GL_ONE, GL_ONE);
 
-        unsigned int attachments_final[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-        gl->glDrawBuffers(2, attachments_final);
+    // Every type of light has its own shader variant
+    const LightSource::Type lightTypes[] = { LightSource::Type::Point, LightSource::Type::Directional };
+    for (auto lightType : lightTypes)
+    {
+        QOpenGLShaderProgram &program = *deferredLightingProgram->variant(lightType == LightSource::Type::Directional ? DirectionalLight : 0);
+
+        if (!program.bind())
+        {
+            continue;
+        }
 
         //Set uniforms
-        program.setUniformValue("viewMatrix", camera->viewMatrix);
+        program.setUniformValue("viewMatrix", camera.viewMatrix);
 
         gl->glActiveTexture(GL_TEXTURE0);
         gl->glBindTexture(GL_TEXTURE_2D, fboPosition);
@@ -682,32 +704,40 @@ void DeferredRenderer::passLights(Camera *camera)
         program.setUniformValue("gPosition", 0);
         program.setUniformValue("gNormal", 1);
         program.setUniformValue("gColor", 2);
+        resourceManager->materialBuffer->bind(3);
+        program.setUniformValue("materialParameters", 3);
 
-        program.setUniformValue("cameraPos", camera->position);
-        program.setUniformValue("viewportSize", QVector2D(camera->viewportWidth, camera->viewportHeight));
-
-        gl->glEnable(GL_BLEND);
-        gl->glBlendFunc(GL_ONE, GL_ONE);
+        program.setUniformValue("cameraPos", camera.position);
+        program.setUniformValue("viewportSize", QVector2D(camera.viewportWidth, camera.viewportHeight));
 
         //Render spheres on lights
-        for (auto entity : scene->entities)
+        for (const LightDraw &lightDraw : frame.lights)
         {
-            if (entity->active && entity->lightSource != nullptr)
+            if (lightDraw.type == lightType)
             {
-                auto light = entity->lightSource;
-                auto transform = *entity->transform;
+                auto light = &lightDraw;
+                const QVector3D worldPosition = QVector3D(light->worldMatrix.column(3));
 
+                // Skip point lights that don't reach any object
+                if (!light->lightsSomething) continue;
+
+                // Light volume: a sphere of the light radius, or centered for directional lights
+                QVector3D lightPosition;
+                QMatrix4x4 worldMatrix;
                 if (light->type == LightSource::Type::Point)
-                    transform.scale = QVector3D(light->radius,light->radius, light->radius);
+                {
+                    lightPosition = worldPosition;
+                    worldMatrix.translate(lightPosition);
+                    worldMatrix.scale(light->radius);
+                }
                 else
                 {
-                    transform.position = QVector3D(0.0f,0.0f,0.0f);
-                    transform.scale = QVector3D(1.0f,1.0f,1.0f);
+                    worldMatrix = light->worldMatrix;
+                    worldMatrix.setColumn(3, QVector4D(0.0f, 0.0f, 0.0f, 1.0f));
                 }
-                QMatrix4x4 worldMatrix = transform.matrix();
-                QMatrix4x4 worldViewMatrix = camera->viewMatrix * worldMatrix;
+                QMatrix4x4 worldViewMatrix = camera.viewMatrix * worldMatrix;
                 QMatrix3x3 normalMatrix = worldViewMatrix.normalMatrix();
-                QMatrix4x4 projectionMatrix = camera->projectionMatrix;
+                QMatrix4x4 projectionMatrix = camera.projectionMatrix;
 
                 if(light->type ==  LightSource::Type::Directional){
                     projectionMatrix = QMatrix4x4();
@@ -719,9 +749,8 @@ void DeferredRenderer::passLights(Camera *camera)
                 program.setUniformValue("normalMatrix", normalMatrix);
                 program.setUniformValue("projectionMatrix", projectionMatrix);
 
-                program.setUniformValue("lightType", (int)light->type);
-                program.setUniformValue("lightPosition", transform.position);
-                program.setUniformValue("lightDirection", QVector3D(transform.matrix() * QVector4D(0.0, 1.0, 0.0, 0.0)));
+                program.setUniformValue("lightPosition", lightPosition);
+                program.setUniformValue("lightDirection", QVector3D(light->worldMatrix.column(1)).normalized());
                 QVector3D color = {light->color.red()/255.0f, light->color.green()/255.0f, light->color.blue()/255.0f};
                 program.setUniformValue("lightColor", color);
                 program.setUniformValue("lightIntensity", light->intensity);
@@ -741,16 +770,16 @@ void DeferredRenderer::passLights(Camera *camera)
             }
         }
 
-        gl->glDisable(GL_BLEND);
-        gl->glDisable(GL_CULL_FACE);
-
         program.release();
     }
+
+    gl->glDisable(GL_BLEND);
+    gl->glDisable(GL_CULL_FACE);
 }
 
-void DeferredRenderer::passAmbient()
+void DeferredRenderer::passAmbient(const FrameSnapshot &frame)
 {
-    QOpenGLShaderProgram &program = ambientLightingProgram->program;
+    QOpenGLShaderProgram &program = *ambientLightingProgram->variant(frame.settings.ambientOcclusion ? ApplyOcclusion : 0);
     if(program.bind()){
         // Set FBO buffers
         gl->glDrawBuffer(GL_COLOR_ATTACHMENT0);
@@ -760,15 +789,22 @@ void DeferredRenderer::passAmbient()
         gl->glClearColor(0.0f,0.0f,0.0f,1.0);
         gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        program.setUniformValue("ambientValue", miscSettings->ambientValue);
-        program.setUniformValue("applyOcclusion", miscSettings->ambientOcclusion);
+        program.setUniformValue("ambientValue", frame.settings.ambientValue);
 
         gl->glActiveTexture(GL_TEXTURE0);
         gl->glBindTexture(GL_TEXTURE_2D, fboColor);
         gl->glActiveTexture(GL_TEXTURE1);
         gl->glBindTexture(GL_TEXTURE_2D, fboAO);
+        gl->glActiveTexture(GL_TEXTURE2);
+        gl->glBindTexture(GL_TEXTURE_2D, fboPosition);
+        gl->glActiveTexture(GL_TEXTURE3);
+        gl->glBindTexture(GL_TEXTURE_2D, fboNormal);
+        resourceManager->materialBuffer->bind(4);
         program.setUniformValue("gColor", 0);
         program.setUniformValue("ssao", 1);
+        program.setUniformValue("gPosition", 2);
+        program.setUniformValue("gNormal", 3);
+        program.setUniformValue("materialParameters", 4);
 
         resourceManager->quad->submeshes[0]->draw();
 
@@ -776,9 +812,10 @@ void DeferredRenderer::passAmbient()
     }
 }
 
-void DeferredRenderer::passSSAO(Camera *camera)
+void DeferredRenderer::passSSAO(const FrameSnapshot &frame)
 {
-    QOpenGLShaderProgram &program = ssaoProgram->program;
+    const Camera &camera = frame.camera;
+    QOpenGLShaderProgram &program = *ssaoProgram->program;
     if(program.bind()){
         // Set FBO buffers
         gl->glDrawBuffer(GL_COLOR_ATTACHMENT0);
@@ -787,8 +824,8 @@ void DeferredRenderer::passSSAO(Camera *camera)
         gl->glClearColor(0.0f,0.0f,0.0f,1.0);
         gl->glClear(GL_COLOR_BUFFER_BIT);
 
-        program.setUniformValue("projectionMatrix", camera->projectionMatrix);
-        program.setUniformValue("viewMatrix", camera->viewMatrix);
+        program.setUniformValue("projectionMatrix", camera.projectionMatrix);
+        program.setUniformValue("viewMatrix", camera.viewMatrix);
         program.setUniformValueArray("samples", &ssaoKernel[0], 64);
 
         gl->glActiveTexture(GL_TEXTURE0);
@@ -810,9 +847,10 @@ void DeferredRenderer::passSSAO(Camera *camera)
     }
 }
 
-void DeferredRenderer::passIdentifiers(Camera *camera)
+void DeferredRenderer::passIdentifiers(const FrameSnapshot &frame)
 {
-    QOpenGLShaderProgram &program = mousePickProgram->program;
+    const Camera &camera = frame.camera;
+    QOpenGLShaderProgram &program = *mousePickProgram->program;
 
     if (program.bind())
     {
@@ -824,55 +862,36 @@ void DeferredRenderer::passIdentifiers(Camera *camera)
         gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         //Set uniforms
-        program.setUniformValue("projectionMatrix", camera->projectionMatrix);
+        program.setUniformValue("projectionMatrix", camera.projectionMatrix);
 
-        QVector<MeshRenderer*> meshRenderers;
-        QVector<LightSource*> lightSources;
-
-        // Get components
-        for (auto entity : scene->entities)
+        // Meshes that may be under the cursor
+        for (const MeshDraw &draw : frame.pickMeshes)
         {
-            if (entity->active)
-            {
-                if (entity->meshRenderer != nullptr) { meshRenderers.push_back(entity->meshRenderer); }
-                if (entity->lightSource != nullptr) { lightSources.push_back(entity->lightSource); }
-            }
-        }
+            QMatrix4x4 worldViewMatrix = camera.viewMatrix * draw.worldMatrix;
 
-        // Meshes
-        for (auto meshRenderer : meshRenderers)
-        {
-            auto mesh = meshRenderer->mesh;
+            program.setUniformValue("worldViewMatrix", worldViewMatrix);
+            program.setUniformValue("colorId", draw.idColor);
 
-            if (mesh != nullptr)
+            for (int i = draw.firstSubmesh; i < draw.firstSubmesh + draw.submeshCount; ++i)
             {
-                QMatrix4x4 worldViewMatrix = camera->viewMatrix * meshRenderer->entity->transform->matrix();
-
-                program.setUniformValue("worldViewMatrix", worldViewMatrix);
-                program.setUniformValue("colorId", meshRenderer->entity->getIDColor());
-
-                for (auto submesh : mesh->submeshes)
-                {
-                    submesh->draw();
-                }
+                frame.submeshes[i]->drawPositions();
             }
         }
 
         // Light spheres
-        if (miscSettings->renderLightSources)
+        if (frame.settings.renderLightSources)
         {
-            for (auto lightSource : lightSources)
+            for (const LightDraw &light : frame.lights)
             {
-                QMatrix4x4 worldMatrix = lightSource->entity->transform->matrix();
                 QMatrix4x4 scaleMatrix; scaleMatrix.scale(0.1f, 0.1f, 0.1f);
-                QMatrix4x4 worldViewMatrix = camera->viewMatrix * worldMatrix * scaleMatrix;
+                QMatrix4x4 worldViewMatrix = camera.viewMatrix * light.worldMatrix * scaleMatrix;
 
                 program.setUniformValue("worldViewMatrix", worldViewMatrix);
-                program.setUniformValue("colorId", lightSource->entity->getIDColor());
+                program.setUniformValue("colorId", light.idColor);
 
                 for (auto submesh : resourceManager->sphere->submeshes)
                 {
-                    submesh->draw();
+                    submesh->drawPositions();
                 }
             }
         }
@@ -881,9 +900,10 @@ void DeferredRenderer::passIdentifiers(Camera *camera)
     }
 }
 
-void DeferredRenderer::passMask(Camera *camera)
+void DeferredRenderer::passMask(const FrameSnapshot &frame)
 {
-    QOpenGLShaderProgram &program = maskProgram->program;
+    const Camera &camera = frame.camera;
+    QOpenGLShaderProgram &program = *maskProgram->program;
 
     if (program.bind())
     {
@@ -895,56 +915,35 @@ void DeferredRenderer::passMask(Camera *camera)
         gl->glClear(GL_COLOR_BUFFER_BIT);
 
         //Set uniforms
-        program.setUniformValue("projectionMatrix", camera->projectionMatrix);
-
-        QVector<MeshRenderer*> meshRenderers;
-        QVector<LightSource*> lightSources;
-
-        // Get components
-        for (int i = 0; i < selection->count; ++i)
-        {
-            Entity* entity = selection->entities[i];
-            if (entity->active)
-            {
-                if (entity->meshRenderer != nullptr) { meshRenderers.push_back(entity->meshRenderer); }
-                if (entity->lightSource != nullptr) { lightSources.push_back(entity->lightSource); }
-            }
-        }
+        program.setUniformValue("projectionMatrix", camera.projectionMatrix);
 
         // Meshes
-        for (auto meshRenderer : meshRenderers)
+        for (const MeshDraw &draw : frame.selectedMeshes)
         {
-            auto mesh = meshRenderer->mesh;
-
-            if (mesh != nullptr)
-            {
-                QMatrix4x4 worldMatrix = meshRenderer->entity->transform->matrix();
-                QMatrix4x4 worldViewMatrix = camera->viewMatrix * worldMatrix;
+            QMatrix4x4 worldViewMatrix = camera.viewMatrix * draw.worldMatrix;
 
-                program.setUniformValue("worldMatrix", worldMatrix);
-                program.setUniformValue("worldViewMatrix", worldViewMatrix);
+            program.setUniformValue("worldMatrix", draw.worldMatrix);
+            program.setUniformValue("worldViewMatrix", worldViewMatrix);
 
-                for (auto submesh : mesh->submeshes)
-                {
-                    submesh->draw();
-                }
+            for (int i = draw.firstSubmesh; i < draw.firstSubmesh + draw.submeshCount; ++i)
+            {
+                frame.submeshes[i]->drawPositions();
             }
         }
 
         // Light spheres
-        if (miscSettings->renderLightSources)
+        if (frame.settings.renderLightSources)
         {
-            for (auto lightSource : lightSources)
+            for (const LightDraw &light : frame.selectedLights)
             {
-                QMatrix4x4 worldMatrix = lightSource->entity->transform->matrix();
                 QMatrix4x4 scaleMatrix; scaleMatrix.scale(0.1f, 0.1f, 0.1f);
-                QMatrix4x4 worldViewMatrix = camera->viewMatrix * worldMatrix * scaleMatrix;
-                program.setUniformValue("worldMatrix", worldMatrix);
+                QMatrix4x4 worldViewMatrix = camera.viewMatrix * light.worldMatrix * scaleMatrix;
+                program.setUniformValue("worldMatrix", light.worldMatrix);
                 program.setUniformValue("worldViewMatrix", worldViewMatrix);
 
                 for (auto submesh : resourceManager->sphere->submeshes)
                 {
-                    submesh->draw();
+                    submesh->drawPositions();
                 }
             }
         }
@@ -953,9 +952,9 @@ void DeferredRenderer::passMask(Camera *camera)
     }
 }
 
-void DeferredRenderer::passOutline()
+void DeferredRenderer::passOutline(const FrameSnapshot &frame)
 {
-    QOpenGLShaderProgram &program = outlineProgram->program;
+    QOpenGLShaderProgram &program = *outlineProgram->program;
     if(program.bind()){
         // Set FBO buffers
         gl->glDrawBuffer(GL_COLOR_ATTACHMENT3);
@@ -965,8 +964,8 @@ void DeferredRenderer::passOutline()
         gl->glClearColor(0.0f,0.0f,0.0f,0.0);
         gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        program.setUniformValue("outlineColor", miscSettings->outlineColor);
-        program.setUniformValue("outlineThickness", miscSettings->outlineThickness);
+        program.setUniformValue("outlineColor", frame.settings.outlineColor);
+        program.setUniformValue("outlineThickness", frame.settings.outlineThickness);
 
         gl->glActiveTexture(GL_TEXTURE0);
         gl->glBindTexture(GL_TEXTURE_2D, fboMask);
@@ -978,9 +977,10 @@ void DeferredRenderer::passOutline()
     }
 }
 
-void DeferredRenderer::passDOF(){
+void DeferredRenderer::passDOF(const FrameSnapshot &frame){
 
-    QOpenGLShaderProgram &program = DOFProgram->program;
+    const Camera &camera = frame.camera;
+    QOpenGLShaderProgram &program = *DOFProgram->variant(camera.depthFocus >= 0.0f ? DepthOfField : 0);
 
     if(program.bind()){
 
@@ -989,10 +989,10 @@ void DeferredRenderer::passDOF(){
         gl->glBindTexture(GL_TEXTURE_2D, fboDepth);
         program.setUniformValue("depth", 0);
         program.setUniformValue("color", 1);
-        program.setUniformValue("depthFocus", camera->depthFocus);
-        program.setUniformValue("viewportSize", QVector2D(camera->viewportWidth, camera->viewportHeight));
-        program.setUniformValue("fallofStartMargin", camera->depthFallofStartMargin);
-        program.setUniformValue("fallofEndMargin", camera->depthFallofEndMargin);
+        program.setUniformValue("depthFocus", camera.depthFocus);
+        program.setUniformValue("viewportSize", QVector2D(camera.viewportWidth, camera.viewportHeight));
+        program.setUniformValue("fallofStartMargin", camera.depthFallofStartMargin);
+        program.setUniformValue("fallofEndMargin", camera.depthFallofEndMargin);
 
         // Vertical pass
         // Draw on fboDOFV
@@ -1037,7 +1037,7 @@ void DeferredRenderer::finalMix(){
     gl->glEnable(GL_BLEND);
     gl->glBlendFunc(GL_ONE, GL_ONE);
 
-    QOpenGLShaderProgram &program = blitProgram->program;
+    QOpenGLShaderProgram &program = *blitProgram->variant(BlitSimple);
     if(program.bind()){
         // Set FBO buffers
         gl->glDrawBuffer(GL_COLOR_ATTACHMENT0);
@@ -1047,7 +1047,6 @@ void DeferredRenderer::finalMix(){
         gl->glClearColor(0.0f,0.0f,0.0f,1.0);
         gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        program.setUniformValue("blitSimple", true);
         gl->glActiveTexture(GL_TEXTURE0);
 
         // Background
@@ -1073,14 +1072,11 @@ void DeferredRenderer::passBlit()
 {
     gl->glDisable(GL_DEPTH_TEST);
 
-    QOpenGLShaderProgram &program = blitProgram->program;
+    const bool depth = (shownTexture() == "Depth");
+    QOpenGLShaderProgram &program = *blitProgram->variant(depth ? BlitDepth : 0);
 
     if (program.bind())
     {
-        program.setUniformValue("blitSimple", false);
-        program.setUniformValue("blitDepth", false);
-        program.setUniformValue("blitAlpha", false);
-
         program.setUniformValue("colorTexture", 0);
         gl->glActiveTexture(GL_TEXTURE0);
 
@@ -1104,8 +1100,7 @@ void DeferredRenderer::passBlit()
             gl->glBindTexture(GL_TEXTURE_2D, fboIdentifiers);
         } else if(shownTexture() == "DOF"){
             gl->glBindTexture(GL_TEXTURE_2D, fboDOF);
-        } else if(shownTexture() == "Depth"){
-            program.setUniformValue("blitDepth", true);
+        } else if(depth){
             gl->glBindTexture(GL_TEXTURE_2D, fboDepth);
         }
 
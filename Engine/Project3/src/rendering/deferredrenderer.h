@@ -18,22 +18,23 @@ public:
     void finalize() override;
 
     void resize(int width, int height) override;
-    void render(Camera *camera) override;
+    void render(const FrameSnapshot &frame) override;
 
-    void renderIdentifiers(Camera* camera);
+    // Draws the identifiers of FrameSnapshot::pickMeshes (and the light spheres)
+    void renderIdentifiers(const FrameSnapshot &frame);
     unsigned int getClickedIdentifier(int x, int y);
 
 private:
 
-    void passGrid(Camera* camera);
-    void passMeshes(Camera *camera);
-    void passLights(Camera *camera);
-    void passAmbient();
-    void passSSAO(Camera *camera);
-    void passIdentifiers(Camera *camera);
-    void passMask(Camera *camera);
-    void passOutline();
-    void passDOF();
+    void passGrid(const FrameSnapshot &frame);
+    void passMeshes(const FrameSnapshot &frame);
+    void passLights(const FrameSnapshot &frame);
+    void passAmbient(const FrameSnapshot &frame);
+    void passSSAO(const FrameSnapshot &frame);
+    void passIdentifiers(const FrameSnapshot &frame);
+    void passMask(const FrameSnapshot &frame);
+    void passOutline(const FrameSnapshot &frame);
+    void passDOF(const FrameSnapshot &frame);
     void finalMix();
     void passBlit();
 
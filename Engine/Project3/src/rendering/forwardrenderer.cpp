@@ -1,13 +1,14 @@
 #include "forwardrenderer.h"
 #include "miscsettings.h"
-#include "ecs/scene.h"
-#include "ecs/camera.h"
+#include "framesnapshot.h"
 #include "resources/material.h"
 #include "resources/mesh.h"
 #include "resources/texture.h"
+#include "resources/texturearray.h"
 #include "resources/shaderprogram.h"
 #include "resources/resourcemanager.h"
 #include "framebufferobject.h"
+#include "meshletculling.h"
 #include "gl.h"
 #include "globals.h"
 #include <QVector>
@@ -16,25 +17,19 @@
 #include <QOpenGLTexture>
 
 
-static void sendLightsToProgram(QOpenGLShaderProgram &program, const QMatrix4x4 &worldMatrix)
+static void sendLightsToProgram(QOpenGLShaderProgram &program, const QVector<LightDraw> &lights)
 {
     QVector<int> lightType;
     QVector<QVector3D> lightPosition;
     QVector<QVector3D> lightDirection;
     QVector<QVector3D> lightColor;
-    for (auto entity : scene->entities)
+    for (const LightDraw &light : lights)
     {
-        if (entity->active && entity->lightSource != nullptr)
-        {
-            auto light = entity->lightSource;
-            auto transform = *entity->transform;
-
-            lightType.push_back(int(light->type));
-            lightPosition.push_back(QVector3D(transform.matrix() * QVector4D(0.0, 0.0, 0.0, 1.0)));
-            lightDirection.push_back(QVector3D(transform.matrix() * QVector4D(0.0, 1.0, 0.0, 0.0)));
-            QVector3D color(light->color.redF(), light->color.greenF(), light->color.blueF());
-            lightColor.push_back(color * light->intensity);
-        }
+        lightType.push_back(int(light.type));
+        lightPosition.push_back(QVector3D(light.worldMatrix.column(3)));
+        lightDirection.push_back(QVector3D(light.worldMatrix.column(1)));
+        QVector3D color(light.color.redF(), light.color.greenF(), light.color.blueF());
+        lightColor.push_back(color * light.intensity);
     }
     if (lightPosition.size() > 0)
     {
@@ -128,7 +123,7 @@ void ForwardRenderer::resize(int w, int h)
     fbo->release();
 }
 
-void ForwardRenderer::render(Camera *camera)
+void ForwardRenderer::render(const FrameSnapshot &frame)
 {
     OpenGLErrorGuard guard("ForwardRenderer::render()");
 
@@ -136,14 +131,14 @@ void ForwardRenderer::render(Camera *camera)
 
     // Clear color
     gl->glClearDepth(1.0);
-    gl->glClearColor(miscSettings->backgroundColor.redF(),
-                     miscSettings->backgroundColor.greenF(),
-                     miscSettings->backgroundColor.blueF(),
+    gl->glClearColor(frame.settings.backgroundColor.redF(),
+                     frame.settings.backgroundColor.greenF(),
+                     frame.settings.backgroundColor.blueF(),
                      1.0);
     gl->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Passes
-    passMeshes(camera);
+    passMeshes(frame);
 
     fbo->release();
 
@@ -152,106 +147,87 @@ void ForwardRenderer::render(Camera *camera)
     passBlit();
 }
 
-void ForwardRenderer::passMeshes(Camera *camera)
+void ForwardRenderer::passMeshes(const FrameSnapshot &frame)
 {
-    QOpenGLShaderProgram &program = forwardProgram->program;
+    const Camera &camera = frame.camera;
+    QOpenGLShaderProgram &program = *forwardProgram->program;
 
     if (program.bind())
     {
+        // Consecutive materials sharing texture arrays skip the binds
+        TextureArray::resetBindings();
+
         gl->glDrawBuffer(GL_COLOR_ATTACHMENT0);
 
-        program.setUniformValue("viewMatrix", camera->viewMatrix);
-        program.setUniformValue("projectionMatrix", camera->projectionMatrix);
+        program.setUniformValue("viewMatrix", camera.viewMatrix);
+        program.setUniformValue("projectionMatrix", camera.projectionMatrix);
 
-        sendLightsToProgram(program, camera->worldMatrix);
+        sendLightsToProgram(program, frame.lights);
 
-        QVector<MeshRenderer*> meshRenderers;
-        QVector<LightSource*> lightSources;
-
-        // Get components
-        for (auto entity : scene->entities)
-        {
-            if (entity->active)
-            {
-                if (entity->meshRenderer != nullptr) { meshRenderers.push_back(entity->meshRenderer); }
-                if (entity->lightSource != nullptr) { lightSources.push_back(entity->lightSource); }
-            }
-        }
+        // Visible index ranges of each submesh
+        QVector<MeshletDrawList> drawLists = cullMeshlets(frame);
+        ResourcePool<Texture> &textures = resourceManager->textures();
 
         // Meshes
-        for (auto meshRenderer : meshRenderers)
+        for (const MeshDraw &draw : frame.meshes)
         {
-            auto mesh = meshRenderer->mesh;
-
-            if (mesh != nullptr)
-            {
-                QMatrix4x4 worldMatrix = meshRenderer->entity->transform->matrix();
-                QMatrix4x4 worldViewMatrix = camera->viewMatrix * worldMatrix;
-                QMatrix3x3 normalMatrix = worldViewMatrix.normalMatrix();
+            QMatrix4x4 worldViewMatrix = camera.viewMatrix * draw.worldMatrix;
+            QMatrix3x3 normalMatrix = camera.viewNormalMatrix * draw.normalMatrix;
 
-                program.setUniformValue("worldMatrix", worldMatrix);
-                program.setUniformValue("worldViewMatrix", worldViewMatrix);
-                program.setUniformValue("normalMatrix", normalMatrix);
+            program.setUniformValue("worldMatrix", draw.worldMatrix);
+            program.setUniformValue("worldViewMatrix", worldViewMatrix);
+            program.setUniformValue("normalMatrix", normalMatrix);
 
-                int materialIndex = 0;
-                for (auto submesh : mesh->submeshes)
-                {
-                    // Get material from the component
-                    Material *material = nullptr;
-                    if (materialIndex < meshRenderer->materials.size()) {
-                        material = meshRenderer->materials[materialIndex];
-                    }
-                    if (material == nullptr) {
-                        material = resourceManager->materialWhite;
-                    }
-                    materialIndex++;
-
-#define SEND_TEXTURE(uniformName, tex1, tex2, texUnit) \
-    program.setUniformValue(uniformName, texUnit); \
-    if (tex1 != nullptr) { \
-    tex1->bind(texUnit); \
-                } else { \
-    tex2->bind(texUnit); \
+            for (int i = draw.firstSubmesh; i < draw.firstSubmesh + draw.submeshCount; ++i)
+            {
+                const MeshletDrawList &drawList = drawLists[i];
+                if (!drawList.complete && drawList.counts.isEmpty()) {
+                    continue;
                 }
 
-                    // Send the material to the shader
-                    program.setUniformValue("albedo", material->albedo);
-                    program.setUniformValue("emissive", material->emissive);
-                    program.setUniformValue("specular", material->specular);
-                    program.setUniformValue("smoothness", material->smoothness);
-                    program.setUniformValue("bumpiness", material->bumpiness);
-                    program.setUniformValue("tiling", material->tiling);
-                    SEND_TEXTURE("albedoTexture", material->albedoTexture, resourceManager->texWhite, 0);
-                    SEND_TEXTURE("emissiveTexture", material->emissiveTexture, resourceManager->texBlack, 1);
-                    SEND_TEXTURE("specularTexture", material->specularTexture, resourceManager->texBlack, 2);
-                    SEND_TEXTURE("normalTexture", material->normalsTexture, resourceManager->texNormal, 3);
-                    SEND_TEXTURE("bumpTexture", material->bumpTexture, resourceManager->texWhite, 4);
-
-                    submesh->draw();
-                }
+                const MaterialSnapshot &material = frame.materials[i];
+
+#define SEND_TEXTURE(uniformName, tex, texUnit) \
+    program.setUniformValue(uniformName "Array", texUnit); \
+    program.setUniformValue(uniformName "Texture", texUnit + 5); \
+    program.setUniformValue(uniformName "Layer", Texture::bindMaterialTexture(textures.get(tex), texUnit, texUnit + 5));
+
+                // Send the material to the shader
+                program.setUniformValue("albedo", material.albedo);
+                program.setUniformValue("emissive", material.emissive);
+                program.setUniformValue("specular", material.specular);
+                program.setUniformValue("smoothness", material.smoothness);
+                program.setUniformValue("bumpiness", material.bumpiness);
+                program.setUniformValue("tiling", material.tiling);
+                SEND_TEXTURE("albedo", material.albedoTexture, 0);
+                SEND_TEXTURE("emissive", material.emissiveTexture, 1);
+                SEND_TEXTURE("specular", material.specularTexture, 2);
+                SEND_TEXTURE("normal", material.normalsTexture, 3);
+                SEND_TEXTURE("bump", material.bumpTexture, 4);
+
+                drawList.draw(frame.submeshes[i]);
             }
         }
 
         // Light spheres
-        if (miscSettings->renderLightSources)
+        if (frame.settings.renderLightSources)
         {
-            for (auto lightSource : lightSources)
+            for (const LightDraw &light : frame.lights)
             {
-                QMatrix4x4 worldMatrix = lightSource->entity->transform->matrix();
                 QMatrix4x4 scaleMatrix; scaleMatrix.scale(0.1f, 0.1f, 0.1f);
-                QMatrix4x4 worldViewMatrix = camera->viewMatrix * worldMatrix * scaleMatrix;
-                QMatrix3x3 normalMatrix = worldViewMatrix.normalMatrix();
-                program.setUniformValue("worldMatrix", worldMatrix);
+                QMatrix4x4 worldViewMatrix = camera.viewMatrix * light.worldMatrix * scaleMatrix;
+                QMatrix3x3 normalMatrix = camera.viewNormalMatrix * light.normalMatrix * 10.0f;
+                program.setUniformValue("worldMatrix", light.worldMatrix);
                 program.setUniformValue("worldViewMatrix", worldViewMatrix);
                 program.setUniformValue("normalMatrix", normalMatrix);
 
                 for (auto submesh : resourceManager->sphere->submeshes)
                 {
                     // Send the material to the shader
-                    Material *material = resourceManager->materialLight;
-                    program.setUniformValue("albedo", material->albedo);
-                    program.setUniformValue("emissive", material->emissive);
-                    program.setUniformValue("smoothness", material->smoothness);
+                    const MaterialSnapshot &material = frame.lightMaterial;
+                    program.setUniformValue("albedo", material.albedo);
+                    program.setUniformValue("emissive", material.emissive);
+                    program.setUniformValue("smoothness", material.smoothness);
 
                     submesh->draw();
                 }
@@ -266,7 +242,7 @@ void ForwardRenderer::passBlit()
 {
     gl->glDisable(GL_DEPTH_TEST);
 
-    QOpenGLShaderProgram &program = blitProgram->program;
+    QOpenGLShaderProgram &program = *blitProgram->program;
 
     if (program.bind())
     {
@@ -18,11 +18,11 @@ public:
     void finalize() override;
 
     void resize(int width, int height) override;
-    void render(Camera *camera) override;
+    void render(const FrameSnapshot &frame) override;
 
 private:
 
-    void passMeshes(Camera *camera);
+    void passMeshes(const FrameSnapshot &frame);
     void passBlit();
 
     // Shaders
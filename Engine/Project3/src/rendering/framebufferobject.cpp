@@ -4,6 +4,10 @@
 #include <QDebug>
 
 
+// Per thread, as it is set by the thread that renders
+static thread_local GLuint defaultFramebuffer = 0;
+
+
 FramebufferObject::FramebufferObject()
 {
 
@@ -69,5 +73,17 @@ void FramebufferObject::bind()
 
 void FramebufferObject::release()
 {
-    QOpenGLFramebufferObject::bindDefault();
+    if (defaultFramebuffer != 0)
+    {
+        gl->glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer);
+    }
+    else
+    {
+        QOpenGLFramebufferObject::bindDefault();
+    }
+}
+
+void FramebufferObject::setDefault(GLuint defaultId)
+{
+    defaultFramebuffer = defaultId;
 }
@@ -22,6 +22,10 @@ public:
     void bind();
     void release();
 
+    // Framebuffer that release() binds (0 = the one of the current context).
+    // Outside of paintGL the widget framebuffer has to be given explicitly.
+    static void setDefault(GLuint defaultId);
+
     GLuint id = 0;
 
     QString name;
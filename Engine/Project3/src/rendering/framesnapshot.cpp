@@ -0,0 +1,157 @@
+#include "rendering/framesnapshot.h"
+#include "rendering/frustum.h"
+#include "resources/material.h"
+#include "resources/mesh.h"
+#include "globals.h"
+#include <algorithm>
+
+
+void MaterialSnapshot::capture(const Material *material)
+{
+    ResourcePool<Texture> &textures = resourceManager->textures();
+
+    index = int(material->poolSlot) + 1;
+    albedo = material->albedo;
+    emissive = material->emissive;
+    specular = material->specular;
+    smoothness = material->smoothness;
+    bumpiness = material->bumpiness;
+    tiling = material->tiling;
+    albedoTexture = textures.handle(material->albedoTexture);
+    emissiveTexture = textures.handle(material->emissiveTexture);
+    specularTexture = textures.handle(material->specularTexture);
+    normalsTexture = textures.handle(material->normalsTexture);
+    bumpTexture = textures.handle(material->bumpTexture);
+}
+
+void FrameSnapshot::capture(Renderer *frameRenderer)
+{
+    renderer = frameRenderer;
+    camera = *::camera;
+    settings = *miscSettings;
+
+    meshes.clear();
+    lights.clear();
+    selectedMeshes.clear();
+    selectedLights.clear();
+    pickMeshes.clear();
+    submeshes.clear();
+    materials.clear();
+
+    // Mesh renderers inside the view frustum
+    QVector<Entity*> entities;
+    scene->bvh.queryFrustum(Frustum(camera.projectionMatrix * camera.viewMatrix), entities);
+    for (auto entity : entities)
+    {
+        if (entity->active && entity->meshRenderer != nullptr) { addMesh(meshes, entity->meshRenderer); }
+    }
+
+    // Light sources
+    scene->lightSources.forEachActive([this](const Transform &, const LightSource &light) { addLight(lights, &light); });
+
+    // Skip point lights that don't reach any object
+    for (LightDraw &light : lights)
+    {
+        if (light.type == LightSource::Type::Point)
+        {
+            QVector<Entity*> litEntities;
+            scene->bvh.querySphere(QVector3D(light.worldMatrix.column(3)), light.radius, litEntities);
+            light.lightsSomething = false;
+            for (auto litEntity : litEntities)
+            {
+                light.lightsSomething = light.lightsSomething || litEntity->active;
+            }
+        }
+    }
+
+    // Selected entities
+    for (int i = 0; i < selection->count; ++i)
+    {
+        Entity* entity = selection->entities[i];
+        if (entity->active)
+        {
+            if (entity->meshRenderer != nullptr) { addMesh(selectedMeshes, entity->meshRenderer); }
+            if (entity->lightSource != nullptr) { addLight(selectedLights, entity->lightSource); }
+        }
+    }
+
+    // Mesh renderers that may be under the cursor
+    pickIdentifiers = interaction->renderIdentifiers;
+    if (pickIdentifiers)
+    {
+        mouseX = input->mousex;
+        mouseY = input->mousey;
+
+        QVector<Entity*> candidates;
+        const QVector3D rayDirection = camera.screenPointToWorldRay(mouseX, mouseY);
+        scene->bvh.queryRay(camera.position, rayDirection, candidates);
+        for (auto entity : candidates)
+        {
+            if (entity->active && entity->meshRenderer != nullptr) { addMesh(pickMeshes, entity->meshRenderer); }
+        }
+    }
+
+    lightMaterial.capture(resourceManager->materialLight);
+}
+
+void FrameSnapshot::dropDestroyedMeshes()
+{
+    const ResourcePool<Mesh> &pool = resourceManager->meshes();
+    auto destroyed = [&pool](const MeshDraw &draw) { return pool.get(draw.mesh) == nullptr; };
+    meshes.erase(std::remove_if(meshes.begin(), meshes.end(), destroyed), meshes.end());
+    selectedMeshes.erase(std::remove_if(selectedMeshes.begin(), selectedMeshes.end(), destroyed), selectedMeshes.end());
+    pickMeshes.erase(std::remove_if(pickMeshes.begin(), pickMeshes.end(), destroyed), pickMeshes.end());
+}
+
+void FrameSnapshot::addMesh(QVector<MeshDraw> &draws, const MeshRenderer *meshRenderer)
+{
+    const Mesh *mesh = meshRenderer->mesh;
+    if (mesh == nullptr)
+    {
+        return;
+    }
+
+    const Transform *transform = meshRenderer->entity->transform;
+    MeshDraw draw;
+    draw.mesh = resourceManager->meshes().handle(mesh);
+    draw.worldMatrix = transform->matrix();
+    draw.inverseMatrix = transform->inverseMatrix();
+    draw.normalMatrix = transform->normalMatrix();
+    draw.determinant = transform->determinant();
+    draw.idColor = meshRenderer->entity->getIDColor();
+    draw.firstSubmesh = submeshes.size();
+    draw.submeshCount = mesh->submeshes.size();
+
+    for (int i = 0; i < mesh->submeshes.size(); ++i)
+    {
+        // Get material from the component
+        const Material *material = nullptr;
+        if (i < meshRenderer->materials.size()) {
+            material = meshRenderer->materials[i];
+        }
+        if (material == nullptr) {
+            material = resourceManager->materialWhite;
+        }
+
+        MaterialSnapshot materialSnapshot;
+        materialSnapshot.capture(material);
+        submeshes.push_back(mesh->submeshes[i]);
+        materials.push_back(materialSnapshot);
+    }
+
+    draws.push_back(draw);
+}
+
+void FrameSnapshot::addLight(QVector<LightDraw> &draws, const LightSource *lightSource)
+{
+    const Transform *transform = lightSource->entity->transform;
+    LightDraw draw;
+    draw.type = lightSource->type;
+    draw.worldMatrix = transform->matrix();
+    draw.normalMatrix = transform->normalMatrix();
+    draw.color = lightSource->color;
+    draw.intensity = lightSource->intensity;
+    draw.radius = lightSource->radius;
+    draw.idColor = lightSource->entity->getIDColor();
+    draws.push_back(draw);
+}
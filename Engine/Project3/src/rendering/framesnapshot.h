@@ -0,0 +1,105 @@
+#ifndef FRAMESNAPSHOT_H
+#define FRAMESNAPSHOT_H
+
+#include "ecs/camera.h"
+#include "ecs/components.h"
+#include "rendering/miscsettings.h"
+#include "resources/resourcemanager.h"
+#include <QColor>
+#include <QVector>
+#include <QVector2D>
+#include <QVector3D>
+#include <QMatrix4x4>
+
+class Renderer;
+class SubMesh;
+
+// Copy of the parameters of a material, textures are handles because they
+// may be destroyed before the frame is drawn
+struct MaterialSnapshot
+{
+    int index = 0; // In the material buffer (0 = no material)
+    QColor albedo;
+    QColor emissive;
+    QColor specular;
+    float smoothness = 0.0f;
+    float bumpiness = 0.0f;
+    QVector2D tiling;
+    TextureHandle albedoTexture;
+    TextureHandle emissiveTexture;
+    TextureHandle specularTexture;
+    TextureHandle normalsTexture;
+    TextureHandle bumpTexture;
+
+    void capture(const Material *material);
+};
+
+// Mesh renderer to draw, its submeshes (with their materials) are a range
+// of FrameSnapshot::submeshes
+struct MeshDraw
+{
+    MeshHandle mesh;
+    QMatrix4x4 worldMatrix;
+    QMatrix4x4 inverseMatrix;
+    QMatrix3x3 normalMatrix; // World space
+    float determinant = 1.0f;
+    QVector3D idColor;
+    int firstSubmesh = 0;
+    int submeshCount = 0;
+};
+
+struct LightDraw
+{
+    LightSource::Type type = LightSource::Type::Point;
+    QMatrix4x4 worldMatrix;
+    QMatrix3x3 normalMatrix; // World space
+    QColor color;
+    float intensity = 1.0f;
+    float radius = 0.0f;
+    bool lightsSomething = true; // Point lights that reach no active entity are skipped
+    QVector3D idColor;
+};
+
+// Everything the renderers read to draw a frame, copied from the scene by
+// the main thread so the render thread never touches it. The arrays keep
+// their capacity from one frame to the next.
+class FrameSnapshot
+{
+public:
+
+    // Main thread, with the transforms, the spatial index and the camera
+    // matrices up to date
+    void capture(Renderer *frameRenderer);
+
+    // Render thread, after the resources were updated: draws of destroyed
+    // meshes are dropped
+    void dropDestroyedMeshes();
+
+    Renderer *renderer = nullptr;
+    Camera camera;
+    MiscSettings settings;
+
+    QVector<MeshDraw> meshes;         // Inside the view frustum
+    QVector<LightDraw> lights;        // Of the active entities
+    QVector<MeshDraw> selectedMeshes;
+    QVector<LightDraw> selectedLights;
+
+    // Mouse picking, only the entities whose bounds are under the cursor
+    bool pickIdentifiers = false;
+    int mouseX = 0;
+    int mouseY = 0;
+    QVector<MeshDraw> pickMeshes;
+
+    // Submeshes of all the mesh draws, and the material of each one
+    QVector<SubMesh*> submeshes;
+    QVector<MaterialSnapshot> materials;
+
+    MaterialSnapshot lightMaterial; // Light spheres
+
+private:
+
+    void addMesh(QVector<MeshDraw> &draws, const MeshRenderer *meshRenderer);
+    void addLight(QVector<LightDraw> &draws, const LightSource *lightSource);
+};
+
+#endif // FRAMESNAPSHOT_H
@@ -0,0 +1,52 @@
+#include "frustum.h"
+
+
+Frustum::Frustum(const QMatrix4x4 &m)
+{
+    const QVector4D r0 = m.row(0);
+    const QVector4D r1 = m.row(1);
+    const QVector4D r2 = m.row(2);
+    const QVector4D r3 = m.row(3);
+
+    planes[0] = r3 + r0; // Left
+    planes[1] = r3 - r0; // Right
+    planes[2] = r3 + r1; // Bottom
+    planes[3] = r3 - r1; // Top
+    planes[4] = r3 + r2; // Near
+    planes[5] = r3 - r2; // Far
+
+    for (QVector4D &plane : planes)
+    {
+        const float length = plane.toVector3D().length();
+        if (length > 0.0f) { plane /= length; }
+    }
+}
+
+bool Frustum::intersectsSphere(const QVector3D &center, float radius) const
+{
+    for (const QVector4D &plane : planes)
+    {
+        if (QVector3D::dotProduct(plane.toVector3D(), center) + plane.w() < -radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Frustum::intersectsBox(const QVector3D &min, const QVector3D &max) const
+{
+    for (const QVector4D &plane : planes)
+    {
+        // Corner of the box furthest along the plane normal
+        const QVector3D corner(
+                    plane.x() >= 0.0f ? max.x() : min.x(),
+                    plane.y() >= 0.0f ? max.y() : min.y(),
+                    plane.z() >= 0.0f ? max.z() : min.z());
+        if (QVector3D::dotProduct(plane.toVector3D(), corner) + plane.w() < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
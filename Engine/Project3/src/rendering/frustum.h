@@ -0,0 +1,26 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+class Frustum
+{
+public:
+
+    Frustum() { }
+
+    // Planes are extracted in the space the matrix transforms from
+    // (e.g. world space for projection * view, object space for
+    // projection * view * world)
+    explicit Frustum(const QMatrix4x4 &clipMatrix);
+
+    bool intersectsSphere(const QVector3D &center, float radius) const;
+    bool intersectsBox(const QVector3D &min, const QVector3D &max) const;
+
+    // Normalized planes (xyz = normal pointing inwards, w = distance)
+    QVector4D planes[6];
+};
+
+#endif // FRUSTUM_H
@@ -0,0 +1,103 @@
+#include "meshletculling.h"
+#include "frustum.h"
+#include "framesnapshot.h"
+#include "resources/mesh.h"
+#include "globals.h"
+
+
+struct MeshletCullJob
+{
+    const SubMesh *submesh = nullptr;
+    Frustum frustum;       // In object space
+    QVector3D eye;         // In object space
+    bool coneCulling = true;
+    MeshletDrawList *drawList = nullptr;
+};
+
+static void cullSubMesh(MeshletCullJob &job)
+{
+    const QVector<Meshlet> &meshlets = job.submesh->getMeshlets();
+    MeshletDrawList &drawList = *job.drawList;
+    drawList.complete = false;
+
+    unsigned int rangeOffset = 0;
+    unsigned int rangeCount = 0;
+    for (const Meshlet &meshlet : meshlets)
+    {
+        bool visible = job.frustum.intersectsSphere(meshlet.center, meshlet.radius);
+
+        if (visible && job.coneCulling)
+        {
+            const QVector3D toCenter = meshlet.center - job.eye;
+            visible = QVector3D::dotProduct(toCenter, meshlet.coneAxis) <
+                    meshlet.coneCutoff * toCenter.length() + meshlet.radius;
+        }
+
+        if (!visible) { continue; }
+
+        // Merge with the previous range when contiguous
+        if (rangeCount > 0 && rangeOffset + rangeCount == meshlet.indexOffset)
+        {
+            rangeCount += meshlet.indexCount;
+        }
+        else
+        {
+            if (rangeCount > 0)
+            {
+                drawList.counts.push_back(GLsizei(rangeCount));
+                drawList.offsets.push_back(reinterpret_cast<const void *>(size_t(rangeOffset) * sizeof(unsigned int)));
+            }
+            rangeOffset = meshlet.indexOffset;
+            rangeCount = meshlet.indexCount;
+        }
+    }
+    if (rangeCount > 0)
+    {
+        drawList.counts.push_back(GLsizei(rangeCount));
+        drawList.offsets.push_back(reinterpret_cast<const void *>(size_t(rangeOffset) * sizeof(unsigned int)));
+    }
+}
+
+void MeshletDrawList::draw(SubMesh *submesh) const
+{
+    if (complete)
+    {
+        submesh->draw();
+    }
+    else if (!counts.isEmpty())
+    {
+        submesh->drawRanges(counts, offsets);
+    }
+}
+
+QVector<MeshletDrawList> cullMeshlets(const FrameSnapshot &frame)
+{
+    const Camera &camera = frame.camera;
+    QVector<MeshletDrawList> drawLists(frame.submeshes.size());
+    QVector<MeshletCullJob> jobs;
+
+    for (const MeshDraw &draw : frame.meshes)
+    {
+        const bool invertible = draw.determinant != 0.0f;
+
+        for (int i = draw.firstSubmesh; i < draw.firstSubmesh + draw.submeshCount; ++i)
+        {
+            const SubMesh *submesh = frame.submeshes[i];
+            if (submesh->getMeshlets().isEmpty() || !invertible) { continue; }
+
+            MeshletCullJob job;
+            job.submesh = submesh;
+            job.frustum = Frustum(camera.projectionMatrix * camera.viewMatrix * draw.worldMatrix);
+            job.eye = draw.inverseMatrix * camera.position;
+            job.coneCulling = draw.determinant > 0.0f; // Mirroring flips the winding
+            job.drawList = &drawLists[i];
+            jobs.push_back(job);
+        }
+    }
+
+    jobSystem->parallelFor("Meshlet culling", jobs.size(), 4, [&jobs](int begin, int end) {
+        for (int i = begin; i < end; ++i) cullSubMesh(jobs[i]);
+    });
+
+    return drawLists;
+}
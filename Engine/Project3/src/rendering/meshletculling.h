@@ -0,0 +1,25 @@
+#ifndef MESHLETCULLING_H
+#define MESHLETCULLING_H
+
+#include "gl.h"
+#include <QVector>
+
+class FrameSnapshot;
+class SubMesh;
+
+// Index ranges of a submesh that survived culling
+struct MeshletDrawList
+{
+    bool complete = true; // Nothing was culled (or the submesh has no meshlets)
+    QVector<GLsizei> counts;
+    QVector<const void *> offsets;
+
+    void draw(SubMesh *submesh) const;
+};
+
+// Tests the meshlets of the submeshes of the visible meshes against the
+// camera frustum and their normal cones in parallel. It returns one draw
+// list per submesh of the snapshot (FrameSnapshot::submeshes).
+QVector<MeshletDrawList> cullMeshlets(const FrameSnapshot &frame);
+
+#endif // MESHLETCULLING_H
@@ -16,6 +16,7 @@ public:
     bool ambientOcclusion = true;
     float ambientValue = 0.2f;
     bool grid = true;
+    bool normalFromBumpOnGpu = true; // Material::createNormalFromBump renders into the texture
 };
 
 #endif // MISCSETTINGS_H
@@ -4,7 +4,7 @@
 #include <QVector>
 #include <QString>
 
-class Camera;
+class FrameSnapshot;
 
 class Renderer
 {
@@ -16,7 +16,7 @@ public:
     virtual void finalize() = 0;
 
     virtual void resize(int width, int height) = 0;
-    virtual void render(Camera *camera) = 0;
+    virtual void render(const FrameSnapshot &frame) = 0;
 
     QVector<QString> getTextures() const;
     void showTexture(QString textureName);
@@ -0,0 +1,101 @@
+#include "rendering/renderthread.h"
+#include "ui/openglwidget.h"
+#include "globals.h"
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QOpenGLContext>
+
+
+RenderThread::RenderThread(OpenGLWidget *w) : widget(w)
+{
+}
+
+RenderThread::~RenderThread()
+{
+    stop();
+}
+
+void RenderThread::submitFrame()
+{
+    QMutexLocker locker(&mutex);
+    while (state != State::Idle)
+    {
+        stateChanged.wait(&mutex);
+    }
+    current = 1 - current;
+
+    // The context can only be made current in the thread it belongs to
+    widget->doneCurrent();
+    widget->context()->moveToThread(this);
+
+    state = State::Syncing;
+    stateChanged.wakeAll();
+    while (state == State::Syncing)
+    {
+        stateChanged.wait(&mutex);
+    }
+}
+
+void RenderThread::finishFrame()
+{
+    QMutexLocker locker(&mutex);
+    while (state != State::Idle)
+    {
+        stateChanged.wait(&mutex);
+    }
+}
+
+void RenderThread::stop()
+{
+    if (!isRunning())
+    {
+        return;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        while (state != State::Idle)
+        {
+            stateChanged.wait(&mutex);
+        }
+        state = State::Quitting;
+        stateChanged.wakeAll();
+    }
+    wait();
+}
+
+void RenderThread::run()
+{
+    QMutexLocker locker(&mutex);
+    while (true)
+    {
+        while (state == State::Idle)
+        {
+            stateChanged.wait(&mutex);
+        }
+        if (state == State::Quitting)
+        {
+            return;
+        }
+
+        // Uploads and removals, while nothing else touches the resources
+        widget->makeCurrent();
+        resourceManager->updateResources();
+        FrameSnapshot &frame = frames[current];
+        frame.dropDestroyedMeshes();
+
+        state = State::Rendering;
+        stateChanged.wakeAll();
+        locker.unlock();
+
+        widget->renderSnapshot(frame);
+
+        widget->doneCurrent();
+        widget->context()->moveToThread(QCoreApplication::instance()->thread());
+
+        locker.relock();
+        state = State::Idle;
+        stateChanged.wakeAll();
+        emit frameRendered();
+    }
+}
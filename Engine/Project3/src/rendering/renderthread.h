@@ -0,0 +1,70 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include "rendering/framesnapshot.h"
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+class OpenGLWidget;
+
+// Thread that draws the frames of an OpenGLWidget (Qt's threaded
+// QOpenGLWidget pattern): the context is handed to it for every frame and
+// it is back in the main thread whenever the render thread is idle. The
+// main thread captures frame N+1 into one snapshot while frame N is drawn
+// from the other one.
+class RenderThread : public QThread
+{
+    Q_OBJECT
+
+public:
+
+    explicit RenderThread(OpenGLWidget *widget);
+    ~RenderThread() override;
+
+    // Main thread: snapshot to capture the next frame into, the render
+    // thread never reads it until it is submitted
+    FrameSnapshot &nextFrame() { return frames[1 - current]; }
+
+    // Main thread: hands the captured snapshot and the context to the render
+    // thread. It returns once the resources are updated (they are only
+    // modified while the main thread waits), the frame is drawn meanwhile.
+    void submitFrame();
+
+    // Main thread: finishes the frame in flight and ends the thread
+    void stop();
+
+public slots:
+
+    // Main thread: waits until the frame in flight is drawn and the context is back
+    void finishFrame();
+
+signals:
+
+    void frameRendered(); // From the render thread, the widget can be composed
+
+protected:
+
+    void run() override;
+
+private:
+
+    enum class State
+    {
+        Idle,      // Context in the main thread
+        Syncing,   // Updating the resources, the main thread waits
+        Rendering, // Drawing the snapshot
+        Quitting
+    };
+
+    OpenGLWidget *widget = nullptr;
+
+    FrameSnapshot frames[2];
+    int current = 0; // Snapshot of the frame in flight
+
+    QMutex mutex;
+    QWaitCondition stateChanged;
+    State state = State::Idle;
+};
+
+#endif // RENDERTHREAD_H
@@ -1,13 +1,31 @@
 #include "material.h"
 #include "texture.h"
 #include "resourcemanager.h"
+#include "texturearray.h"
+#include "materialbuffer.h"
+#include "shaderprogram.h"
+#include "mesh.h"
 #include "globals.h"
+#include "rendering/gl.h"
+#include "rendering/framebufferobject.h"
+#include "util/hash.h"
+#include "util/normalmap.h"
 #include <QJsonObject>
 
 
 const char *Material::TypeName = "Material";
 
 
+// Normal map computed by a job, shared with it so the material can be
+// deleted while it runs
+struct NormalMapJob
+{
+    const Texture *bumpTexture = nullptr;
+    QImage normalMap;
+    JobCounter done;
+};
+
+
 Material::Material() :
     albedo(QColor::fromRgb(255, 255, 255)),
     emissive(QColor::fromRgb(0, 0, 0)),
@@ -16,7 +34,10 @@ Material::Material() :
     metalness(0.0f),
     bumpiness(0.0f),
     tiling(1.0, 1.0)
-{ }
+{
+    // Sends the parameters to the material buffer
+    requestUpdate();
+}
 
 Material::~Material()
 { }
@@ -30,7 +51,16 @@ void Material::handleResourcesAboutToDie()
     HANDLE_TEXTURE_IF_ABOUT_TO_DIE(specularTexture);
     HANDLE_TEXTURE_IF_ABOUT_TO_DIE(normalsTexture);
     HANDLE_TEXTURE_IF_ABOUT_TO_DIE(bumpTexture);
- }
+}
+
+void Material::referenceTextures()
+{
+    resourceManager->addReference(this, albedoTexture);
+    resourceManager->addReference(this, emissiveTexture);
+    resourceManager->addReference(this, specularTexture);
+    resourceManager->addReference(this, normalsTexture);
+    resourceManager->addReference(this, bumpTexture);
+}
 
 #define TEXTURE_GUID(tex) (tex != nullptr)?tex->guid.toString():QUuid().toString()
 
@@ -46,53 +76,212 @@ void Material::link(const QJsonObject &json)
 {
 }
 
+quint64 Material::contentHash() const
+{
+    const quint64 values[] = {
+        quint64(shaderType),
+        quint64(albedo.rgba()),
+        quint64(emissive.rgba()),
+        quint64(specular.rgba()),
+        quint64(qRound(smoothness * 65536.0f)),
+        quint64(qRound(metalness * 65536.0f)),
+        quint64(qRound(bumpiness * 65536.0f)),
+        quint64(qRound(tiling.x() * 65536.0f)),
+        quint64(qRound(tiling.y() * 65536.0f)),
+        quint64(quintptr(albedoTexture)),
+        quint64(quintptr(emissiveTexture)),
+        quint64(quintptr(specularTexture)),
+        quint64(quintptr(normalsTexture)),
+        quint64(quintptr(bumpTexture))
+    };
+    return hash64(values, sizeof(values));
+}
+
+void Material::update()
+{
+    resourceManager->materialBuffer->setMaterial(this);
+    resourceManager->rekeyMaterial(this);
+
+    if (normalFromBumpPending)
+    {
+        normalFromBumpPending = false;
+        if (!generateNormalFromBump(true))
+        {
+            normalFromBumpPending = true;
+            requestUpdate();
+        }
+    }
+}
+
 void Material::createNormalFromBump()
 {
     if (normalsTexture == nullptr && bumpTexture != nullptr)
     {
-        // Create normal map from the height texture
-        QImage bumpMap = bumpTexture->getImage();
-        QImage normalMap(bumpMap.size(), QImage::Format_RGB888);
-        const int w = normalMap.width();
-        const int h = normalMap.height();
-        const float bumpiness = 2.0f;
-        for (int y = 0; y < h; ++y) {
-            for (int x = 0; x < w; ++x) {
-
-                // surrounding indices
-                const int il = (x + w - 1) % w;
-                const int ir = (x + 1) % w;
-                const int ib = (y + 1) % h;
-                const int it = (y + w - 1) % h;
-
-                // surrounding pixels
-                float tl = qRed( bumpMap.pixel(il, it) ) / 255.0f; // top left
-                float  l = qRed( bumpMap.pixel(il,  y) ) / 255.0f; // left
-                float bl = qRed( bumpMap.pixel(il, ib) ) / 255.0f; // bottom left
-                float  t = qRed( bumpMap.pixel(x,  it) ) / 255.0f; // top
-                float  b = qRed( bumpMap.pixel(x,  ib) ) / 255.0f; // bottom
-                float tr = qRed( bumpMap.pixel(ir, it) ) / 255.0f; // top right
-                float  r = qRed( bumpMap.pixel(ir,  y) ) / 255.0f; // right
-                float br = qRed( bumpMap.pixel(ir, ib) ) / 255.0f; // bottom right
-
-                // sobel filter
-                const float dX = (tl + 2.0 * l + bl) - (tr + 2.0 * r + br);
-                const float dY = (bl + 2.0 * b + br) - (tl + 2.0 * t + tr);
-                const float dZ = 1.0/bumpiness;
-
-                QVector3D n(dX, dY, dZ);
-                n.normalize();
-                n = n* 0.5 + QVector3D(0.5f, 0.5f, 0.5f);
-
-                normalMap.setPixelColor(x, y, QColor::fromRgbF(n.x(), n.y(), n.z()));
-            }
+        // The GPU path runs from update(), where the context is current
+        if (miscSettings->normalFromBumpOnGpu || !generateNormalFromBump(false))
+        {
+            normalFromBumpPending = true;
+            requestUpdate();
         }
+    }
+}
 
-        // Test to see the saved file
-        //normalMap.save(bumpTexture->name + QString("NORM.png"));
+bool Material::generateNormalFromBump(bool contextCurrent)
+{
+    if (normalsTexture != nullptr || bumpTexture == nullptr)
+    {
+        return true;
+    }
+
+    // The CPU path is running in a job
+    if (normalMapJob)
+    {
+        if (!normalMapJob->done.isDone())
+        {
+            return false;
+        }
+        QSharedPointer<NormalMapJob> job = normalMapJob;
+        normalMapJob.reset();
+        if (job->bumpTexture != bumpTexture)
+        {
+            return false; // The bump texture changed, start again
+        }
+
+        normalsTexture = resourceManager->createTexture();
+        normalsTexture->name = bumpTexture->name + "-NORM-auto";
+        resourceManager->addReference(this, normalsTexture);
+
+        // Already in the OpenGL row order
+        TextureData normalData;
+        normalData.image = job->normalMap;
+        normalData.w = job->normalMap.width();
+        normalData.h = job->normalMap.height();
+        normalData.comp = 3;
+        normalsTexture->setData(normalData, QString());
+        return true;
+    }
 
+    // A shader that failed to link falls back to the CPU path
+    ShaderProgram *program = nullptr;
+    bool gpu = contextCurrent && miscSettings->normalFromBumpOnGpu;
+    if (gpu)
+    {
+        program = resourceManager->getShaderProgram("Normal from bump");
+        if (program == nullptr)
+        {
+            program = resourceManager->createShaderProgram();
+            program->name = "Normal from bump";
+            program->vertexShaderFilename = "res/shaders/blit/blit.vert";
+            program->fragmentShaderFilename = "res/shaders/normal_from_bump/normal_from_bump.frag";
+            program->includeForSerialization = false;
+            return false;
+        }
+        if (program->needsUpdate)
+        {
+            return false;
+        }
+        gpu = program->program->isLinked();
+    }
+
+    if (!gpu)
+    {
+        // The bump pixels are needed after the upload
+        bumpTexture->setKeepPixels(true);
+
+        // They were released already, so the bump texture is loaded again
+        if (!bumpTexture->isLoading() && bumpTexture->getImage().isNull() && !bumpTexture->getFilePath().isEmpty())
+        {
+            bumpTexture->loadTexture(bumpTexture->getFilePath().toLatin1());
+        }
+    }
+    else if (bumpTexture->isEvicted() && !bumpTexture->isLoading())
+    {
+        // The full resolution texture is needed, not the low resolution copy
+        bumpTexture->loadTexture(bumpTexture->getFilePath().toLatin1());
+    }
+
+    // The bump texture is still decoding (or uploading), try again in the next frames
+    if (bumpTexture->isLoading() || (gpu && (!bumpTexture->isReady() || bumpTexture->needsUpdate)))
+    {
+        return false;
+    }
+
+    if (gpu)
+    {
         normalsTexture = resourceManager->createTexture();
         normalsTexture->name = bumpTexture->name + "-NORM-auto";
-        normalsTexture->setImage(normalMap);
+        resourceManager->addReference(this, normalsTexture);
+
+        normalsTexture->allocateRenderTarget(bumpTexture->width(), bumpTexture->height());
+        renderNormalFromBump();
+        bumpTexture->setKeepPixels(false);
+        bumpTexture->releasePixels();
+        return true;
     }
+
+    // Create normal map from the height texture in a job, the texture is
+    // created when it is done
+    const float bumpiness = 2.0f;
+    const QImage bumpImage = bumpTexture->getImage();
+    QSharedPointer<NormalMapJob> job(new NormalMapJob);
+    job->bumpTexture = bumpTexture;
+    jobSystem->run("Normal from bump", [job, bumpImage, bumpiness]() {
+        job->normalMap = NormalMap::fromBump(bumpImage, bumpiness);
+
+        // Test to see the saved file
+        //job->normalMap.save(QString("NORM.png"));
+    }, &job->done);
+    normalMapJob = job;
+
+    bumpTexture->setKeepPixels(false);
+    bumpTexture->releasePixels();
+    return false;
+}
+
+void Material::renderNormalFromBump()
+{
+    QOpenGLShaderProgram &program = *resourceManager->getShaderProgram("Normal from bump")->program;
+    const float bumpiness = 2.0f;
+
+    // The state of the current frame is restored afterwards
+    GLint viewport[4];
+    gl->glGetIntegerv(GL_VIEWPORT, viewport);
+    const GLboolean depthTest = gl->glIsEnabled(GL_DEPTH_TEST);
+    const GLboolean blend = gl->glIsEnabled(GL_BLEND);
+    const GLboolean cullFace = gl->glIsEnabled(GL_CULL_FACE);
+
+    FramebufferObject fbo;
+    fbo.name = "Normal from bump";
+    fbo.create();
+    fbo.bind();
+    fbo.addColorAttachment(0, normalsTexture->textureId());
+    fbo.checkStatus();
+
+    gl->glViewport(0, 0, normalsTexture->width(), normalsTexture->height());
+    gl->glDisable(GL_DEPTH_TEST);
+    gl->glDisable(GL_BLEND);
+    gl->glDisable(GL_CULL_FACE);
+
+    if (program.bind())
+    {
+        TextureArray::resetBindings();
+        program.setUniformValue("bumpArray", 0);
+        program.setUniformValue("bumpTexture", 1);
+        program.setUniformValue("bumpLayer", Texture::bindMaterialTexture(bumpTexture, 0, 1));
+        program.setUniformValue("texelSize", QVector2D(1.0f / bumpTexture->width(), 1.0f / bumpTexture->height()));
+        program.setUniformValue("bumpiness", bumpiness);
+        resourceManager->quad->submeshes[0]->draw();
+        program.release();
+        TextureArray::resetBindings();
+    }
+
+    fbo.release();
+    fbo.destroy();
+
+    gl->glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    if (depthTest) gl->glEnable(GL_DEPTH_TEST);
+    if (blend) gl->glEnable(GL_BLEND);
+    if (cullFace) gl->glEnable(GL_CULL_FACE);
+
+    normalsTexture->generateMipMaps();
 }
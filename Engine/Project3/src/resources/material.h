@@ -4,6 +4,7 @@
 #include "resource.h"
 #include <QColor>
 #include <QVector2D>
+#include <QSharedPointer>
 
 class Texture;
 
@@ -26,6 +27,7 @@ public:
 
     Material * asMaterial() override { return this; }
 
+    void update() override;
     void handleResourcesAboutToDie() override;
 
     void write(QJsonObject &json) override;
@@ -34,6 +36,13 @@ public:
 
     void createNormalFromBump();
 
+    // Registers the textures in the ResourceManager, so the material is told
+    // when they are removed. Call it after assigning any of them.
+    void referenceTextures();
+
+    // Hash of the parameters and textures (see ResourceManager::shareMaterial)
+    quint64 contentHash() const;
+
     MaterialShaderType shaderType = MaterialShaderType::Surface; // Required shader
 
     QColor albedo;           // RGB color
@@ -50,6 +59,16 @@ public:
     Texture *specularTexture = nullptr;
     Texture *normalsTexture = nullptr;
     Texture *bumpTexture = nullptr;
+
+private:
+
+    // Returns false while it has to wait for the bump texture (or the shader,
+    // or the job of the CPU path)
+    bool generateNormalFromBump(bool contextCurrent);
+    void renderNormalFromBump();
+
+    bool normalFromBumpPending = false; // Waiting for the bump texture to load
+    QSharedPointer<struct NormalMapJob> normalMapJob; // CPU normal map being computed
 };
 
 #endif // MATERIAL_H
@@ -0,0 +1,91 @@
+#include "materialbuffer.h"
+#include "material.h"
+#include "rendering/gl.h"
+#include <algorithm>
+
+
+void MaterialBuffer::setMaterial(Material *material)
+{
+    const int index = int(material->poolSlot);
+    if ((index + 1) * TexelsPerMaterial * 4 > values.size())
+    {
+        values.resize((index + 1) * TexelsPerMaterial * 4);
+    }
+
+    float *texels = values.data() + index * TexelsPerMaterial * 4;
+    const float parameters[TexelsPerMaterial * 4] = {
+        float(material->albedo.redF()), float(material->albedo.greenF()), float(material->albedo.blueF()), material->smoothness,
+        float(material->specular.redF()), float(material->specular.greenF()), float(material->specular.blueF()), material->metalness,
+        float(material->emissive.redF()), float(material->emissive.greenF()), float(material->emissive.blueF()), material->bumpiness
+    };
+    std::copy(parameters, parameters + TexelsPerMaterial * 4, texels);
+
+    if (dirtyBegin == dirtyEnd)
+    {
+        dirtyBegin = index;
+        dirtyEnd = index + 1;
+    }
+    else
+    {
+        dirtyBegin = qMin(dirtyBegin, index);
+        dirtyEnd = qMax(dirtyEnd, index + 1);
+    }
+}
+
+void MaterialBuffer::upload()
+{
+    if (dirtyBegin == dirtyEnd)
+    {
+        return;
+    }
+
+    if (buffer == 0)
+    {
+        gl->glGenBuffers(1, &buffer);
+        gl->glGenTextures(1, &texture);
+    }
+    gl->glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+
+    const int materialSize = TexelsPerMaterial * 4 * int(sizeof(float));
+    const int materialCount = values.size() / (TexelsPerMaterial * 4);
+    if (materialCount > capacity)
+    {
+        // Grows geometrically, everything is sent again
+        capacity = qMax(64, qMax(materialCount, capacity * 2));
+        gl->glBufferData(GL_TEXTURE_BUFFER, capacity * materialSize, nullptr, GL_DYNAMIC_DRAW);
+        gl->glBufferSubData(GL_TEXTURE_BUFFER, 0, materialCount * materialSize, values.constData());
+
+        gl->glBindTexture(GL_TEXTURE_BUFFER, texture);
+        gl->glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+        gl->glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    else
+    {
+        gl->glBufferSubData(GL_TEXTURE_BUFFER, dirtyBegin * materialSize, (dirtyEnd - dirtyBegin) * materialSize,
+                            values.constData() + dirtyBegin * TexelsPerMaterial * 4);
+    }
+
+    gl->glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    dirtyBegin = dirtyEnd = 0;
+}
+
+void MaterialBuffer::bind(unsigned int textureUnit)
+{
+    gl->glActiveTexture(GL_TEXTURE0 + textureUnit);
+    gl->glBindTexture(GL_TEXTURE_BUFFER, texture);
+}
+
+void MaterialBuffer::destroy()
+{
+    if (buffer != 0)
+    {
+        gl->glDeleteTextures(1, &texture);
+        gl->glDeleteBuffers(1, &buffer);
+        buffer = texture = 0;
+    }
+    capacity = 0;
+
+    // Everything is sent again if the buffer is created later on
+    dirtyBegin = 0;
+    dirtyEnd = values.size() / (TexelsPerMaterial * 4);
+}
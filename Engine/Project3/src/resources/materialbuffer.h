@@ -0,0 +1,40 @@
+#ifndef MATERIALBUFFER_H
+#define MATERIALBUFFER_H
+
+#include <QVector>
+#include <qopengl.h>
+
+class Material;
+
+// Parameters of all the materials in one texture buffer (GL_RGBA32F). The
+// G-buffer stores the index of the material of every pixel, which is the
+// slot of the material in its pool, and the lighting passes fetch the
+// parameters by index (see res/shaders/common/material.glsl).
+class MaterialBuffer
+{
+public:
+
+    // Texels of a material: albedo and smoothness, specular and metalness,
+    // emissive and bumpiness
+    static const int TexelsPerMaterial = 3;
+
+    // Copies the parameters, they are sent to the GPU by upload()
+    void setMaterial(Material *material);
+
+    // Sends the range of the materials changed since the last upload
+    void upload();
+
+    void bind(unsigned int textureUnit);
+    void destroy();
+
+private:
+
+    QVector<float> values; // RGBA of every texel
+    int dirtyBegin = 0;    // Range of changed materials
+    int dirtyEnd = 0;
+    int capacity = 0;      // Materials that fit in the GPU buffer
+    GLuint buffer = 0;
+    GLuint texture = 0;
+};
+
+#endif // MATERIALBUFFER_H
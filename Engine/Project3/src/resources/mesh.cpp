@@ -13,8 +13,7 @@ ibo(QOpenGLBuffer::Type::IndexBuffer)
 {
     vertexFormat = vf;
     data_size = size_t(in_data_size);
-    data = new unsigned char[data_size];
-    memcpy(data, in_data, data_size);
+    data = QByteArray(static_cast<const char *>(in_data), in_data_size);
 	  
     computeBounds();
 }
@@ -25,20 +24,34 @@ ibo(QOpenGLBuffer::Type::IndexBuffer)
     vertexFormat = vf;
 	
     data_size = size_t(in_data_size);
-    data = new unsigned char[data_size];
-    memcpy(data, in_data, data_size);
+    data = QByteArray(static_cast<const char *>(in_data), in_data_size);
 	
     indices_count = size_t(in_indices_count);
-    indices = new unsigned int[indices_count];
-    memcpy(indices, in_indices, indices_count * sizeof(unsigned int));
+    indices.resize(in_indices_count);
+    memcpy(indices.data(), in_indices, indices_count * sizeof(unsigned int));
 	
     computeBounds();
 }
 
+SubMesh::SubMesh(VertexFormat vf, QByteArray &&in_data, QVector<unsigned int> &&in_indices, QVector<Meshlet> &&in_meshlets) :
+ibo(QOpenGLBuffer::Type::IndexBuffer)
+{
+    vertexFormat = vf;
+
+    // Take ownership of the buffers, no copies involved
+    data_size = size_t(in_data.size());
+    data = std::move(in_data);
+
+    indices_count = size_t(in_indices.size());
+    indices = std::move(in_indices);
+
+    meshlets = std::move(in_meshlets);
+
+    computeBounds();
+}
+
 SubMesh::~SubMesh()
 {
-    delete[] data;
-    delete[] indices;
 }
 
 void SubMesh::enableAttributes()
@@ -63,26 +76,48 @@ void SubMesh::update()
     if (vbo.isCreated()) vbo.destroy();
     if (ibo.isCreated()) ibo.destroy();
     if (vao.isCreated()) vao.destroy();
+    if (positionVbo.isCreated()) positionVbo.destroy();
+    if (positionVao.isCreated()) positionVao.destroy();
 	
     // VBO: Buffer with vertex data
     vbo.create();
     vbo.bind();
     vbo.setUsagePattern(QOpenGLBuffer::UsagePattern::StaticDraw);
-    vbo.allocate(data, int(data_size));
+    vbo.allocate(data.constData(), int(data_size));
     vbo.release();
-    delete[] data;
-    data = nullptr;
+
+    // Position VBO: Only positions, packed (not needed if that's all there is)
+    const bool usePositionStream = keepPositionStream && vertexFormat.size > int(3 * sizeof(float));
+    if (usePositionStream)
+    {
+        const int count = int(vertexCount());
+        QVector<float> positions(count * 3);
+        const int float_advance = vertexFormat.size / sizeof(float);
+        const float *vertex = (const float *)data.constData();
+        for (int i = 0; i < count; ++i, vertex += float_advance)
+        {
+            positions[i * 3 + 0] = vertex[0];
+            positions[i * 3 + 1] = vertex[1];
+            positions[i * 3 + 2] = vertex[2];
+        }
+
+        positionVbo.create();
+        positionVbo.bind();
+        positionVbo.setUsagePattern(QOpenGLBuffer::UsagePattern::StaticDraw);
+        positionVbo.allocate(positions.constData(), int(positions.size() * sizeof(float)));
+        positionVbo.release();
+    }
+    data = QByteArray();
 	
     // IBO: Buffer with indexes
-    if (indices != nullptr)
+    if (!indices.isEmpty())
     {
         ibo.create();
         ibo.bind();
         ibo.setUsagePattern(QOpenGLBuffer::UsagePattern::StaticDraw);
-        ibo.allocate(indices, int(indices_count * sizeof(unsigned int)));
+        ibo.allocate(indices.constData(), int(indices_count * sizeof(unsigned int)));
         ibo.release();
-        delete[] indices;
-        indices = nullptr;
+        indices = QVector<unsigned int>();
     }
 	
     // VAO: Vertex format description and state of VBOs
@@ -95,6 +130,20 @@ void SubMesh::update()
     vao.release();
     vbo.release();
     if (ibo.isCreated()) { ibo.release(); }
+
+    // Position VAO: Same indices, only attribute 0
+    if (usePositionStream)
+    {
+        positionVao.create();
+        positionVao.bind();
+        positionVbo.bind();
+        if (ibo.isCreated()) { ibo.bind(); }
+        gl->glEnableVertexAttribArray(0);
+        gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
+        positionVao.release();
+        positionVbo.release();
+        if (ibo.isCreated()) { ibo.release(); }
+    }
 }
 
 void SubMesh::draw(GLenum primitiveType)
@@ -109,11 +158,38 @@ void SubMesh::draw(GLenum primitiveType)
     vao.release();
 }
 
+void SubMesh::drawPositions(GLenum primitiveType)
+{
+    if (!positionVao.isCreated())
+    {
+        draw(primitiveType);
+        return;
+    }
+
+    int num_vertices = data_size / vertexFormat.size;
+    positionVao.bind();
+    if (indices_count > 0) {
+        gl->glDrawElements(primitiveType, indices_count, GL_UNSIGNED_INT, nullptr);
+    } else {
+        gl->glDrawArrays(primitiveType, 0, num_vertices);
+    }
+    positionVao.release();
+}
+
+void SubMesh::drawRanges(const QVector<GLsizei> &counts, const QVector<const void *> &offsets)
+{
+    vao.bind();
+    gl->glMultiDrawElements(GL_TRIANGLES, counts.constData(), GL_UNSIGNED_INT, offsets.constData(), counts.size());
+    vao.release();
+}
+
 void SubMesh::destroy()
 {
     if (vbo.isCreated()) { vbo.destroy(); }
     if (ibo.isCreated()) { ibo.destroy(); }
     if (vao.isCreated()) { vao.destroy(); }
+    if (positionVbo.isCreated()) { positionVbo.destroy(); }
+    if (positionVao.isCreated()) { positionVao.destroy(); }
 }
 
 static QVector3D min(const QVector3D &a, const QVector3D &b)
@@ -136,8 +212,8 @@ static QVector3D max(const QVector3D &a, const QVector3D &b)
 
 void SubMesh::computeBounds()
 {
-    const float *vertex = (const float *)data;
-    const float *end = (const float *)(data + data_size);
+    const float *vertex = (const float *)data.constData();
+    const float *end = (const float *)(data.constData() + data_size);
     const int float_advance = vertexFormat.size / sizeof(float);
     while (vertex < end)
     {
@@ -165,14 +241,21 @@ void Mesh::addSubMesh(VertexFormat vertexFormat, void *data, int bytes)
 {
     submeshes.push_back(new SubMesh(vertexFormat, data, bytes));
     updateBounds(submeshes.back()->bounds);
-    needsUpdate = true;
+    requestUpdate();
 }
 
 void Mesh::addSubMesh(VertexFormat vertexFormat, void *data, int data_size, unsigned int *indices, int indices_size)
 {
     submeshes.push_back(new SubMesh(vertexFormat, data, data_size, indices, indices_size));
     updateBounds(submeshes.back()->bounds);
-    needsUpdate = true;
+    requestUpdate();
+}
+
+void Mesh::addSubMesh(VertexFormat vertexFormat, QByteArray &&data, QVector<unsigned int> &&indices, QVector<Meshlet> &&meshlets)
+{
+    submeshes.push_back(new SubMesh(vertexFormat, std::move(data), std::move(indices), std::move(meshlets)));
+    updateBounds(submeshes.back()->bounds);
+    requestUpdate();
 }
 
 void Mesh::updateBounds(const Bounds &b)
@@ -185,6 +268,7 @@ void Mesh::update()
 {
     for (auto submesh : submeshes)
     {
+        submesh->keepPositionStream = positionStream;
         submesh->update();
     }
 }
@@ -2,6 +2,8 @@
 #define MESH_H
 
 #include "resource.h"
+#include "meshlet.h"
+#include <QByteArray>
 #include <QOpenGLBuffer>
 #include <QOpenGLVertexArrayObject>
 #include <QVector>
@@ -52,16 +54,21 @@ class SubMesh
 public:
     SubMesh(VertexFormat vertexFormat, void *data, int size);
     SubMesh(VertexFormat vertexFormat, void *data, int size, unsigned int *indices, int indices_count);
+    SubMesh(VertexFormat vertexFormat, QByteArray &&data, QVector<unsigned int> &&indices, QVector<Meshlet> &&meshlets = QVector<Meshlet>());
     ~SubMesh();
 
     void update();
     void draw(GLenum primitiveType = GL_TRIANGLES);
+    void drawPositions(GLenum primitiveType = GL_TRIANGLES); // Only feeds attribute 0
+    void drawRanges(const QVector<GLsizei> &counts, const QVector<const void *> &offsets);
     void destroy();
 
     unsigned int vertexCount() const { return data_size/vertexFormat.size; }
 
     void enableAttributes();
 
+    const QVector<Meshlet> &getMeshlets() const { return meshlets; }
+
 private:
 
     friend class Mesh;
@@ -69,16 +76,23 @@ private:
 
     void computeBounds();
 
-    unsigned char *data = nullptr;
+    QByteArray data;
     size_t data_size = 0;
 
-    unsigned int *indices = nullptr;
+    QVector<unsigned int> indices;
     size_t indices_count = 0;
 
+    QVector<Meshlet> meshlets;
+
     VertexFormat vertexFormat;
     QOpenGLBuffer vbo;
     QOpenGLBuffer ibo;
     QOpenGLVertexArrayObject vao;
+
+    // Tightly packed positions for passes that need nothing else
+    bool keepPositionStream = true;
+    QOpenGLBuffer positionVbo;
+    QOpenGLVertexArrayObject positionVao;
 };
 
 class Mesh : public Resource
@@ -99,6 +113,7 @@ public:
 
     void addSubMesh(VertexFormat vertexFormat, void *data, int bytes);
     void addSubMesh(VertexFormat vertexFormat, void *data, int bytes, unsigned int *indexes, int bytes_indexes);
+    void addSubMesh(VertexFormat vertexFormat, QByteArray &&data, QVector<unsigned int> &&indices, QVector<Meshlet> &&meshlets = QVector<Meshlet>());
 
     void read(const QJsonObject &json) override;
     void write(QJsonObject &json) override;
@@ -109,6 +124,8 @@ public:
 
     Bounds bounds;
 
+    bool positionStream = true; // Keep a position-only vertex stream in the submeshes
+
 private:
 
     void updateBounds(const Bounds &b);
@@ -0,0 +1,165 @@
+#include "meshlet.h"
+#include <QQueue>
+#include <cfloat>
+#include <cmath>
+
+
+static QVector3D vertexPosition(const char *vertices, int vertexSize, unsigned int index)
+{
+    const float *v = reinterpret_cast<const float *>(vertices + size_t(index) * size_t(vertexSize));
+    return QVector3D(v[0], v[1], v[2]);
+}
+
+static void computeMeshletBounds(Meshlet &meshlet, const char *vertices, int vertexSize, const unsigned int *indices)
+{
+    const unsigned int *first = indices + meshlet.indexOffset;
+    const unsigned int *last = first + meshlet.indexCount;
+
+    // Bounding sphere centered in the bounding box
+    QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+    QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (const unsigned int *i = first; i < last; ++i)
+    {
+        const QVector3D p = vertexPosition(vertices, vertexSize, *i);
+        min = QVector3D(std::fmin(min.x(), p.x()), std::fmin(min.y(), p.y()), std::fmin(min.z(), p.z()));
+        max = QVector3D(std::fmax(max.x(), p.x()), std::fmax(max.y(), p.y()), std::fmax(max.z(), p.z()));
+    }
+    meshlet.center = (min + max) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (const unsigned int *i = first; i < last; ++i)
+    {
+        const QVector3D p = vertexPosition(vertices, vertexSize, *i);
+        meshlet.radius = std::fmax(meshlet.radius, (p - meshlet.center).length());
+    }
+
+    // Normal cone around the average face normal
+    QVector<QVector3D> normals;
+    normals.reserve(int(meshlet.indexCount / 3));
+    QVector3D axis;
+    for (const unsigned int *i = first; i < last; i += 3)
+    {
+        const QVector3D p0 = vertexPosition(vertices, vertexSize, i[0]);
+        const QVector3D p1 = vertexPosition(vertices, vertexSize, i[1]);
+        const QVector3D p2 = vertexPosition(vertices, vertexSize, i[2]);
+        const QVector3D n = QVector3D::crossProduct(p1 - p0, p2 - p0);
+        const float length = n.length();
+        if (length > 0.0f)
+        {
+            normals.push_back(n / length);
+            axis += normals.back();
+        }
+    }
+
+    meshlet.coneAxis = QVector3D(0.0f, 0.0f, 0.0f);
+    meshlet.coneCutoff = 1.0f; // Never culled
+    if (normals.isEmpty() || axis.length() == 0.0f) { return; }
+
+    axis.normalize();
+    float minDot = 1.0f;
+    for (const QVector3D &n : normals)
+    {
+        minDot = std::fmin(minDot, QVector3D::dotProduct(n, axis));
+    }
+
+    // Normals spanning more than a hemisphere can always face the viewer
+    if (minDot <= 0.0f) { return; }
+
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+QVector<Meshlet> buildMeshlets(const QByteArray &vertices, int vertexSize, QVector<unsigned int> &indices)
+{
+    QVector<Meshlet> meshlets;
+
+    const int triangleCount = indices.size() / 3;
+    const int vertexCount = vertexSize > 0 ? vertices.size() / vertexSize : 0;
+    if (triangleCount == 0 || vertexCount == 0) { return meshlets; }
+
+    // Vertex -> triangles adjacency (compressed in a single array)
+    QVector<int> vertexTriangleOffsets(vertexCount + 1, 0);
+    for (unsigned int index : indices)
+    {
+        vertexTriangleOffsets[int(index) + 1]++;
+    }
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        vertexTriangleOffsets[i + 1] += vertexTriangleOffsets[i];
+    }
+    QVector<int> vertexTriangles(indices.size());
+    QVector<int> fill = vertexTriangleOffsets;
+    for (int i = 0; i < indices.size(); ++i)
+    {
+        vertexTriangles[fill[int(indices[i])]++] = i / 3;
+    }
+
+    // Grow each meshlet from a seed triangle through shared vertices
+    QVector<unsigned int> reordered;
+    reordered.reserve(indices.size());
+    QVector<bool> assigned(triangleCount, false);
+    QVector<int> queuedIn(triangleCount, -1);
+    QQueue<int> candidates;
+
+    int firstUnassigned = 0;
+    while (true)
+    {
+        // Continue from the frontier of the previous meshlet to keep them compact
+        int seed = -1;
+        while (!candidates.isEmpty() && seed < 0)
+        {
+            const int triangle = candidates.dequeue();
+            if (!assigned[triangle]) { seed = triangle; }
+        }
+        if (seed < 0)
+        {
+            while (firstUnassigned < triangleCount && assigned[firstUnassigned]) { firstUnassigned++; }
+            if (firstUnassigned == triangleCount) { break; }
+            seed = firstUnassigned;
+        }
+
+        Meshlet meshlet;
+        meshlet.indexOffset = unsigned(reordered.size());
+        const int meshletIndex = meshlets.size();
+
+        candidates.clear();
+        candidates.enqueue(seed);
+        queuedIn[seed] = meshletIndex;
+
+        int meshletTriangles = 0;
+        while (!candidates.isEmpty() && meshletTriangles < MESHLET_MAX_TRIANGLES)
+        {
+            const int triangle = candidates.dequeue();
+            if (assigned[triangle]) { continue; }
+
+            assigned[triangle] = true;
+            meshletTriangles++;
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                const unsigned int vertex = indices[triangle * 3 + corner];
+                reordered.push_back(vertex);
+
+                for (int i = vertexTriangleOffsets[int(vertex)]; i < vertexTriangleOffsets[int(vertex) + 1]; ++i)
+                {
+                    const int neighbour = vertexTriangles[i];
+                    if (!assigned[neighbour] && queuedIn[neighbour] != meshletIndex)
+                    {
+                        queuedIn[neighbour] = meshletIndex;
+                        candidates.enqueue(neighbour);
+                    }
+                }
+            }
+        }
+
+        meshlet.indexCount = unsigned(reordered.size()) - meshlet.indexOffset;
+        meshlets.push_back(meshlet);
+    }
+
+    indices = std::move(reordered);
+
+    for (Meshlet &meshlet : meshlets)
+    {
+        computeMeshletBounds(meshlet, vertices.constData(), vertexSize, indices.constData());
+    }
+
+    return meshlets;
+}
@@ -0,0 +1,31 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QVector3D>
+
+static const int MESHLET_MAX_TRIANGLES = 128;
+
+// Small cluster of triangles occupying a contiguous range of the index buffer
+struct Meshlet
+{
+    unsigned int indexOffset = 0;
+    unsigned int indexCount = 0;
+
+    // Bounding sphere (object space)
+    QVector3D center;
+    float radius = 0.0f;
+
+    // Normal cone: the meshlet is backfacing for any viewer satisfying
+    // dot(center - eye, coneAxis) >= coneCutoff * |center - eye| + radius
+    QVector3D coneAxis;
+    float coneCutoff = 1.0f;
+};
+
+// Groups adjacent triangles into meshlets and reorders the indices so that
+// each meshlet is a contiguous range. The vertex position must be the first
+// attribute of each vertex.
+QVector<Meshlet> buildMeshlets(const QByteArray &vertices, int vertexSize, QVector<unsigned int> &indices);
+
+#endif // MESHLET_H
@@ -3,6 +3,18 @@
 #include <QDir>
 
 
+void Resource::requestUpdate()
+{
+    needsUpdate = true;
+
+    // Resources created along with the manager are queued when added to it
+    if (!updateQueued && resourceManager != nullptr)
+    {
+        resourceManager->queueUpdate(this);
+    }
+}
+
+
 QString Resource::absolutePathInProject(QString filePath)
 {
     QDir dir(projectDirectory);
@@ -28,6 +28,9 @@ public:
     virtual void update() { needsUpdate = false; }
     virtual void destroy() { }
 
+    // Sets needsUpdate and queues the resource for the next updateResources
+    void requestUpdate();
+
     virtual void write(QJsonObject &) = 0;
     virtual void read(const QJsonObject &) = 0;
     virtual void link(const QJsonObject &) { }
@@ -37,12 +40,18 @@ public:
     bool needsUpdate = false;
     bool needsRemove = false;
     bool includeForSerialization = true;
+    quint32 poolSlot = 0; // Slot in the ResourcePool of its type
 
 
     // Static methods
 
     static QString absolutePathInProject(QString filePath);
     static QString relativePathInProject(QString filePath);
+
+private:
+
+    bool updateQueued = false; // In the update queue of the ResourceManager
+    friend class ResourceManager;
 };
 
 #endif // RESOURCE_H
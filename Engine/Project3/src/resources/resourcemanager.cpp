@@ -3,15 +3,47 @@
 #include "material.h"
 #include "texture.h"
 #include "shaderprogram.h"
+#include "texturearray.h"
+#include "materialbuffer.h"
+#include "util/hash.h"
 #include <QVector3D>
 #include <cmath>
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QFileInfo>
+#include <QDir>
+#include "globals.h"
+#include <QSharedPointer>
+#include <algorithm>
 
 
+// Result of a decode job, shared with the job so the request can be
+// dropped while it runs
+struct DecodedTexture
+{
+    TextureData data;
+    JobCounter done;
+    bool cancelled = false; // The texture is gone, it must not claim contents (textureContentMutex)
+};
+
+// Texture being decoded in a worker thread
+struct PendingTexture
+{
+    Texture *texture = nullptr;
+    QString filePath;
+    QSharedPointer<DecodedTexture> decoded;
+    bool shareContent = false;
+};
+
 ResourceManager::ResourceManager()
 {
+    meshPool = new ResourcePool<Mesh>;
+    materialPool = new ResourcePool<Material>;
+    texturePool = new ResourcePool<Texture>;
+    shaderProgramPool = new ResourcePool<ShaderProgram>;
+    textureArrays = new TextureArrayPool;
+    materialBuffer = new MaterialBuffer;
+
     float quad[] = {
         -1.0, -1.0, 0.0,
          1.0, -1.0, 0.0,
@@ -236,87 +268,318 @@ ResourceManager::ResourceManager()
     materialLight->name = "Material light";
     materialLight->emissive = QColor(255, 255, 255);
     materialLight->includeForSerialization = false;
+
+    // The global is not set yet, so these could not queue themselves
+    for (auto resource : resources)
+    {
+        if (resource->needsUpdate && !resource->updateQueued)
+        {
+            queueUpdate(resource);
+        }
+    }
 }
 
 ResourceManager::~ResourceManager()
 {
     qDebug("ResourceManager deletion");
-    for (auto res : resources) {
-        delete res;
+    for (auto pending : pendingTextures) {
+        jobSystem->wait(pending->decoded->done);
+        delete pending;
     }
+    for (auto decoded : cancelledDecodes) {
+        jobSystem->wait(decoded->done);
+    }
+    delete meshPool;
+    delete materialPool;
+    delete texturePool;
+    delete shaderProgramPool;
+    delete textureArrays;
+    delete materialBuffer;
+}
+
+void ResourceManager::addResource(Resource *resource)
+{
+    resources.push_back(resource);
+    unindexedResources.push_back(resource);
+    resourcesChanged = true;
 }
 
 Mesh *ResourceManager::createMesh()
 {
-    Mesh *m = new Mesh;
-    resources.push_back(m);
+    Mesh *m = meshPool->create();
+    addResource(m);
     return m;
 }
 
 Mesh *ResourceManager::getMesh(const QUuid &guid)
 {
-    for (auto res : resources)
-    {
-        if (res->guid == guid)
-        {
-            return res->asMesh();
-        }
-    }
-    return nullptr;
+    Resource *res = getResource(guid);
+    return (res != nullptr) ? res->asMesh() : nullptr;
 }
 
 
 Material *ResourceManager::createMaterial()
 {
-    Material *m = new Material;
-    resources.push_back(m);
+    Material *m = materialPool->create();
+    addResource(m);
     return m;
 }
 
 Material *ResourceManager::getMaterial(const QUuid &guid)
 {
-    for (auto res : resources)
+    Resource *res = getResource(guid);
+    return (res != nullptr) ? res->asMaterial() : nullptr;
+}
+
+Material *ResourceManager::shareMaterial(Material *material)
+{
+    const quint64 key = material->contentHash();
+    Material *shared = materialsByContent.value(key, nullptr);
+    // It may have been edited since, and not rekeyed yet
+    if (shared != nullptr && shared != material && !shared->needsRemove && shared->contentHash() == key)
     {
-        if (res->guid == guid)
-        {
-            return res->asMaterial();
-        }
+        destroyResource(material);
+        return shared;
     }
-    return nullptr;
+    materialsByContent.insert(key, material);
+    materialContentKeys.insert(material, key);
+    return material;
+}
+
+void ResourceManager::rekeyMaterial(Material *material)
+{
+    auto previous = materialContentKeys.find(material);
+    if (previous == materialContentKeys.end())
+    {
+        return;
+    }
+
+    const quint64 key = material->contentHash();
+    if (previous.value() == key)
+    {
+        return;
+    }
+    if (materialsByContent.value(previous.value()) == material)
+    {
+        materialsByContent.remove(previous.value());
+    }
+
+    // Another material with the same parameters keeps being the shared one
+    Material *shared = materialsByContent.value(key, nullptr);
+    if (shared == nullptr || shared->needsRemove || shared->contentHash() != key)
+    {
+        materialsByContent.insert(key, material);
+    }
+    previous.value() = key;
 }
 
 Texture *ResourceManager::createTexture()
 {
-    Texture *t = new Texture;
-    resources.push_back(t);
+    Texture *t = texturePool->create();
+    addResource(t);
     return t;
 }
 
 Texture *ResourceManager::loadTexture(const QString &filePath)
 {
-    Texture *tex = nullptr;
-    for (auto res : resources)
+    return loadTexture(filePath, TextureUsage::Color);
+}
+
+Texture *ResourceManager::loadTexture(const QString &filePath, TextureUsage usage)
+{
+    // Different relative paths to the same file resolve to the same texture
+    QFileInfo fileInfo(filePath);
+    QString canonicalPath = fileInfo.canonicalFilePath();
+    if (canonicalPath.isEmpty())
     {
-        tex = res->asTexture();
-        if (tex != nullptr && tex->getFilePath() == filePath)
-        {
-            return tex;
-        }
+        canonicalPath = QDir::cleanPath(fileInfo.absoluteFilePath());
+    }
+
+    Texture *tex = findTextureByPath(canonicalPath);
+    if (tex != nullptr)
+    {
+        return tex;
     }
-    QFileInfo fileInfo(filePath);
     tex = createTexture();
-    tex->loadTexture(filePath.toLatin1());
     tex->name = fileInfo.fileName();
+    tex->setUsage(usage);
+    decodeTextureAsync(tex, canonicalPath, true);
     return tex;
 }
 
+QVector<Texture*> ResourceManager::loadTextures(const QVector<QString> &filePaths, const QVector<TextureUsage> &usages)
+{
+    // The textures are created right away (the file path is set while
+    // loading, so repeated paths resolve to the same texture) and their
+    // images are decoded concurrently
+    QVector<Texture*> textures(filePaths.size(), nullptr);
+    for (int i = 0; i < filePaths.size(); ++i)
+    {
+        textures[i] = loadTexture(filePaths[i], i < usages.size() ? usages[i] : TextureUsage::Color);
+    }
+    return textures;
+}
+
+void ResourceManager::decodeTextureAsync(Texture *texture, const QString &filePath, bool shareContent)
+{
+    // A newer request replaces the one in flight
+    for (int i = 0; i < pendingTextures.size(); ++i)
+    {
+        if (pendingTextures[i]->texture == texture)
+        {
+            cancelDecode(pendingTextures[i]);
+            pendingTextures.removeAt(i);
+            break;
+        }
+    }
+
+    PendingTexture *pending = new PendingTexture;
+    pending->texture = texture;
+    pending->filePath = filePath;
+    pending->shareContent = shareContent;
+    TextureDecodeOptions options;
+    options.usage = texture->getUsage();
+    options.compress = compressTextures;
+    options.compressHdr = compressHdrTextures;
+    options.halfFloatHdr = halfFloatHdrTextures;
+    options.keepImage = texture->getKeepPixels() || texture->getUsage() == TextureUsage::Bump;
+    const TextureUsage usage = options.usage;
+    QSharedPointer<DecodedTexture> decoded(new DecodedTexture);
+    const DecodedTexture *request = decoded.data(); // Kept alive by the job
+    auto claimContent = [this, texture, shareContent, usage, request](quint64 contentHash) {
+        return claimTextureContent(contentHash, usage, texture, shareContent, request) == texture;
+    };
+    std::function<bool(quint64)> claim(claimContent);
+    jobSystem->run("Texture decode", [decoded, filePath, options, claim]() {
+        decoded->data = Texture::decodeFile(filePath, options, claim);
+    }, &decoded->done);
+    pending->decoded = decoded;
+    pendingTextures.push_back(pending);
+
+    texture->setLoading(filePath);
+    reindex(texture);
+}
+
+void ResourceManager::requestReload(Texture *texture)
+{
+    QMutexLocker locker(&reloadMutex);
+    if (!reloadRequests.contains(texture))
+    {
+        reloadRequests.push_back(texture);
+    }
+}
+
+Texture *ResourceManager::claimTextureContent(quint64 contentHash, TextureUsage usage, Texture *texture, bool share, const DecodedTexture *decoded)
+{
+    QMutexLocker locker(&textureContentMutex);
+    if (decoded->cancelled)
+    {
+        return nullptr;
+    }
+
+    const TextureContentKey key(contentHash, int(usage));
+    Texture *owner = texturesByContent.value(key, nullptr);
+    if (owner != nullptr && owner != texture)
+    {
+        return share ? owner : texture;
+    }
+
+    // The texture owns these contents from now on (and no longer the previous ones)
+    auto previous = textureContentKeys.find(texture);
+    if (previous != textureContentKeys.end() && previous.value() != key)
+    {
+        texturesByContent.remove(previous.value());
+    }
+    texturesByContent.insert(key, texture);
+    textureContentKeys.insert(texture, key);
+    return texture;
+}
+
+void ResourceManager::cancelDecode(PendingTexture *pending)
+{
+    // The job may still be running, once it is flagged it no longer
+    // touches the content index (forgetContent can clean it up)
+    {
+        QMutexLocker locker(&textureContentMutex);
+        pending->decoded->cancelled = true;
+    }
+    cancelledDecodes.push_back(pending->decoded);
+    delete pending;
+}
+
+Texture *ResourceManager::textureContentOwner(quint64 contentHash, TextureUsage usage)
+{
+    QMutexLocker locker(&textureContentMutex);
+    return texturesByContent.value(TextureContentKey(contentHash, int(usage)), nullptr);
+}
+
+void ResourceManager::replaceTexture(Texture *texture, Texture *replacement)
+{
+    for (auto dependent : dependentsOf.values(texture))
+    {
+        Material *material = dependent->asMaterial();
+        if (material == nullptr)
+        {
+            continue;
+        }
+        Texture **slots[] = { &material->albedoTexture, &material->emissiveTexture, &material->specularTexture, &material->normalsTexture, &material->bumpTexture };
+        for (Texture **slot : slots)
+        {
+            if (*slot == texture)
+            {
+                *slot = replacement;
+            }
+        }
+        addReference(material, replacement);
+        material->requestUpdate(); // Also rekeys it
+    }
+    destroyResource(texture);
+}
+
+void ResourceManager::forgetContent(Resource *resource)
+{
+    Texture *texture = resource->asTexture();
+    if (texture != nullptr)
+    {
+        QMutexLocker locker(&textureContentMutex);
+        auto key = textureContentKeys.find(texture);
+        if (key != textureContentKeys.end())
+        {
+            texturesByContent.remove(key.value());
+            textureContentKeys.erase(key);
+        }
+    }
+
+    Material *material = resource->asMaterial();
+    if (material != nullptr)
+    {
+        auto key = materialContentKeys.find(material);
+        if (key != materialContentKeys.end())
+        {
+            if (materialsByContent.value(key.value()) == material)
+            {
+                materialsByContent.remove(key.value());
+            }
+            materialContentKeys.erase(key);
+        }
+    }
+}
+
 Texture *ResourceManager::getTexture(const QUuid &guid)
 {
-    for (auto res : resources)
+    Resource *res = getResource(guid);
+    return (res != nullptr) ? res->asTexture() : nullptr;
+}
+
+Texture *ResourceManager::findTextureByPath(const QString &filePath)
+{
+    indexNewResources();
+    for (auto it = resourcesByPath.find(filePath); it != resourcesByPath.end() && it.key() == filePath; ++it)
     {
-        if (res->guid == guid)
+        Texture *tex = it.value()->asTexture();
+        if (tex != nullptr && tex->getFilePath() == filePath)
         {
-            return res->asTexture();
+            return tex;
         }
     }
     return nullptr;
@@ -324,18 +587,19 @@ Texture *ResourceManager::getTexture(const QUuid &guid)
 
 ShaderProgram *ResourceManager::createShaderProgram()
 {
-    ShaderProgram *res = new ShaderProgram;
-    resources.push_back(res);
+    ShaderProgram *res = shaderProgramPool->create();
+    addResource(res);
     return res;
 }
 
 ShaderProgram *ResourceManager::getShaderProgram(const QString &name)
 {
-    for (auto res : resources)
+    indexNewResources();
+    for (auto it = resourcesByName.find(name); it != resourcesByName.end() && it.key() == name; ++it)
     {
-        if (res->name == name)
+        if (it.value()->name == name && it.value()->asShaderProgram() != nullptr)
         {
-            return res->asShaderProgram();
+            return it.value()->asShaderProgram();
         }
     }
     return nullptr;
@@ -343,11 +607,19 @@ ShaderProgram *ResourceManager::getShaderProgram(const QString &name)
 
 void ResourceManager::reloadShaderPrograms()
 {
-    for (auto res : resources)
+    for (auto program : *shaderProgramPool)
+    {
+        program->reload();
+    }
+}
+
+void ResourceManager::reloadShaderPrograms(const QString &changedFile)
+{
+    for (auto program : *shaderProgramPool)
     {
-        if (res->asShaderProgram())
+        if (program->usesFile(changedFile))
         {
-            res->asShaderProgram()->reload();
+            program->reload();
         }
     }
 }
@@ -391,14 +663,73 @@ Resource *ResourceManager::loadResource(const QString &path)
 
 Resource *ResourceManager::getResource(const QUuid &guid)
 {
-    for (auto res : resources)
+    indexNewResources();
+    Resource *res = resourcesByGuid.value(guid, nullptr);
+    return (res != nullptr && res->guid == guid) ? res : nullptr;
+}
+
+static QString resourcePath(Resource *resource)
+{
+    if (resource->asTexture() != nullptr) return resource->asTexture()->getFilePath();
+    if (resource->asMesh() != nullptr) return resource->asMesh()->getFilePath();
+    return QString();
+}
+
+void ResourceManager::indexNewResources()
+{
+    for (auto resource : unindexedResources)
     {
-        if (res->guid == guid)
-        {
-            return res;
-        }
+        index(resource);
     }
-    return nullptr;
+    unindexedResources.clear();
+}
+
+void ResourceManager::index(Resource *resource)
+{
+    unindex(resource);
+
+    ResourceKeys keys;
+    keys.guid = resource->guid;
+    keys.name = resource->name;
+    keys.path = resourcePath(resource);
+    resourcesByGuid.insert(keys.guid, resource);
+    resourcesByName.insert(keys.name, resource);
+    if (!keys.path.isEmpty())
+    {
+        resourcesByPath.insert(keys.path, resource);
+    }
+    indexedKeys.insert(resource, keys);
+}
+
+void ResourceManager::unindex(Resource *resource)
+{
+    auto keys = indexedKeys.find(resource);
+    if (keys == indexedKeys.end())
+    {
+        return;
+    }
+    if (resourcesByGuid.value(keys->guid) == resource)
+    {
+        resourcesByGuid.remove(keys->guid);
+    }
+    resourcesByName.remove(keys->name, resource);
+    resourcesByPath.remove(keys->path, resource);
+    indexedKeys.erase(keys);
+}
+
+void ResourceManager::reindex(Resource *resource)
+{
+    // Resources not indexed yet get their current keys on the next lookup
+    if (indexedKeys.contains(resource))
+    {
+        index(resource);
+    }
+}
+
+void ResourceManager::rename(Resource *resource, const QString &name)
+{
+    resource->name = name;
+    reindex(resource);
 }
 
 int ResourceManager::numResources() const
@@ -421,13 +752,14 @@ void ResourceManager::write(QJsonObject &json)
 
 void ResourceManager::removeResourceAt(int index)
 {
-    resources[index]->needsRemove = true;
+    destroyResource(resources[index]);
 }
 
 void ResourceManager::destroyResource(Resource *res)
 {
-    if (res != nullptr) {
+    if (res != nullptr && !res->needsRemove) {
         res->needsRemove = true;
+        removeQueue.push_back(res);
     }
 }
 
@@ -436,43 +768,228 @@ void ResourceManager::clear()
     for (auto resource : resources)
     {
         if (resource->includeForSerialization) {
-            resource->needsRemove = true;
+            destroyResource(resource);
         }
     }
 }
 
+void ResourceManager::queueUpdate(Resource *resource)
+{
+    resource->updateQueued = true;
+    updateQueue.push_back(resource);
+}
+
+void ResourceManager::addReference(Resource *dependent, Resource *dependency)
+{
+    if (dependent != nullptr && dependency != nullptr && !dependentsOf.contains(dependency, dependent))
+    {
+        dependentsOf.insert(dependency, dependent);
+        dependenciesOf.insert(dependent, dependency);
+    }
+}
+
+void ResourceManager::removeReferences(Resource *resource)
+{
+    for (auto dependent : dependentsOf.values(resource))
+    {
+        dependenciesOf.remove(dependent, resource);
+    }
+    dependentsOf.remove(resource);
+    for (auto dependency : dependenciesOf.values(resource))
+    {
+        dependentsOf.remove(dependency, resource);
+    }
+    dependenciesOf.remove(resource);
+}
+
 void ResourceManager::updateResources()
 {
-    int i = 0;
-    while (i < resources.size())
+    frameIndex++;
+    indexNewResources();
+
+    // Evicted textures bound since the last update
+    QVector<Texture*> reloads;
+    {
+        QMutexLocker locker(&reloadMutex);
+        reloads.swap(reloadRequests);
+    }
+    for (auto texture : reloads)
+    {
+        if (!texture->needsRemove && texture->isEvicted() && !texture->isLoading())
+        {
+            decodeTextureAsync(texture, texture->getFilePath());
+        }
+    }
+
+    auto finished = [](const QSharedPointer<DecodedTexture> &decoded) { return decoded->done.isDone(); };
+    cancelledDecodes.erase(std::remove_if(cancelledDecodes.begin(), cancelledDecodes.end(), finished), cancelledDecodes.end());
+
+    // Hand the decoded images to their textures
+    int j = 0;
+    while (j < pendingTextures.size())
     {
-        Resource *resource = resources[i];
+        PendingTexture *pending = pendingTextures[j];
+        if (pending->decoded->done.isDone())
+        {
+            const TextureData data = pending->decoded->data;
+            Texture *texture = pending->texture;
+            const QString filePath = pending->filePath;
+            const bool shareContent = pending->shareContent;
+            delete pending;
+            pendingTextures.removeAt(j);
+
+            if (data.sharedContent)
+            {
+                // Another texture has the same contents, unless it was removed meanwhile
+                Texture *owner = textureContentOwner(data.contentHash, texture->getUsage());
+                if (owner != nullptr && owner != texture && !owner->needsRemove)
+                {
+                    replaceTexture(texture, owner);
+                }
+                else
+                {
+                    decodeTextureAsync(texture, filePath, shareContent);
+                }
+            }
+            else
+            {
+                texture->setData(data, filePath);
+            }
+        }
+        else
+        {
+            ++j;
+        }
+    }
 
-        resource->handleResourcesAboutToDie();
+    // Uploads beyond the budget wait for the next frames (at least one per frame)
+    int uploadedBytes = 0;
+    uploadsDeferred = false;
 
-        if (resource->needsUpdate)
+    QVector<Resource*> updates;
+    updates.swap(updateQueue);
+    for (auto resource : updates)
+    {
+        resource->updateQueued = false;
+        if (resource->needsRemove || !resource->needsUpdate)
         {
-            resource->update();
-            resource->needsUpdate = false;
+            continue;
         }
 
-        if (resource->needsRemove)
+        Texture *texture = resource->asTexture();
+        const int bytes = (texture != nullptr) ? texture->uploadSize() : 0;
+        if (bytes == 0 || uploadedBytes == 0 || uploadedBytes + bytes <= textureUploadBudget)
         {
-            resourcesToDestroy.push_back(resource);
-            resources.removeAt(i);
+            // Cleared before update() so it can ask for another one
+            resource->needsUpdate = false;
+            resource->update();
+            uploadedBytes += bytes;
+            resourcesChanged = true;
         }
         else
         {
-            ++i;
+            queueUpdate(resource);
+            uploadsDeferred = true;
+        }
+    }
+
+    // Materials updated above
+    materialBuffer->upload();
+
+    // Dependents are told while the removed resources are still alive
+    resourcesToDestroy.swap(removeQueue);
+    for (auto resource : resourcesToDestroy)
+    {
+        for (int k = 0; k < pendingTextures.size(); ++k)
+        {
+            if (pendingTextures[k]->texture == resource)
+            {
+                cancelDecode(pendingTextures[k]);
+                pendingTextures.removeAt(k);
+                break;
+            }
         }
+
+        forgetContent(resource);
+        unindex(resource);
+
+        for (auto dependent : dependentsOf.values(resource))
+        {
+            if (!dependent->needsRemove)
+            {
+                dependent->handleResourcesAboutToDie();
+            }
+        }
+        removeReferences(resource);
+    }
+
+    if (!resourcesToDestroy.isEmpty())
+    {
+        auto removed = [](Resource *resource) { return resource->needsRemove; };
+        resources.erase(std::remove_if(resources.begin(), resources.end(), removed), resources.end());
+        unindexedResources.erase(std::remove_if(unindexedResources.begin(), unindexedResources.end(), removed),
+                                 unindexedResources.end());
+        updateQueue.erase(std::remove_if(updateQueue.begin(), updateQueue.end(), removed), updateQueue.end());
+        resourcesChanged = true;
     }
 
     for (auto resource : resourcesToDestroy)
     {
         resource->destroy();
-        delete resource;
+        releaseResource(resource);
     }
     resourcesToDestroy.clear();
+
+    // Memory only grows with uploads, and textures only age when over budget
+    if (resourcesChanged || textureMemoryUsed > textureMemoryBudget)
+    {
+        resourcesChanged = false;
+        evictTextures();
+    }
+}
+
+void ResourceManager::releaseResource(Resource *resource)
+{
+    if (resource->asMesh() != nullptr) meshPool->destroy(resource->asMesh());
+    else if (resource->asMaterial() != nullptr) materialPool->destroy(resource->asMaterial());
+    else if (resource->asTexture() != nullptr) texturePool->destroy(resource->asTexture());
+    else if (resource->asShaderProgram() != nullptr) shaderProgramPool->destroy(resource->asShaderProgram());
+}
+
+void ResourceManager::evictTextures()
+{
+    textureMemoryUsed = 0;
+    QVector<Texture*> candidates;
+    for (auto texture : *texturePool)
+    {
+        textureMemoryUsed += texture->gpuMemory();
+
+        // Textures bound in the last frames are kept
+        if (texture->canEvict() && texture->lastUsed() + 2 < frameIndex)
+        {
+            candidates.push_back(texture);
+        }
+    }
+
+    if (textureMemoryUsed <= textureMemoryBudget)
+    {
+        return;
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Texture *a, const Texture *b) {
+        return a->lastUsed() < b->lastUsed();
+    });
+
+    for (Texture *texture : candidates)
+    {
+        if (textureMemoryUsed <= textureMemoryBudget)
+        {
+            break;
+        }
+        textureMemoryUsed -= texture->gpuMemory();
+        texture->evict();
+        textureMemoryUsed += texture->gpuMemory();
+    }
 }
 
 void ResourceManager::destroyResources()
@@ -481,4 +998,13 @@ void ResourceManager::destroyResources()
     {
         resource->destroy();
     }
+    Texture::destroyUploadBuffer();
+    textureArrays->destroy();
+    materialBuffer->destroy();
+}
+
+bool ResourceManager::isLoading() const
+{
+    QMutexLocker locker(&reloadMutex);
+    return !pendingTextures.isEmpty() || uploadsDeferred || !updateQueue.isEmpty() || !reloadRequests.isEmpty();
 }
@@ -3,13 +3,28 @@
 
 #include <QVector>
 #include <QUuid>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QSharedPointer>
+#include "resourcepool.h"
 
 class Resource;
 class Mesh;
 class Material;
 class Texture;
 class ShaderProgram;
+class TextureArrayPool;
+class MaterialBuffer;
+enum class TextureUsage;
 class QJsonObject;
+struct PendingTexture;
+struct DecodedTexture;
+
+typedef ResourceHandle<Mesh> MeshHandle;
+typedef ResourceHandle<Material> MaterialHandle;
+typedef ResourceHandle<Texture> TextureHandle;
+typedef ResourceHandle<ShaderProgram> ShaderProgramHandle;
 
 class ResourceManager
 {
@@ -23,13 +38,29 @@ public:
     Material *createMaterial();
     Material *getMaterial(const QUuid &guid);
 
+    // Returns a material registered before with the same parameters and
+    // textures (and destroys the given one), or registers the given one
+    Material *shareMaterial(Material *material);
+    // Called by Material::update, an edited material is shared under its new
+    // parameters (and no longer under the ones it was registered with)
+    void rekeyMaterial(Material *material);
+
     Texture *createTexture();
     Texture *loadTexture(const QString &filename);
+    Texture *loadTexture(const QString &filename, TextureUsage usage);
+    QVector<Texture*> loadTextures(const QVector<QString> &filenames, const QVector<TextureUsage> &usages = QVector<TextureUsage>());
+    // When shareContent is set and another texture has the same file
+    // contents, the references to the texture are replaced by that one
+    void decodeTextureAsync(Texture *texture, const QString &filename, bool shareContent = false);
+    // Evicted textures bound while rendering are read again in the next
+    // updateResources (it can be called from any thread)
+    void requestReload(Texture *texture);
     Texture *getTexture(const QUuid &guid);
 
     ShaderProgram *createShaderProgram();
     ShaderProgram *getShaderProgram(const QString &name);
     void reloadShaderPrograms();
+    void reloadShaderPrograms(const QString &changedFile); // Only the programs using it
 
     Resource *createResource(const QString &type);
     Resource *loadResource(const QString &path);
@@ -39,13 +70,43 @@ public:
     Resource *resourceAt(int index);
     void removeResourceAt(int index);
 
+    // Storage of the resources of each type, they also give out handles
+    // and resolve them (see ResourcePool)
+    ResourcePool<Mesh> &meshes() { return *meshPool; }
+    ResourcePool<Material> &materials() { return *materialPool; }
+    ResourcePool<Texture> &textures() { return *texturePool; }
+    ResourcePool<ShaderProgram> &shaderPrograms() { return *shaderProgramPool; }
+
+    // Resources are indexed by guid, name and file path the first time they
+    // are looked up, call it after changing any of them later on
+    void reindex(Resource *resource);
+    void rename(Resource *resource, const QString &name); // Also reindexes it
+
+    // Queues the resource for removal in the next updateResources
     void destroyResource(Resource *res);
     void clear();
 
+    // Called by Resource::requestUpdate
+    void queueUpdate(Resource *resource);
+
+    // The dependent is told (handleResourcesAboutToDie) when the dependency
+    // is removed, and only then
+    void addReference(Resource *dependent, Resource *dependency);
+
     // Perform OpenGL calls
     void updateResources();
     void destroyResources();
 
+    // Textures still decoding or waiting for their upload (or anything
+    // else waiting for the next updateResources, as compiling shaders)
+    bool isLoading() const;
+
+    // Incremented by updateResources, textures store it when bound
+    quint64 currentFrame() const { return frameIndex; }
+
+    // GPU memory used by the textures in the last update (bytes)
+    qint64 textureMemoryUsage() const { return textureMemoryUsed; }
+
     // Serialization
     void read(const QJsonObject &json);
     void write(QJsonObject &json);
@@ -68,13 +129,96 @@ public:
     Texture *texWaterNormals = nullptr;
     Texture *texWaterDudv = nullptr;
 
+    // Storage of the textures with the same size and format
+    TextureArrayPool *textureArrays = nullptr;
+
+    // Parameters of all the materials for the lighting passes
+    MaterialBuffer *materialBuffer = nullptr;
+
     // Pre-made materials
     Material *materialWhite = nullptr;
     Material *materialLight = nullptr;
 
+    // Maximum amount of texture data uploaded per frame (bytes)
+    int textureUploadBudget = 16 * 1024 * 1024;
+
+    // Least recently used textures are evicted above this amount of memory (bytes)
+    qint64 textureMemoryBudget = qint64(1024) * 1024 * 1024;
+
+    // Block compression supported by the context (set on initialization)
+    bool compressTextures = false;
+    bool compressHdrTextures = false;
+
+    // Uncompressed HDR textures as RGB16F instead of RGB9E5 (negative values)
+    bool halfFloatHdrTextures = false;
+
 private:
 
     QVector<Resource*> resourcesToDestroy;
+
+    // Work of the next updateResources, so it only visits what changed
+    QVector<Resource*> updateQueue;
+    QVector<Resource*> removeQueue;
+    bool resourcesChanged = false;
+
+    // Dependency to dependents and dependent to dependencies
+    QMultiHash<Resource*, Resource*> dependentsOf;
+    QMultiHash<Resource*, Resource*> dependenciesOf;
+    void removeReferences(Resource *resource);
+
+    void addResource(Resource *resource);
+    Texture *findTextureByPath(const QString &filePath);
+
+    // Lookup indices
+    struct ResourceKeys
+    {
+        QUuid guid;
+        QString name;
+        QString path;
+    };
+    void indexNewResources();
+    void index(Resource *resource);
+    void unindex(Resource *resource);
+    QVector<Resource*> unindexedResources;
+    QHash<Resource*, ResourceKeys> indexedKeys;
+    QHash<QUuid, Resource*> resourcesByGuid;
+    QMultiHash<QString, Resource*> resourcesByName;
+    QMultiHash<QString, Resource*> resourcesByPath;
+
+    void releaseResource(Resource *resource);
+
+    ResourcePool<Mesh> *meshPool = nullptr;
+    ResourcePool<Material> *materialPool = nullptr;
+    ResourcePool<Texture> *texturePool = nullptr;
+    ResourcePool<ShaderProgram> *shaderProgramPool = nullptr;
+
+    void evictTextures();
+
+    // Called from the decoding threads, returns the texture that owns the
+    // contents (null if the decode was cancelled)
+    Texture *claimTextureContent(quint64 contentHash, TextureUsage usage, Texture *texture, bool share, const DecodedTexture *decoded);
+    void cancelDecode(PendingTexture *pending);
+    Texture *textureContentOwner(quint64 contentHash, TextureUsage usage);
+    void replaceTexture(Texture *texture, Texture *replacement);
+    void forgetContent(Resource *resource);
+
+    typedef QPair<quint64, int> TextureContentKey; // Content hash and usage
+    QMutex textureContentMutex;
+    QHash<TextureContentKey, Texture*> texturesByContent;
+    QHash<Texture*, TextureContentKey> textureContentKeys;
+
+    QHash<quint64, Material*> materialsByContent;
+    QHash<Material*, quint64> materialContentKeys;
+
+    QVector<PendingTexture*> pendingTextures;
+    QVector<QSharedPointer<DecodedTexture>> cancelledDecodes; // Jobs still running
+
+    mutable QMutex reloadMutex;
+    QVector<Texture*> reloadRequests;
+    bool uploadsDeferred = false;
+
+    quint64 frameIndex = 0;
+    qint64 textureMemoryUsed = 0;
 };
 
 #endif // RESOURCEMANAGER_H
@@ -0,0 +1,170 @@
+#ifndef RESOURCEPOOL_H
+#define RESOURCEPOOL_H
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QVector>
+#include <QtGlobal>
+#include <new>
+#include <type_traits>
+
+// Reference to a resource that can be held anywhere (also in other
+// threads): it stops resolving once the resource is destroyed, because the
+// generation of its slot changes. Resources are only destroyed by
+// ResourceManager::updateResources, in the render thread while the main
+// thread waits for it (see RenderThread).
+template <typename T>
+struct ResourceHandle
+{
+    static const quint32 InvalidSlot = 0xffffffff;
+
+    quint32 slot = InvalidSlot;
+    quint32 generation = 0;
+
+    bool isNull() const { return slot == InvalidSlot; }
+    bool operator==(const ResourceHandle &other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const ResourceHandle &other) const { return !(*this == other); }
+};
+
+// Storage of the resources of one type in slabs of SlabSize objects. The
+// slabs never move, so pointers stay valid until the resource is destroyed
+// and iterating the pool walks contiguous memory.
+template <typename T, int SlabSize = 64>
+class ResourcePool
+{
+public:
+
+    ResourcePool() { }
+    ~ResourcePool() { clear(); }
+
+    ResourcePool(const ResourcePool &) = delete;
+    ResourcePool &operator=(const ResourcePool &) = delete;
+
+    T *create()
+    {
+        quint32 index;
+        if (!freeSlots.isEmpty())
+        {
+            index = freeSlots.takeLast();
+        }
+        else
+        {
+            if (capacity % SlabSize == 0)
+            {
+                if (capacity / SlabSize >= MaxSlabs)
+                {
+                    qFatal("ResourcePool: too many resources");
+                }
+                slabs[capacity / SlabSize].storeRelease(new Slot[SlabSize]);
+            }
+            index = capacity++;
+        }
+
+        Slot &s = slot(index);
+        T *object = new (&s.storage) T;
+        object->poolSlot = index;
+        s.generation.fetchAndAddRelease(1); // Odd while alive
+        liveCount++;
+        return object;
+    }
+
+    void destroy(T *object)
+    {
+        const quint32 index = object->poolSlot;
+        Slot &s = slot(index);
+        Q_ASSERT(isAlive(s) && object == at(index));
+        object->~T();
+        s.generation.fetchAndAddRelease(1); // Outstanding handles stop resolving
+        liveCount--;
+        freeSlots.push_back(index);
+    }
+
+    // Destroys all the resources
+    void clear()
+    {
+        for (quint32 i = 0; i < capacity; ++i)
+        {
+            if (isAlive(slot(i)))
+            {
+                destroy(at(i));
+            }
+        }
+        for (int i = 0; i < MaxSlabs && slabs[i].loadAcquire() != nullptr; ++i)
+        {
+            delete [] slabs[i].loadAcquire();
+            slabs[i].storeRelease(nullptr);
+        }
+        capacity = 0;
+        liveCount = 0;
+        freeSlots.clear();
+    }
+
+    ResourceHandle<T> handle(const T *object) const
+    {
+        ResourceHandle<T> h;
+        if (object != nullptr)
+        {
+            h.slot = object->poolSlot;
+            h.generation = slot(h.slot).generation.loadAcquire();
+        }
+        return h;
+    }
+
+    // Null when the resource was destroyed
+    T *get(const ResourceHandle<T> &h) const
+    {
+        if (h.isNull() || h.slot / SlabSize >= quint32(MaxSlabs))
+        {
+            return nullptr;
+        }
+        Slot *slab = slabs[h.slot / SlabSize].loadAcquire();
+        if (slab == nullptr)
+        {
+            return nullptr;
+        }
+        const Slot &s = slab[h.slot % SlabSize];
+        return (isAlive(s) && s.generation.loadAcquire() == h.generation) ? at(h.slot) : nullptr;
+    }
+
+    int size() const { return liveCount; }
+
+    // Iteration over the live resources in slot order
+    class Iterator
+    {
+    public:
+        Iterator(const ResourcePool *p, quint32 i) : pool(p), index(i) { skipDead(); }
+        T *operator*() const { return pool->at(index); }
+        Iterator &operator++() { ++index; skipDead(); return *this; }
+        bool operator!=(const Iterator &other) const { return index != other.index; }
+    private:
+        void skipDead() { while (index < pool->capacity && !isAlive(pool->slot(index))) ++index; }
+        const ResourcePool *pool;
+        quint32 index;
+    };
+
+    Iterator begin() const { return Iterator(this, 0); }
+    Iterator end() const { return Iterator(this, capacity); }
+
+private:
+
+    struct Slot
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        QAtomicInteger<quint32> generation; // Odd while the slot holds a resource
+    };
+
+    static const int MaxSlabs = 4096;
+
+    static bool isAlive(const Slot &s) { return (s.generation.loadAcquire() & 1) != 0; }
+
+    Slot &slot(quint32 index) const { return slabs[index / SlabSize].loadAcquire()[index % SlabSize]; }
+    T *at(quint32 index) const { return reinterpret_cast<T *>(&slot(index).storage); }
+
+    QAtomicPointer<Slot> slabs[MaxSlabs];
+    quint32 capacity = 0; // Slots handed out so far
+    int liveCount = 0;
+
+    QVector<quint32> freeSlots;
+};
+
+#endif // RESOURCEPOOL_H
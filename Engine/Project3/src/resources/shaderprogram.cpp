@@ -1,25 +1,459 @@
 #include "shaderprogram.h"
+#include "rendering/gl.h"
+#include "util/hash.h"
+#include <QOpenGLContext>
+#include <QStandardPaths>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+
+
+// ARB_get_program_binary (core in OpenGL 4.1, not in the 3.3 functions)
+typedef void (APIENTRY *GetProgramBinaryFunction)(GLuint, GLsizei, GLsizei *, GLenum *, void *);
+typedef void (APIENTRY *ProgramBinaryFunction)(GLuint, GLenum, const void *, GLsizei);
+typedef void (APIENTRY *ProgramParameteriFunction)(GLuint, GLenum, GLint);
+static GetProgramBinaryFunction glGetProgramBinary = nullptr;
+static ProgramBinaryFunction glProgramBinary = nullptr;
+static ProgramParameteriFunction glProgramParameteri = nullptr;
+
+// KHR_parallel_shader_compile (or the ARB one), compile and link return
+// immediately and the completion status is polled
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRY *MaxShaderCompilerThreadsFunction)(GLuint);
+static bool parallelCompile = false;
+
+// Binaries are only valid for the driver that created them
+static quint64 driverHash = 0;
+
+
+void ShaderProgram::initialize(QOpenGLContext *context)
+{
+    parallelCompile = false;
+    const char *parallelFunctions[][2] = {
+        { "GL_KHR_parallel_shader_compile", "glMaxShaderCompilerThreadsKHR" },
+        { "GL_ARB_parallel_shader_compile", "glMaxShaderCompilerThreadsARB" }
+    };
+    for (auto extension : parallelFunctions)
+    {
+        if (context->hasExtension(QByteArray(extension[0])))
+        {
+            auto maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsFunction>(context->getProcAddress(extension[1]));
+            if (maxShaderCompilerThreads != nullptr)
+            {
+                maxShaderCompilerThreads(0xffffffff); // As many threads as the driver wants
+                parallelCompile = true;
+                break;
+            }
+        }
+    }
+
+    glGetProgramBinary = nullptr;
+    glProgramBinary = nullptr;
+    glProgramParameteri = nullptr;
+
+    const QSurfaceFormat format = context->format();
+    const bool core = format.majorVersion() > 4 || (format.majorVersion() == 4 && format.minorVersion() >= 1);
+    if (!core && !context->hasExtension(QByteArrayLiteral("GL_ARB_get_program_binary")))
+    {
+        return;
+    }
+
+    GLint formatCount = 0;
+    gl->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount == 0)
+    {
+        return;
+    }
+
+    glGetProgramBinary = reinterpret_cast<GetProgramBinaryFunction>(context->getProcAddress("glGetProgramBinary"));
+    glProgramBinary = reinterpret_cast<ProgramBinaryFunction>(context->getProcAddress("glProgramBinary"));
+    glProgramParameteri = reinterpret_cast<ProgramParameteriFunction>(context->getProcAddress("glProgramParameteri"));
+
+    const QByteArray renderer = reinterpret_cast<const char *>(gl->glGetString(GL_RENDERER));
+    const QByteArray version = reinterpret_cast<const char *>(gl->glGetString(GL_VERSION));
+    driverHash = hash64(version, hash64(renderer));
+}
+
+// Cached binaries are named after the sources and the driver
+static QString binaryCachePath(quint64 key)
+{
+    static const int cacheVersion = 1; // Increase when the file layout changes
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QString::fromLatin1("/shaders");
+    QDir().mkpath(directory);
+    return QString::fromLatin1("%1/%2-v%3.bin")
+            .arg(directory)
+            .arg(key, 16, 16, QChar('0'))
+            .arg(cacheVersion);
+}
+
+// Reads a shader expanding the #include "file" lines (paths relative to
+// the including file) and lists every file read
+static QByteArray readSource(const QString &filename, QStringList &files, int depth = 0)
+{
+    if (depth > 16)
+    {
+        qDebug("Too many nested includes in shader %s", filename.toLatin1().data());
+        return QByteArray();
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug("Could not open shader %s", filename.toLatin1().data());
+        return QByteArray();
+    }
+    const QFileInfo fileInfo(filename);
+    const QString filePath = QDir::cleanPath(fileInfo.absoluteFilePath());
+    if (!files.contains(filePath))
+    {
+        files.push_back(filePath);
+    }
+
+    QByteArray source;
+    int lineNumber = 0;
+    for (const QByteArray &line : file.readAll().split('\n'))
+    {
+        lineNumber++;
+        const QByteArray trimmed = line.trimmed();
+        if (!trimmed.startsWith("#include"))
+        {
+            source += line;
+            source += '\n';
+            continue;
+        }
+
+        const int begin = trimmed.indexOf('"');
+        const int end = trimmed.lastIndexOf('"');
+        if (begin < 0 || end <= begin)
+        {
+            qDebug("Malformed include in shader %s:%d", filename.toLatin1().data(), lineNumber);
+            continue;
+        }
+        const QString included = fileInfo.dir().filePath(QString::fromLatin1(trimmed.mid(begin + 1, end - begin - 1)));
+        source += readSource(included, files, depth + 1);
+
+        // Errors keep pointing at the lines of the including file
+        source += "#line " + QByteArray::number(lineNumber + 1) + "\n";
+    }
+    return source;
+}
+
+// Inserts the defines right after the #version line (it has to come first)
+static QByteArray addDefines(const QByteArray &source, const QByteArray &defines)
+{
+    if (defines.isEmpty())
+    {
+        return source;
+    }
+    int position = source.indexOf("#version");
+    if (position >= 0)
+    {
+        const int lineEnd = source.indexOf('\n', position);
+        position = (lineEnd < 0) ? source.size() : lineEnd + 1;
+    }
+    else
+    {
+        position = 0;
+    }
+    const int nextLine = source.left(position).count('\n') + 1;
+    return source.left(position) + defines + "#line " + QByteArray::number(nextLine) + "\n" + source.mid(position);
+}
+
 
 ShaderProgram::ShaderProgram()
 {
-    needsUpdate = true;
+    program = variant(0);
+}
+
+ShaderProgram::~ShaderProgram()
+{
+    for (auto v : variants)
+    {
+        delete v->pendingProgram;
+        delete v->program;
+        delete v;
+    }
+}
+
+QOpenGLShaderProgram *ShaderProgram::variant(quint32 featureMask)
+{
+    Variant *v = variants.value(featureMask, nullptr);
+    if (v == nullptr)
+    {
+        v = new Variant;
+        v->program = new QOpenGLShaderProgram;
+        variants.insert(featureMask, v);
+        requestUpdate();
+    }
+    return v->program;
 }
 
 void ShaderProgram::reload()
 {
-    needsUpdate = true;
+    for (auto v : variants)
+    {
+        v->sourcesChanged = true;
+    }
+    requestUpdate();
+}
+
+bool ShaderProgram::usesFile(const QString &filePath) const
+{
+    return sourceFiles.contains(QDir::cleanPath(QFileInfo(filePath).absoluteFilePath()));
+}
+
+bool ShaderProgram::isCompiling() const
+{
+    for (auto v : variants)
+    {
+        if (v->pendingProgram != nullptr)
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
 void ShaderProgram::update()
 {
-    program.removeAllShaders();
+    bool compiling = false;
+    for (auto it = variants.begin(); it != variants.end(); ++it)
+    {
+        Variant &v = **it;
+        if (v.sourcesChanged)
+        {
+            v.sourcesChanged = false;
+            startCompilation(it.key(), v);
+        }
+
+        if (v.pendingProgram != nullptr)
+        {
+            if (compilationFinished(v))
+            {
+                finishCompilation(v);
+            }
+            else
+            {
+                compiling = true;
+            }
+        }
+    }
+    program = variants.value(0)->program;
+
+    // Polled again in the next frame
+    if (compiling)
+    {
+        requestUpdate();
+    }
+}
+
+void ShaderProgram::startCompilation(quint32 featureMask, Variant &v)
+{
+    // A newer version of the sources replaces the one being compiled
+    discardCompilation(v);
+
+    QByteArray defines;
+    for (int i = 0; i < features.size(); ++i)
+    {
+        if (featureMask & (1u << i))
+        {
+            defines += "#define " + features[i].toLatin1() + "\n";
+        }
+    }
+
+    QStringList files;
+    QByteArray vertexSource, fragmentSource;
     if (!vertexShaderFilename.isEmpty())
-        program.addShaderFromSourceFile(QOpenGLShader::Vertex, vertexShaderFilename);
+    {
+        vertexSource = addDefines(readSource(vertexShaderFilename, files), defines);
+    }
     if (!fragmentShaderFilename.isEmpty())
-        program.addShaderFromSourceFile(QOpenGLShader::Fragment, fragmentShaderFilename);
-    program.link();
+    {
+        fragmentSource = addDefines(readSource(fragmentShaderFilename, files), defines);
+    }
+    for (const QString &file : files)
+    {
+        if (!sourceFiles.contains(file))
+        {
+            sourceFiles.push_back(file);
+        }
+    }
+
+    v.pendingProgram = new QOpenGLShaderProgram;
+    v.pendingProgram->create();
+    const GLuint programId = v.pendingProgram->programId();
+
+    // The sources are hashed after the preprocessing, defines included
+    const quint64 key = hash64(fragmentSource, hash64(vertexSource, driverHash));
+    if (loadBinary(programId, key))
+    {
+        v.pendingKey = 0;
+        return;
+    }
+
+    // Compiled with plain GL calls, QOpenGLShaderProgram would wait for every step
+    const QPair<GLenum, QByteArray> stages[] = {
+        qMakePair(GLenum(GL_VERTEX_SHADER), vertexSource),
+        qMakePair(GLenum(GL_FRAGMENT_SHADER), fragmentSource)
+    };
+    for (const auto &stage : stages)
+    {
+        if (stage.second.isEmpty())
+        {
+            continue;
+        }
+        const GLuint shader = gl->glCreateShader(stage.first);
+        const char *source = stage.second.constData();
+        const GLint length = stage.second.size();
+        gl->glShaderSource(shader, 1, &source, &length);
+        gl->glCompileShader(shader);
+        gl->glAttachShader(programId, shader);
+        v.pendingShaders.push_back(shader);
+    }
+
+    if (glProgramParameteri != nullptr)
+    {
+        glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    gl->glLinkProgram(programId);
+    v.pendingKey = key;
+}
+
+bool ShaderProgram::compilationFinished(const Variant &v) const
+{
+    if (!parallelCompile)
+    {
+        return true;
+    }
+    GLint completed = GL_FALSE;
+    gl->glGetProgramiv(v.pendingProgram->programId(), GL_COMPLETION_STATUS_KHR, &completed);
+    return completed != GL_FALSE;
+}
+
+void ShaderProgram::finishCompilation(Variant &v)
+{
+    const GLuint programId = v.pendingProgram->programId();
+
+    GLint status = GL_FALSE;
+    gl->glGetProgramiv(programId, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE)
+    {
+        // The previous program stays in use
+        for (auto shader : v.pendingShaders)
+        {
+            GLint compiled = GL_FALSE;
+            gl->glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+            if (compiled == GL_FALSE)
+            {
+                char log[4096];
+                gl->glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+                qDebug("Could not compile a shader of %s:\n%s", name.toLatin1().data(), log);
+            }
+        }
+        char log[4096];
+        gl->glGetProgramInfoLog(programId, sizeof(log), nullptr, log);
+        qDebug("Could not link shader program %s:\n%s", name.toLatin1().data(), log);
+        discardCompilation(v);
+        return;
+    }
+
+    if (v.pendingKey != 0)
+    {
+        storeBinary(programId, v.pendingKey);
+    }
+
+    for (auto shader : v.pendingShaders)
+    {
+        gl->glDetachShader(programId, shader);
+        gl->glDeleteShader(shader);
+    }
+    v.pendingShaders.clear();
+
+    // Without shaders attached link() only checks the status of the program
+    v.pendingProgram->link();
+    delete v.program;
+    v.program = v.pendingProgram;
+    v.pendingProgram = nullptr;
+}
+
+void ShaderProgram::discardCompilation(Variant &v)
+{
+    for (auto shader : v.pendingShaders)
+    {
+        gl->glDeleteShader(shader);
+    }
+    v.pendingShaders.clear();
+    delete v.pendingProgram;
+    v.pendingProgram = nullptr;
+}
+
+bool ShaderProgram::loadBinary(GLuint programId, quint64 key)
+{
+    if (glProgramBinary == nullptr)
+    {
+        return false;
+    }
+
+    QFile file(binaryCachePath(key));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    const QByteArray contents = file.readAll();
+    if (contents.size() <= int(sizeof(GLenum)))
+    {
+        return false;
+    }
+
+    // The format of the binary followed by its bytes
+    GLenum binaryFormat;
+    memcpy(&binaryFormat, contents.constData(), sizeof(GLenum));
+    glProgramBinary(programId, binaryFormat, contents.constData() + sizeof(GLenum), GLsizei(contents.size() - int(sizeof(GLenum))));
+
+    // Drivers reject the binaries of other versions (or just updated ones)
+    GLint status = GL_FALSE;
+    gl->glGetProgramiv(programId, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE)
+    {
+        qDebug("Shader binary of %s rejected by the driver, compiling it", name.toLatin1().data());
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+void ShaderProgram::storeBinary(GLuint programId, quint64 key)
+{
+    if (glGetProgramBinary == nullptr)
+    {
+        return;
+    }
+
+    GLint length = 0;
+    gl->glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return;
+    }
+
+    QByteArray contents(int(sizeof(GLenum)) + length, Qt::Uninitialized);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(programId, length, nullptr, &binaryFormat, contents.data() + sizeof(GLenum));
+    memcpy(contents.data(), &binaryFormat, sizeof(GLenum));
+
+    QFile file(binaryCachePath(key));
+    if (!file.open(QIODevice::WriteOnly) || file.write(contents) != contents.size())
+    {
+        qDebug("Could not write the shader cache %s", file.fileName().toLatin1().data());
+    }
 }
 
 void ShaderProgram::destroy()
 {
+    for (auto v : variants)
+    {
+        discardCompilation(*v);
+    }
 }
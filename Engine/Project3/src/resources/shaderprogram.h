@@ -3,17 +3,27 @@
 
 #include "resource.h"
 #include <QOpenGLShaderProgram>
+#include <QStringList>
+#include <QHash>
+
+class QOpenGLContext;
 
 
 class ShaderProgram : public Resource
 {
 public:
     ShaderProgram();
+    ~ShaderProgram() override;
 
     virtual const char *typeName() const override { return "ShaderProgram"; }
 
+    // Compiles the variants again, the current ones are used until they link
     void reload();
 
+    // Whether the sources (absolute paths, includes too) were read by the
+    // last compilation
+    bool usesFile(const QString &filePath) const;
+
     virtual ShaderProgram * asShaderProgram() override { return this; }
 
     void update() override;
@@ -22,9 +32,46 @@ public:
     void read(const QJsonObject &) override { }
     void write(QJsonObject &) override { }
 
+    // Resolves the functions to compile in parallel (KHR_parallel_shader_compile)
+    // and to cache the linked programs on disk (glGetProgramBinary), which
+    // are loaded instead of compiling the sources again if the driver
+    // accepts them. Call it on initialization, with the context current.
+    static void initialize(QOpenGLContext *context);
+
+    // Program compiled with the features of the mask (bit i #defines
+    // features[i] after the #version line). Variants are compiled the first
+    // time they are asked for, until then the program does not bind.
+    QOpenGLShaderProgram *variant(quint32 featureMask);
+
     QString vertexShaderFilename;
     QString fragmentShaderFilename;
-    QOpenGLShaderProgram program;
+    QStringList features;
+    QOpenGLShaderProgram *program = nullptr; // Variant without features
+
+    // Compiling in the background, programs are replaced when they link
+    bool isCompiling() const;
+
+private:
+
+    struct Variant
+    {
+        QOpenGLShaderProgram *program = nullptr; // Last program that linked
+        QOpenGLShaderProgram *pendingProgram = nullptr;
+        QVector<GLuint> pendingShaders;
+        quint64 pendingKey = 0; // Binary stored when linked (0 if it came from the cache)
+        bool sourcesChanged = true;
+    };
+
+    void startCompilation(quint32 featureMask, Variant &v);
+    bool compilationFinished(const Variant &v) const;
+    void finishCompilation(Variant &v);
+    void discardCompilation(Variant &v);
+
+    bool loadBinary(GLuint programId, quint64 key);
+    void storeBinary(GLuint programId, quint64 key);
+
+    QHash<quint32, Variant*> variants;
+    QStringList sourceFiles;
 };
 
 #endif // SHADERPROGRAM_H
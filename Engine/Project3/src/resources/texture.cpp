@@ -2,12 +2,77 @@
 #include <QJsonObject>
 #include <QVector2D>
 #include "rendering/gl.h"
+#include "globals.h"
+#include "resourcemanager.h"
+#include "texturearray.h"
+#include "util/hash.h"
+#include "util/hdrconverter.h"
+#include "util/texturecompressor.h"
+#include <QOpenGLBuffer>
+#include <QFile>
+#include <QDir>
+#include <QStandardPaths>
+#include <cstring>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "util/stb_image.h"
 
 
 const char *Texture::TypeName = "Texture";
+const int Texture::EvictedTextureSize = 32;
+
+
+// Streaming buffer used to send the pixels to the GPU
+static QOpenGLBuffer *uploadBuffer = nullptr;
+
+static void uploadPixels(QOpenGLTexture &tex, int w, int h, GLenum format, GLenum type, const void *pixels, int size)
+{
+    if (uploadBuffer == nullptr)
+    {
+        uploadBuffer = new QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
+        uploadBuffer->setUsagePattern(QOpenGLBuffer::StreamDraw);
+        uploadBuffer->create();
+    }
+
+    // Allocating again orphans the storage of the previous upload
+    uploadBuffer->bind();
+    uploadBuffer->allocate(size);
+    void *mapped = uploadBuffer->mapRange(0, size, QOpenGLBuffer::RangeWrite | QOpenGLBuffer::RangeInvalidateBuffer);
+
+    tex.bind();
+    if (mapped != nullptr)
+    {
+        memcpy(mapped, pixels, size_t(size));
+        uploadBuffer->unmap();
+        gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, type, nullptr);
+        uploadBuffer->release();
+    }
+    else
+    {
+        uploadBuffer->release();
+        gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, type, pixels);
+    }
+    tex.release();
+}
+
+// Swaps the rows of the pixels in place (top to bottom)
+static void flipRows(uchar *bits, int bytesPerLine, int h)
+{
+    QByteArray row(bytesPerLine, Qt::Uninitialized);
+    for (int y = 0; y < h / 2; ++y)
+    {
+        uchar *top = bits + y * bytesPerLine;
+        uchar *bottom = bits + (h - 1 - y) * bytesPerLine;
+        memcpy(row.data(), top, size_t(bytesPerLine));
+        memcpy(top, bottom, size_t(bytesPerLine));
+        memcpy(bottom, row.constData(), size_t(bytesPerLine));
+    }
+}
+
+static void flipRows(QImage &image)
+{
+    flipRows(image.bits(), image.bytesPerLine(), image.height());
+}
 
 
 Texture::Texture() :
@@ -16,7 +81,7 @@ Texture::Texture() :
 {
     image = QImage(1, 1, QImage::Format::Format_RGB888);
     image .setPixelColor(0, 0, QColor::fromRgb(255, 0, 255));
-    needsUpdate = true;
+    requestUpdate();
 }
 
 Texture::~Texture()
@@ -29,94 +94,463 @@ void Texture::update()
     if (tex.isCreated()) {
         tex.destroy();
     }
+    releaseLayer();
+
+    // LDR textures with the default wrap mode go into the texture arrays
+    const bool pooled = hdrData.isEmpty() && compressedFormat != GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT &&
+            wrapMode == QOpenGLTexture::Repeat && w >= 4 && h >= 4;
 
-    // Create and upload the texture
+    // Create the texture with immutable storage and upload it
     tex.create();
-    tex.setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
-    tex.setMagnificationFilter(QOpenGLTexture::Linear);
-    tex.setWrapMode(wrapMode);
-    if (!image.isNull())
+    if (!compressedMips.isEmpty())
     {
-        const bool opengl = true;
-        if (opengl)
+        // The mip chain comes encoded already
+        hdr = compressedFormat == GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+        mipLevels = compressedMips.size();
+        gpuBytes = uploadSize();
+        if (pooled)
         {
-            QImage flipped = image.mirrored();
-            tex.setData(flipped);
+            tex.destroy();
+            array = resourceManager->textureArrays->allocate(w, h, mipLevels, compressedFormat, layer);
+            gl->glBindTexture(GL_TEXTURE_2D_ARRAY, array->tex.textureId());
+            for (int level = 0; level < mipLevels; ++level)
+            {
+                const QByteArray &mip = compressedMips[level];
+                gl->glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, qMax(1, w >> level), qMax(1, h >> level), 1,
+                                              compressedFormat, mip.size(), mip.constData());
+            }
+            gl->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            TextureArray::resetBindings();
         }
         else
         {
-            tex.setData(image);
+            tex.bind();
+            for (int level = 0; level < mipLevels; ++level)
+            {
+                const QByteArray &mip = compressedMips[level];
+                gl->glCompressedTexImage2D(GL_TEXTURE_2D, level, compressedFormat, qMax(1, w >> level), qMax(1, h >> level), 0,
+                                           mip.size(), mip.constData());
+            }
+            gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+            tex.release();
+            tex.setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+            tex.setMagnificationFilter(QOpenGLTexture::Linear);
+            tex.setWrapMode(hdr ? QOpenGLTexture::ClampToEdge : wrapMode);
         }
     }
-    else if (hdrData != nullptr) // For HDR images
+    else if (!image.isNull())
+    {
+        // The pixels come flipped already, RGB8 and RGBA8 are uploaded as they are
+        if (image.format() != QImage::Format_RGB888 && image.format() != QImage::Format_RGBA8888)
+        {
+            image = image.convertToFormat(QImage::Format_RGBA8888);
+        }
+        const bool rgb = image.format() == QImage::Format_RGB888;
+        tex.setFormat(rgb ? QOpenGLTexture::RGB8_UNorm : QOpenGLTexture::RGBA8_UNorm);
+        tex.setSize(image.width(), image.height());
+        tex.setMipLevels(tex.maximumMipLevels());
+        tex.allocateStorage(rgb ? QOpenGLTexture::RGB : QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+        uploadPixels(tex, image.width(), image.height(), rgb ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE,
+                     image.constBits(), image.bytesPerLine() * image.height());
+        tex.generateMipMaps();
+        tex.setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+        tex.setMagnificationFilter(QOpenGLTexture::Linear);
+        tex.setWrapMode(wrapMode);
+        hdr = false;
+        mipLevels = tex.mipLevels();
+        gpuBytes = qint64(image.width()) * image.height() * (rgb ? 3 : 4) * 4 / 3;
+        if (pooled)
+        {
+            // The mips generated above are copied into the layer
+            array = resourceManager->textureArrays->allocate(w, h, mipLevels, rgb ? GL_RGB8 : GL_RGBA8, layer);
+            array->copyLayer(tex, layer);
+            tex.destroy();
+        }
+    }
+    else if (!hdrData.isEmpty()) // For HDR images
+    {
+        // Uploaded in the storage format, so the driver does not convert them
+        const bool halfFloat = hdrFormat == GL_RGB16F;
+        tex.setFormat(halfFloat ? QOpenGLTexture::RGB16F : QOpenGLTexture::RGB9E5);
+        tex.setSize(w, h);
+        tex.setMipLevels(1);
+        tex.allocateStorage(QOpenGLTexture::RGB, halfFloat ? QOpenGLTexture::Float16 : QOpenGLTexture::UInt32_RGB9_E5_Rev);
+        gl->glPixelStorei(GL_UNPACK_ALIGNMENT, halfFloat ? 2 : 4);
+        uploadPixels(tex, w, h, GL_RGB, halfFloat ? GL_HALF_FLOAT : GL_UNSIGNED_INT_5_9_9_9_REV, hdrData.constData(), hdrData.size());
+        gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        tex.setMinificationFilter(QOpenGLTexture::Linear);
+        tex.setMagnificationFilter(QOpenGLTexture::Linear);
+        tex.setWrapMode(QOpenGLTexture::ClampToEdge);
+        hdr = true;
+        mipLevels = 1;
+        gpuBytes = hdrData.size();
+    }
+    else
+    {
+        tex.setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+        tex.setMagnificationFilter(QOpenGLTexture::Linear);
+        tex.setWrapMode(wrapMode);
+        mipLevels = 1;
+        gpuBytes = 0;
+    }
+
+    compressedMips.clear();
+    if (!keepPixels)
     {
-        gl->glBindTexture(GL_TEXTURE_2D, tex.textureId());
-        gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, w, h, 0, GL_RGB, GL_FLOAT, hdrData);
-        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         clear();
     }
+
+    ready = true;
+    evicted = false;
+}
+
+void Texture::allocateRenderTarget(int width, int height)
+{
+    if (tex.isCreated()) {
+        tex.destroy();
+    }
+    releaseLayer();
+    clear();
+
+    tex.create();
+    tex.setFormat(QOpenGLTexture::RGB8_UNorm);
+    tex.setSize(width, height);
+    tex.setMipLevels(tex.maximumMipLevels());
+    tex.allocateStorage(QOpenGLTexture::RGB, QOpenGLTexture::UInt8);
+    tex.setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+    tex.setMagnificationFilter(QOpenGLTexture::Linear);
+    tex.setWrapMode(wrapMode);
+
+    w = width;
+    h = height;
+    comp = 3;
+    hdr = false;
+    mipLevels = tex.mipLevels();
+    gpuBytes = qint64(w) * h * 3 * 4 / 3;
+    loading = false;
+    needsUpdate = false;
+    ready = true;
+    evicted = false;
+}
+
+void Texture::generateMipMaps()
+{
+    if (tex.isCreated())
+    {
+        tex.generateMipMaps();
+    }
 }
 
 void Texture::destroy()
 {
     tex.destroy();
+    releaseLayer();
+    gpuBytes = 0;
+}
+
+void Texture::releaseLayer()
+{
+    if (array != nullptr)
+    {
+        resourceManager->textureArrays->release(array, layer);
+        array = nullptr;
+        layer = -1;
+    }
+}
+
+void Texture::destroyUploadBuffer()
+{
+    delete uploadBuffer;
+    uploadBuffer = nullptr;
 }
 
 void Texture::bind(unsigned int textureUnit)
 {
+    markUsed();
     tex.bind(textureUnit);
 }
 
+int Texture::bindMaterialTexture(Texture *texture, unsigned int arrayUnit, unsigned int textureUnit)
+{
+    if (texture == nullptr)
+    {
+        return -2;
+    }
+
+    texture->markUsed();
+    if (!texture->ready)
+    {
+        return -2;
+    }
+    if (texture->array != nullptr)
+    {
+        texture->array->bind(arrayUnit);
+        return texture->layer;
+    }
+    texture->tex.bind(textureUnit);
+    return -1;
+}
+
+void Texture::markUsed()
+{
+    lastUsedFrame = resourceManager->currentFrame();
+
+    // Evicted textures are read from disk again (the low resolution copy is used meanwhile)
+    if (evicted && !loading)
+    {
+        resourceManager->requestReload(this);
+    }
+}
+
+bool Texture::canEvict() const
+{
+    // Only textures that can be read from disk again and whose mip chain
+    // reaches the size of the low resolution copy
+    const int smallestLevel = mipLevels - 1;
+    return ready && !evicted && !loading && !needsUpdate && !keepPixels && !filePath.isEmpty() && gpuBytes > 0 &&
+            qMax(w >> smallestLevel, h >> smallestLevel) <= EvictedTextureSize;
+}
+
+void Texture::evict()
+{
+    // Read back the largest mip that fits the low resolution copy
+    int level = 0;
+    while (level + 1 < mipLevels && qMax(w >> level, h >> level) > EvictedTextureSize)
+    {
+        ++level;
+    }
+    const int levelWidth = qMax(1, w >> level);
+    const int levelHeight = qMax(1, h >> level);
+
+    QVector<float> pixels;
+    if (array != nullptr)
+    {
+        pixels = array->readLayer(level, layer);
+        releaseLayer();
+    }
+    else
+    {
+        pixels.resize(levelWidth * levelHeight * 4);
+        tex.bind();
+        gl->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        gl->glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_FLOAT, pixels.data());
+        tex.release();
+    }
+
+    // The copy is bound as a 2D texture until the full one is back
+    tex.destroy();
+    evicted = true;
+
+    tex.create();
+    tex.setFormat(hdr ? QOpenGLTexture::RGBA16F : QOpenGLTexture::RGBA8_UNorm);
+    tex.setSize(levelWidth, levelHeight);
+    tex.setMipLevels(1);
+    tex.allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::Float32);
+    tex.setData(0, QOpenGLTexture::RGBA, QOpenGLTexture::Float32, pixels.constData());
+    tex.setMinificationFilter(QOpenGLTexture::Linear);
+    tex.setMagnificationFilter(QOpenGLTexture::Linear);
+    tex.setWrapMode(hdr ? QOpenGLTexture::ClampToEdge : wrapMode);
+    gpuBytes = qint64(levelWidth) * levelHeight * (hdr ? 8 : 4);
+}
+
 void Texture::clear()
 {
     image = QImage();
+    hdrData.clear();
+    compressedMips.clear();
+}
 
-    if (hdrData != nullptr)
+// HDR images are encoded as BC6H when compressHdr is set, otherwise (or if
+// their pixels are asked for) they are packed as RGB9E5 or RGB16F. The float
+// pixels are freed right after that.
+static void decodePixels(const QByteArray &fileData, TextureData &data, const TextureDecodeOptions &options, bool compressHdr)
+{
+    const stbi_uc *bytes = reinterpret_cast<const stbi_uc *>(fileData.constData());
+    if (stbi_is_hdr_from_memory(bytes, fileData.size()))
     {
-        stbi_image_free(hdrData);
-        hdrData = nullptr;
+        // Flipped for OpenGL here, the flag of stb_image is global and the
+        // decodes run concurrently
+        int fileComp = 0;
+        float *pixels = stbi_loadf_from_memory(bytes, fileData.size(), &data.w, &data.h, &fileComp, 3);
+        if (pixels != nullptr)
+        {
+            flipRows(reinterpret_cast<uchar *>(pixels), data.w * 3 * int(sizeof(float)), data.h);
+            data.comp = 3;
+            if (compressHdr)
+            {
+                data.compressedMips = TextureCompressor::compressHdr(pixels, data.w, data.h);
+                data.compressedFormat = GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+            }
+            if (data.compressedMips.isEmpty() || options.keepImage)
+            {
+                const int pixelCount = data.w * data.h;
+                data.hdrData = options.halfFloatHdr ? HdrConverter::toHalf(pixels, pixelCount * 3)
+                                                    : HdrConverter::toRgb9e5(pixels, pixelCount);
+                data.hdrFormat = options.halfFloatHdr ? GL_RGB16F : GL_RGB9_E5;
+            }
+            stbi_image_free(pixels);
+        }
+    }
+    else
+    {
+        // Converted (in place when the depth matches) and flipped for OpenGL
+        QImage image = QImage::fromData(fileData);
+        if (!image.isNull())
+        {
+            data.image = std::move(image).convertToFormat(QImage::Format_RGBA8888);
+            flipRows(data.image);
+        }
+        data.w = data.image.width();
+        data.h = data.image.height();
+        data.comp = data.image.depth()/8;
     }
 }
 
-void Texture::loadTexture(const char *filename)
+// Cached block-compressed images are named after the contents of the source
+static QString compressedCachePath(quint64 contentHash, TextureUsage usage)
 {
-    clear();
+    static const int cacheVersion = 1; // Increase when the encoder output changes
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QString::fromLatin1("/textures");
+    QDir().mkpath(directory);
+    return QString::fromLatin1("%1/%2-%3-v%4.ktx")
+            .arg(directory)
+            .arg(contentHash, 16, 16, QChar('0'))
+            .arg(int(usage))
+            .arg(cacheVersion);
+}
 
-    if (stbi_is_hdr(filename))
+static void compressPixels(const QString &cachePath, TextureUsage usage, TextureData &data)
+{
+    // HDR images come encoded from decodePixels
+    TextureCompression compression = TextureCompression::BC6H;
+    if (!data.image.isNull())
     {
-        stbi_set_flip_vertically_on_load(true);
-        hdrData = stbi_loadf(filename, &w, &h, &comp, 0);
+        switch (usage)
+        {
+        case TextureUsage::Normals: compression = TextureCompression::BC5; break;
+        case TextureUsage::Bump: compression = TextureCompression::BC4; break;
+        default: compression = TextureCompressor::hasAlpha(data.image) ? TextureCompression::BC3 : TextureCompression::BC1; break;
+        }
+        data.compressedMips = TextureCompressor::compress(data.image, compression);
     }
-    else
+
+    if (!data.compressedMips.isEmpty())
+    {
+        data.compressedFormat = TextureCompressor::glFormat(compression);
+        if (!TextureCompressor::writeKtx(cachePath, data.compressedFormat, data.w, data.h, data.compressedMips))
+        {
+            qDebug("Could not write the texture cache %s", cachePath.toLatin1().data());
+        }
+    }
+}
+
+TextureData Texture::decodeFile(const QString &filename, const TextureDecodeOptions &options, const std::function<bool(quint64)> &claimContent)
+{
+    TextureData data;
+    const QByteArray filenameLatin1 = filename.toLatin1();
+
+    QFile file(filename);
+    const QByteArray fileData = file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+
+    // The hash identifies the contents for the deduplication and the cache
+    if (!fileData.isEmpty())
     {
-        image = QImage(QString::fromLatin1(filename));
+        data.contentHash = hash64(fileData);
+        if (claimContent && !claimContent(data.contentHash))
+        {
+            data.sharedContent = true;
+            return data;
+        }
+    }
 
-        if (image.isNull())
+    const stbi_uc *bytes = reinterpret_cast<const stbi_uc *>(fileData.constData());
+    const bool hdr = !fileData.isEmpty() && stbi_is_hdr_from_memory(bytes, fileData.size());
+    const bool compress = hdr ? options.compressHdr : options.compress;
+
+    if (!fileData.isEmpty() && compress)
+    {
+        // A cache hit is a straight file read (the pixels are only decoded if asked for)
+        const QString cachePath = compressedCachePath(data.contentHash, options.usage);
+        if (TextureCompressor::readKtx(cachePath, data.compressedFormat, data.w, data.h, data.compressedMips))
+        {
+            data.comp = hdr ? 3 : 4;
+            if (options.keepImage)
+            {
+                decodePixels(fileData, data, options, false);
+            }
+        }
+        else
         {
-            qDebug("Could not open image %s in Texture::loadTexture()", filename);
-            return;
+            decodePixels(fileData, data, options, hdr);
+            compressPixels(cachePath, options.usage, data);
+            if (!options.keepImage && !data.compressedMips.isEmpty())
+            {
+                data.image = QImage();
+                data.hdrData.clear();
+            }
         }
+    }
+    else if (!fileData.isEmpty())
+    {
+        decodePixels(fileData, data, options, false);
+    }
 
-        w = image.width();
-        h = image.height();
-        comp = image.depth()/8;
+    if (data.isNull())
+    {
+        qDebug("Could not open image %s in Texture::decodeFile()", filenameLatin1.data());
     }
 
-    needsUpdate = true;
+    return data;
+}
+
+void Texture::loadTexture(const char *filename)
+{
+    resourceManager->decodeTextureAsync(this, QString::fromLatin1(filename));
+}
 
-    filePath = QString::fromLatin1(filename);
+void Texture::setLoading(const QString &filename)
+{
+    // Keeps the current GL texture (if any) until the new data arrives
+    clear();
+    filePath = filename;
+    loading = true;
+    needsUpdate = false;
+}
+
+void Texture::setData(const TextureData &data, const QString &filename)
+{
+    clear();
+    loading = false;
+
+    if (data.isNull())
+    {
+        return;
+    }
+
+    image = data.image;
+    hdrData = data.hdrData;
+    hdrFormat = data.hdrFormat;
+    compressedMips = data.compressedMips;
+    compressedFormat = data.compressedFormat;
+    w = data.w;
+    h = data.h;
+    comp = data.comp;
+
+    requestUpdate();
+
+    filePath = filename;
 }
 
 void Texture::setImage(const QImage &img)
 {
-    image = img;
+    loading = false;
+    compressedMips.clear();
+    image = (img.format() == QImage::Format_RGB888) ? img : img.convertToFormat(QImage::Format_RGBA8888);
+    flipRows(image);
     w = image.width();
     h = image.height();
     comp = image.depth()/8;
-    needsUpdate = true;
+    requestUpdate();
 }
 
 void Texture::setWrapMode(QOpenGLTexture::WrapMode wrap)
@@ -124,6 +558,24 @@ void Texture::setWrapMode(QOpenGLTexture::WrapMode wrap)
     wrapMode = wrap;
 }
 
+void Texture::setUsage(TextureUsage u)
+{
+    usage = u;
+}
+
+void Texture::setKeepPixels(bool keep)
+{
+    keepPixels = keep;
+}
+
+void Texture::releasePixels()
+{
+    if (!keepPixels && !needsUpdate && !loading)
+    {
+        clear();
+    }
+}
+
 int Texture::width() const
 {
     return w;
@@ -139,6 +591,28 @@ QVector2D Texture::size() const
     return QVector2D(w, h);
 }
 
+int Texture::uploadSize() const
+{
+    if (!compressedMips.isEmpty())
+    {
+        int size = 0;
+        for (const QByteArray &mip : compressedMips)
+        {
+            size += mip.size();
+        }
+        return size;
+    }
+    if (!image.isNull())
+    {
+        return image.width() * image.height() * 4;
+    }
+    if (!hdrData.isEmpty())
+    {
+        return hdrData.size();
+    }
+    return 0;
+}
+
 void Texture::read(const QJsonObject &json)
 {
 }
@@ -4,13 +4,51 @@
 #include "resource.h"
 #include <QOpenGLTexture>
 #include <QImage>
+#include <QVector>
+#include <functional>
 
+// What the texture is sampled for, it selects the block compression
+enum class TextureUsage
+{
+    Color,   // BC1 (BC3 with alpha)
+    Normals, // BC5
+    Bump     // BC4 (the pixels are also decoded for Material::createNormalFromBump)
+};
+
+struct TextureDecodeOptions
+{
+    TextureUsage usage = TextureUsage::Color;
+    bool compress = false;    // S3TC/RGTC blocks for LDR images
+    bool compressHdr = false; // BC6H blocks for HDR images
+    bool keepImage = false;   // Also return the pixels of compressed images
+    bool halfFloatHdr = false; // RGB16F instead of RGB9E5 for uncompressed HDR images
+};
+
+// Decoded pixels of an image file, it can be produced from any thread
+struct TextureData
+{
+    QImage image;                      // LDR images
+    QByteArray hdrData;                // HDR images (RGB9E5 or RGB16F pixels)
+    GLenum hdrFormat = 0;              // GL_RGB9_E5 or GL_RGB16F
+    QVector<QByteArray> compressedMips; // Block-compressed mip chain
+    GLenum compressedFormat = 0;
+    int w = 0;
+    int h = 0;
+    int comp = 0;
+    quint64 contentHash = 0;           // Hash of the file contents
+    bool sharedContent = false;        // Another texture has the same contents (nothing was decoded)
+
+    bool isNull() const { return image.isNull() && hdrData.isEmpty() && compressedMips.isEmpty(); }
+};
+
+class TextureArray;
 
 class Texture : public Resource
 {
 public:
 
     static const char *TypeName;
+    static const int EvictedTextureSize; // Size of the copy bound while evicted
 
     Texture();
     ~Texture() override;
@@ -22,35 +60,92 @@ public:
     void update() override;
     void destroy() override;
 
-    void bind(unsigned int textureUnit);
+    void bind(unsigned int textureUnit); // Only for textures outside of the arrays
+
+    // Binds the texture for a material shader and returns the value of its
+    // layer uniform: the layer in the array bound to arrayUnit, -1 when it
+    // is bound as a 2D texture to textureUnit, -2 when it is not available
+    static int bindMaterialTexture(Texture *texture, unsigned int arrayUnit, unsigned int textureUnit);
+    bool isPooled() const { return array != nullptr; }
 
     void clear();
     void loadTexture(const char *filename);
+    void setLoading(const QString &filename);
+    void setData(const TextureData &data, const QString &filename);
     void setImage(const QImage &img);
     void setWrapMode(QOpenGLTexture::WrapMode wrap);
+    void allocateRenderTarget(int width, int height); // Empty RGB8 storage (with mips) to render into
+    void generateMipMaps();
+    void setUsage(TextureUsage u);
+    TextureUsage getUsage() const { return usage; }
+    bool getKeepPixels() const { return keepPixels; }
+    void setKeepPixels(bool keep);             // Keep the CPU pixels after the upload
+    void releasePixels();                      // Frees the CPU pixels if already uploaded
     int width() const;
     int height() const;
     QVector2D size() const;
 
+    bool isReady() const { return ready; }     // Uploaded at least once
+    bool isLoading() const { return loading; } // Still decoding in a worker thread
+    int uploadSize() const;                    // Bytes sent to the GPU by the next update()
+
+    // Residency
+    qint64 gpuMemory() const { return gpuBytes; }
+    quint64 lastUsed() const { return lastUsedFrame; } // Frame of the last bind()
+    bool isEvicted() const { return evicted; }
+    bool canEvict() const;
+    void evict(); // Replaces the texture by a low resolution copy until it is bound again
+
     void read(const QJsonObject &json) override;
     void write(QJsonObject &json) override;
 
     const QString &getFilePath() const { return filePath; }
 
-    QImage getImage() { return image; } // Shallow copy
+    QImage getImage() { return image; } // Shallow copy (rows bottom to top)
     GLuint textureId() const { return tex.textureId(); }
 
+    // Thread-safe image decoding (it does not touch any Texture), the
+    // pixels are returned ready for OpenGL (RGBA8 rows from bottom to top).
+    // Compressed images are read from the cache or encoded and stored there.
+    // claimContent is called with the hash of the file contents, when it
+    // returns false the image is not decoded (see TextureData::sharedContent).
+    static TextureData decodeFile(const QString &filename, const TextureDecodeOptions &options = TextureDecodeOptions(),
+                                  const std::function<bool(quint64)> &claimContent = nullptr);
+
+    // Frees the pixel unpack buffer shared by all the uploads
+    static void destroyUploadBuffer();
+
 private:
 
+    void markUsed();
+    void releaseLayer();
+
     QString filePath;
 
     QImage image;
 
-    float *hdrData = nullptr;
+    QByteArray hdrData;
+    GLenum hdrFormat = 0;
+    QVector<QByteArray> compressedMips;
+    GLenum compressedFormat = 0;
     int w, h, comp;
 
     QOpenGLTexture tex;
     QOpenGLTexture::WrapMode wrapMode;
+
+    bool ready = false;
+    bool loading = false;
+    bool keepPixels = false;
+    TextureUsage usage = TextureUsage::Color;
+
+    qint64 gpuBytes = 0;
+    quint64 lastUsedFrame = 0;
+    int mipLevels = 1;
+    bool hdr = false;
+    bool evicted = false;
+
+    TextureArray *array = nullptr; // Shared storage of pooled textures
+    int layer = -1;
 };
 
 #endif // TEXTURE_H
@@ -0,0 +1,175 @@
+#include "texturearray.h"
+#include "rendering/gl.h"
+
+
+static const int MAX_BOUND_UNITS = 16;
+static thread_local GLuint boundArrays[MAX_BOUND_UNITS] = {};
+
+// Read framebuffer used to copy the mips of 2D textures into the layers
+static GLuint copyFramebuffer = 0;
+
+
+TextureArray::TextureArray(int w, int h, int mips, GLenum format, int layerCount) :
+    tex(QOpenGLTexture::Target2DArray),
+    width(w),
+    height(h),
+    mipLevels(mips),
+    internalFormat(format),
+    capacity(layerCount),
+    layers(layerCount, false)
+{
+    tex.create();
+    tex.setFormat(QOpenGLTexture::TextureFormat(format));
+    tex.setSize(w, h);
+    tex.setLayers(layerCount);
+    tex.setMipLevels(mips);
+    tex.allocateStorage();
+    tex.setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+    tex.setMagnificationFilter(QOpenGLTexture::Linear);
+    tex.setWrapMode(QOpenGLTexture::Repeat);
+}
+
+int TextureArray::allocateLayer()
+{
+    for (int i = 0; i < capacity; ++i)
+    {
+        if (!layers[i])
+        {
+            layers[i] = true;
+            usedLayers++;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TextureArray::releaseLayer(int layer)
+{
+    if (layer >= 0 && layer < capacity && layers[layer])
+    {
+        layers[layer] = false;
+        usedLayers--;
+    }
+}
+
+bool TextureArray::matches(int w, int h, int mips, GLenum format) const
+{
+    return width == w && height == h && mipLevels == mips && internalFormat == format;
+}
+
+void TextureArray::copyLayer(QOpenGLTexture &source, int layer)
+{
+    GLint previousFramebuffer = 0;
+    gl->glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+    if (copyFramebuffer == 0)
+    {
+        gl->glGenFramebuffers(1, &copyFramebuffer);
+    }
+    gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFramebuffer);
+    gl->glBindTexture(GL_TEXTURE_2D_ARRAY, tex.textureId());
+
+    for (int level = 0; level < mipLevels; ++level)
+    {
+        gl->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source.textureId(), level);
+        gl->glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, 0, 0, qMax(1, width >> level), qMax(1, height >> level));
+    }
+
+    gl->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    gl->glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(previousFramebuffer));
+    gl->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    resetBindings();
+}
+
+QVector<float> TextureArray::readLayer(int level, int layer)
+{
+    // OpenGL 3.3 can only read whole mips of all the layers
+    const int levelWidth = qMax(1, width >> level);
+    const int levelHeight = qMax(1, height >> level);
+    const int layerSize = levelWidth * levelHeight * 4;
+    QVector<float> pixels(layerSize * capacity);
+    gl->glBindTexture(GL_TEXTURE_2D_ARRAY, tex.textureId());
+    gl->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    gl->glGetTexImage(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, GL_FLOAT, pixels.data());
+    gl->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    resetBindings();
+    return pixels.mid(layerSize * layer, layerSize);
+}
+
+void TextureArray::bind(unsigned int textureUnit)
+{
+    if (textureUnit < MAX_BOUND_UNITS && boundArrays[textureUnit] == tex.textureId())
+    {
+        return;
+    }
+    tex.bind(textureUnit);
+    if (textureUnit < MAX_BOUND_UNITS)
+    {
+        boundArrays[textureUnit] = tex.textureId();
+    }
+}
+
+void TextureArray::resetBindings()
+{
+    for (int i = 0; i < MAX_BOUND_UNITS; ++i)
+    {
+        boundArrays[i] = 0;
+    }
+}
+
+
+TextureArrayPool::~TextureArrayPool()
+{
+    for (auto array : arrays)
+    {
+        delete array;
+    }
+}
+
+TextureArray *TextureArrayPool::allocate(int w, int h, int mips, GLenum format, int &layer)
+{
+    int similarArrays = 0;
+    for (auto array : arrays)
+    {
+        if (array->matches(w, h, mips, format))
+        {
+            layer = array->allocateLayer();
+            if (layer >= 0)
+            {
+                return array;
+            }
+            similarArrays++;
+        }
+    }
+
+    // Grows geometrically so few arrays are needed and little memory is wasted
+    const int layerCount = qMin(4 << similarArrays, 64);
+    TextureArray *array = new TextureArray(w, h, mips, format, layerCount);
+    arrays.push_back(array);
+    layer = array->allocateLayer();
+    return array;
+}
+
+void TextureArrayPool::release(TextureArray *array, int layer)
+{
+    array->releaseLayer(layer);
+    if (array->isEmpty())
+    {
+        arrays.removeOne(array);
+        delete array;
+        TextureArray::resetBindings();
+    }
+}
+
+void TextureArrayPool::destroy()
+{
+    for (auto array : arrays)
+    {
+        array->tex.destroy();
+    }
+    if (copyFramebuffer != 0)
+    {
+        gl->glDeleteFramebuffers(1, &copyFramebuffer);
+        copyFramebuffer = 0;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef TEXTUREARRAY_H
+#define TEXTUREARRAY_H
+
+#include <QOpenGLTexture>
+#include <QVector>
+
+// GL_TEXTURE_2D_ARRAY whose layers hold textures of the same size, format
+// and number of mips
+class TextureArray
+{
+public:
+
+    TextureArray(int w, int h, int mips, GLenum format, int layerCount);
+
+    int allocateLayer(); // -1 if there are no free layers
+    void releaseLayer(int layer);
+    bool isEmpty() const { return usedLayers == 0; }
+    bool matches(int w, int h, int mips, GLenum format) const;
+
+    // Copies all the mips of a 2D texture (of a renderable format) into a layer
+    void copyLayer(QOpenGLTexture &source, int layer);
+
+    // Reads one mip of a layer as RGBA floats
+    QVector<float> readLayer(int level, int layer);
+
+    void bind(unsigned int textureUnit);
+
+    // Forgets which arrays are bound (at the start of every pass)
+    static void resetBindings();
+
+    QOpenGLTexture tex;
+    const int width;
+    const int height;
+    const int mipLevels;
+    const GLenum internalFormat;
+    const int capacity;
+
+private:
+
+    QVector<bool> layers;
+    int usedLayers = 0;
+};
+
+// All the texture arrays, a new one (twice as large as the last one of the
+// same kind) is created when the others are full
+class TextureArrayPool
+{
+public:
+
+    ~TextureArrayPool();
+
+    TextureArray *allocate(int w, int h, int mips, GLenum format, int &layer);
+    void release(TextureArray *array, int layer);
+    void destroy();
+
+private:
+
+    QVector<TextureArray*> arrays;
+};
+
+#endif // TEXTUREARRAY_H
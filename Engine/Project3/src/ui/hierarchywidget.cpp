@@ -12,7 +12,7 @@ HierarchyWidget::HierarchyWidget(QWidget *parent) :
     connect(ui->addButton, SIGNAL(clicked()), this, SLOT(addEntity()));
     connect(ui->duplicateButton, SIGNAL(clicked()), this, SLOT(duplicateEntity()));
     connect(ui->removeButton, SIGNAL(clicked()), this, SLOT(removeEntity()));
-    connect(ui->listWidget, SIGNAL(itemClicked(QListWidgetItem *)), this, SLOT(onItemClicked(QListWidgetItem *)));
+    connect(ui->treeWidget, SIGNAL(itemClicked(QTreeWidgetItem *, int)), this, SLOT(onItemClicked(QTreeWidgetItem *, int)));
 }
 
 HierarchyWidget::~HierarchyWidget()
@@ -22,16 +22,42 @@ HierarchyWidget::~HierarchyWidget()
 
 void HierarchyWidget::updateLayout()
 {
-    ui->listWidget->clear();
+    ui->treeWidget->clear();
+    itemEntities.clear();
     for (int i = 0; i < scene->numEntities(); ++i)
     {
-        if (scene->entityAt(i) != nullptr)
+        Entity *entity = scene->entityAt(i);
+        if (entity != nullptr && entity->parent == nullptr)
         {
-            ui->listWidget->addItem(scene->entityAt(i)->name);
+            addItem(entity, nullptr);
         }
     }
 }
 
+void HierarchyWidget::addItem(Entity *entity, QTreeWidgetItem *parentItem)
+{
+    QTreeWidgetItem *item = new QTreeWidgetItem(QStringList(entity->name));
+    if (parentItem != nullptr)
+    {
+        parentItem->addChild(item);
+    }
+    else
+    {
+        ui->treeWidget->addTopLevelItem(item);
+    }
+    itemEntities.insert(item, entity);
+
+    for (auto child : entity->children)
+    {
+        addItem(child, item);
+    }
+}
+
+Entity *HierarchyWidget::currentEntity() const
+{
+    return itemEntities.value(ui->treeWidget->currentItem(), nullptr);
+}
+
 void HierarchyWidget::addEntity()
 {
     Entity *entity = scene->addEntity();
@@ -40,10 +66,9 @@ void HierarchyWidget::addEntity()
 
 void HierarchyWidget::duplicateEntity()
 {
-    int index = ui->listWidget->currentRow();
-    if (index != -1)
+    auto entity = currentEntity();
+    if (entity != nullptr)
     {
-        auto entity = scene->entityAt(index);
         auto duplicatedEntity = entity->clone();
         emit entityAdded(duplicatedEntity);
     }
@@ -51,21 +76,28 @@ void HierarchyWidget::duplicateEntity()
 
 void HierarchyWidget::removeEntity()
 {
-    int index = ui->listWidget->currentRow();
-    if (index != -1)
+    auto entity = currentEntity();
+    if (entity != nullptr)
     {
-        auto entity = scene->entityAt(index);
-        scene->removeEntityAt(index);
-        emit entityRemoved(entity);
+        // The children go too
+        QVector<Entity*> removed = { entity };
+        for (int i = 0; i < removed.size(); ++i)
+        {
+            removed += removed[i]->children;
+        }
+        scene->removeEntity(entity);
+        for (auto e : removed)
+        {
+            emit entityRemoved(e);
+        }
     }
 }
 
-void HierarchyWidget::onItemClicked(QListWidgetItem *)
+void HierarchyWidget::onItemClicked(QTreeWidgetItem *item, int)
 {
-    int index = ui->listWidget->currentRow();
-    if (index != -1)
+    Entity *entity = itemEntities.value(item, nullptr);
+    if (entity != nullptr)
     {
-        Entity *entity = scene->entityAt(index);
         emit entitySelected(entity);
     }
 }
@@ -2,13 +2,14 @@
 #define HIERARCHYWIDGET_H
 
 #include <QWidget>
+#include <QHash>
 
 namespace Ui {
 class HierarchyWidget;
 }
 
 class Entity;
-class QListWidgetItem;
+class QTreeWidgetItem;
 
 class HierarchyWidget : public QWidget
 {
@@ -30,10 +31,16 @@ public slots:
     void addEntity();
     void duplicateEntity();
     void removeEntity();
-    void onItemClicked(QListWidgetItem *);
+    void onItemClicked(QTreeWidgetItem *, int);
 
 private:
+
+    void addItem(Entity *entity, QTreeWidgetItem *parentItem);
+    Entity *currentEntity() const;
+
     Ui::HierarchyWidget *ui;
+
+    QHash<QTreeWidgetItem*, Entity*> itemEntities;
 };
 
 #endif // HIERARCHYWIDGET_H
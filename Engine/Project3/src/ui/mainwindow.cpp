@@ -23,6 +23,9 @@
 #include <QComboBox>
 #include <QDockWidget>
 #include <QVBoxLayout>
+#include <QFileSystemWatcher>
+#include <QDirIterator>
+#include <QFileInfo>
 
 
 MainWindow *g_MainWindow = nullptr;
@@ -33,6 +36,7 @@ MainWindow::MainWindow(QWidget *parent) :
     uiMainWindow(new Ui::MainWindow)
 {
     // In globals.h / globals.cpp
+    jobSystem = new JobSystem();
     resourceManager = new ResourceManager();
     scene = new Scene();
 
@@ -135,6 +139,16 @@ MainWindow::MainWindow(QWidget *parent) :
 
     connect(selection, SIGNAL(entitySelected(Entity *)), this, SLOT(onEntitySelectedFromSceneView(Entity *)));
 
+    shaderWatcher = new QFileSystemWatcher(this);
+    // Absolute as the shader sources are resolved (see ShaderProgram::readSource)
+    const QString shaderDirectory = QDir::cleanPath(QFileInfo("res/shaders").absoluteFilePath());
+    if (watchShaderFiles(shaderDirectory).isEmpty())
+    {
+        qDebug("Shader directory %s not found, shaders will not be reloaded", shaderDirectory.toLatin1().data());
+    }
+    connect(shaderWatcher, SIGNAL(fileChanged(const QString &)), this, SLOT(onShaderFileChanged(const QString &)));
+    connect(shaderWatcher, SIGNAL(directoryChanged(const QString &)), this, SLOT(onShaderDirectoryChanged(const QString &)));
+
     hierarchyWidget->updateLayout();
     resourcesWidget->updateLayout();
 
@@ -143,6 +157,9 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    // The context is back in the main thread from here on
+    openGLWidget->stopRendering();
+
     // In globals.h / globals.cpp
     delete scene;
 
@@ -151,6 +168,8 @@ MainWindow::~MainWindow()
 
     delete uiMainWindow;
 
+    delete jobSystem; // The jobs in flight are waited for by their owners
+
     g_MainWindow = nullptr;
 }
 
@@ -256,7 +275,7 @@ void MainWindow::addSphere()
 void MainWindow::addPointLight()
 {
     Entity *entity = scene->addEntity();
-    entity->transform->position = QVector3D(0.0f, -3.0f, 3.0f);
+    entity->transform->setPosition(QVector3D(0.0f, -3.0f, 3.0f));
     entity->name = "Point light";
     entity->addComponent(ComponentType::LightSource);
     entity->lightSource->type = LightSource::Type::Point;
@@ -269,7 +288,7 @@ void MainWindow::addPointLight()
 void MainWindow::addDirectionalLight()
 {
     Entity *entity = scene->addEntity();
-    entity->transform->position = QVector3D(3.0f, 5.0f, 4.0f);
+    entity->transform->setPosition(QVector3D(3.0f, 5.0f, 4.0f));
     entity->name = "Directional light";
     entity->addComponent(ComponentType::LightSource);
     entity->lightSource->type = LightSource::Type::Directional;
@@ -320,7 +339,7 @@ void MainWindow::exit()
 
 void MainWindow::updateRender()
 {
-    openGLWidget->update();
+    openGLWidget->requestFrame();
 }
 
 void MainWindow::updateEverything()
@@ -328,7 +347,7 @@ void MainWindow::updateEverything()
     hierarchyWidget->updateLayout();
     resourcesWidget->updateLayout();
     inspectorWidget->updateLayout();
-    openGLWidget->update();
+    openGLWidget->requestFrame();
 }
 
 void MainWindow::onSceneChanged()
@@ -353,19 +372,20 @@ void MainWindow::onEntitySelectedFromHierarchy(Entity *entity)
 {
     selection->onEntitySelectedFromEditor(entity);
     inspectorWidget->showEntity(entity);
-    openGLWidget->update();
+    openGLWidget->requestFrame();
 }
 
 void MainWindow::onEntitySelectedFromSceneView(Entity *entity)
 {
     inspectorWidget->showEntity(entity);
-    openGLWidget->update();
+    openGLWidget->requestFrame();
 }
 
-void MainWindow::onEntityChangedFromInspector(Entity * /*entity*/)
+void MainWindow::onEntityChangedFromInspector(Entity *entity)
 {
+   scene->markDirty(entity);
    hierarchyWidget->updateLayout();
-   openGLWidget->update();
+   openGLWidget->requestFrame();
 }
 
 void MainWindow::onEntityChangedInteractively()
@@ -384,7 +404,7 @@ void MainWindow::onResourceRemoved(Resource *resource)
     scene->handleResourcesAboutToDie();
     resourcesWidget->updateLayout();
     inspectorWidget->showResource(resource);
-    openGLWidget->update();
+    openGLWidget->requestFrame();
 }
 
 void MainWindow::onResourceSelected(Resource *resource)
@@ -394,8 +414,9 @@ void MainWindow::onResourceSelected(Resource *resource)
 
 void MainWindow::onResourceChangedFromInspector(Resource *)
 {
+    scene->markAllDirty(); // Mesh bounds may have changed
     resourcesWidget->updateLayout();
-    openGLWidget->update();
+    openGLWidget->requestFrame();
 }
 
 void MainWindow::dragEnterEvent(QDragEnterEvent* event)
@@ -468,7 +489,65 @@ void MainWindow::closeEvent(QCloseEvent *event)
 void MainWindow::reloadShaderPrograms()
 {
     resourceManager->reloadShaderPrograms();
-    openGLWidget->update();
+    openGLWidget->requestFrame();
+}
+
+QStringList MainWindow::watchShaderFiles(const QString &directory)
+{
+    if (!QFileInfo(directory).isDir())
+    {
+        return QStringList();
+    }
+
+    QStringList candidates(directory);
+    QDirIterator it(directory, QDir::AllEntries | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        candidates.push_back(it.next());
+    }
+
+    // Already watched paths are skipped
+    const QStringList watched = shaderWatcher->files() + shaderWatcher->directories();
+    QStringList paths;
+    for (const QString &path : candidates)
+    {
+        if (!watched.contains(path))
+        {
+            paths.push_back(path);
+        }
+    }
+    if (!paths.isEmpty())
+    {
+        shaderWatcher->addPaths(paths);
+    }
+    return paths;
+}
+
+void MainWindow::onShaderFileChanged(const QString &path)
+{
+    // Editors that save by replacing the file make the watcher drop it, it
+    // is watched again (and reloaded) when it shows up in its directory
+    if (!QFileInfo::exists(path))
+    {
+        return;
+    }
+    if (!shaderWatcher->files().contains(path))
+    {
+        shaderWatcher->addPath(path);
+    }
+
+    resourceManager->reloadShaderPrograms(path);
+    openGLWidget->requestFrame();
+}
+
+void MainWindow::onShaderDirectoryChanged(const QString &path)
+{
+    // New files (or files replaced by editors)
+    for (auto file : watchShaderFiles(path))
+    {
+        resourceManager->reloadShaderPrograms(file);
+    }
+    openGLWidget->requestFrame();
 }
 
 void MainWindow::onRenderChanged(QString name)
@@ -484,7 +563,7 @@ void MainWindow::onRenderChanged(QString name)
 void MainWindow::onRenderOutputChanged(QString name)
 {
     openGLWidget->showTextureWithName(name);
-    openGLWidget->update();
+    openGLWidget->requestFrame();
 }
 
 
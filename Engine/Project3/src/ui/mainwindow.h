@@ -2,6 +2,7 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QStringList>
 
 namespace Ui {
 class MainWindow;
@@ -16,6 +17,7 @@ class Scene;
 class Entity;
 class Resource;
 class QComboBox;
+class QFileSystemWatcher;
 
 class MainWindow : public QMainWindow
 {
@@ -56,6 +58,8 @@ public slots:
     void updateRender();
     void updateEverything();
     void reloadShaderPrograms();
+    void onShaderFileChanged(const QString &path);
+    void onShaderDirectoryChanged(const QString &path);
     void onRenderOutputChanged(QString);
     void onRenderChanged(QString);
 
@@ -72,6 +76,10 @@ private:
     Ui::MainWindow *uiMainWindow;
     QComboBox* comboRendererOutput;
 
+    // Programs are compiled again when their sources change
+    QFileSystemWatcher *shaderWatcher;
+    QStringList watchShaderFiles(const QString &directory); // Returns the new paths
+
 public:
     OpenGLWidget    *openGLWidget;
     HierarchyWidget *hierarchyWidget;
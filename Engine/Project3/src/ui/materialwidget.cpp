@@ -94,6 +94,7 @@ void MaterialWidget::setMaterial(Material *m)
 void MaterialWidget::onShaderChanged(int index)
 {
     material->shaderType = (MaterialShaderType)index;
+    material->requestUpdate();
     emit resourceChanged(material);
 }
 
@@ -104,6 +105,7 @@ void MaterialWidget::onButtonAlbedoClicked()
     {
         material->albedo = color;
         setButtonColor(ui->buttonAlbedo, material->albedo);
+        material->requestUpdate();
         emit resourceChanged(material);
     }
 }
@@ -113,17 +115,13 @@ void MaterialWidget::onButtonAlbedoTextureClicked()
     QMenu contextMenu(tr("Context menu"), (QPushButton*)sender());
 
     QVector<QAction*> actions;
-    for (int i = 0; i < resourceManager->resources.size(); ++i)
+    for (auto texture : resourceManager->textures())
     {
-        Texture * texture = resourceManager->resources[i]->asTexture();
-        if (texture != nullptr)
-        {
-            auto action = new QAction(texture->name, this);
-            action->setProperty("texture", QVariant::fromValue<void*>(texture));
-            actions.push_back(action);
-            connect(action, SIGNAL(triggered()), this, SLOT(onAlbedoTextureChanged()));
-            contextMenu.addAction(action);
-        }
+        auto action = new QAction(texture->name, this);
+        action->setProperty("texture", QVariant::fromValue<void*>(texture));
+        actions.push_back(action);
+        connect(action, SIGNAL(triggered()), this, SLOT(onAlbedoTextureChanged()));
+        contextMenu.addAction(action);
     }
 
     contextMenu.exec(mapToGlobal( ((QPushButton*)sender())->pos() ) );
@@ -135,7 +133,9 @@ void MaterialWidget::onAlbedoTextureChanged()
     QAction *action = (QAction*)sender();
     Texture *texture = (Texture*)action->property("texture").value<void*>();
     material->albedoTexture = texture;
+    material->referenceTextures();
     ui->buttonAlbedoTexture->setText(material->albedoTexture->name);
+    material->requestUpdate();
     emit resourceChanged(material);
 }
 
@@ -146,6 +146,7 @@ void MaterialWidget::onButtonEmissiveClicked()
     {
         material->emissive = color;
         setButtonColor(ui->buttonEmissive, material->emissive);
+        material->requestUpdate();
         emit resourceChanged(material);
     }
 }
@@ -155,17 +156,13 @@ void MaterialWidget::onButtonEmissiveTextureClicked()
     QMenu contextMenu(tr("Context menu"), (QPushButton*)sender());
 
     QVector<QAction*> actions;
-    for (int i = 0; i < resourceManager->resources.size(); ++i)
+    for (auto texture : resourceManager->textures())
     {
-        Texture * texture = resourceManager->resources[i]->asTexture();
-        if (texture != nullptr)
-        {
-            auto action = new QAction(texture->name, this);
-            action->setProperty("texture", QVariant::fromValue<void*>(texture));
-            actions.push_back(action);
-            connect(action, SIGNAL(triggered()), this, SLOT(onEmissiveTextureChanged()));
-            contextMenu.addAction(action);
-        }
+        auto action = new QAction(texture->name, this);
+        action->setProperty("texture", QVariant::fromValue<void*>(texture));
+        actions.push_back(action);
+        connect(action, SIGNAL(triggered()), this, SLOT(onEmissiveTextureChanged()));
+        contextMenu.addAction(action);
     }
 
     contextMenu.exec(mapToGlobal( ((QPushButton*)sender())->pos() ) );
@@ -177,7 +174,9 @@ void MaterialWidget::onEmissiveTextureChanged()
     QAction *action = (QAction*)sender();
     Texture *texture = (Texture*)action->property("texture").value<void*>();
     material->emissiveTexture = texture;
+    material->referenceTextures();
     ui->buttonEmissiveTexture->setText(material->emissiveTexture->name);
+    material->requestUpdate();
     emit resourceChanged(material);
 }
 
@@ -188,6 +187,7 @@ void MaterialWidget::onButtonSpecularClicked()
     {
         material->specular = color;
         setButtonColor(ui->buttonSpecular, material->specular);
+        material->requestUpdate();
         emit resourceChanged(material);
     }
 }
@@ -197,17 +197,13 @@ void MaterialWidget::onButtonSpecularTextureClicked()
     QMenu contextMenu(tr("Context menu"), (QPushButton*)sender());
 
     QVector<QAction*> actions;
-    for (int i = 0; i < resourceManager->resources.size(); ++i)
+    for (auto texture : resourceManager->textures())
     {
-        Texture * texture = resourceManager->resources[i]->asTexture();
-        if (texture != nullptr)
-        {
-            auto action = new QAction(texture->name, this);
-            action->setProperty("texture", QVariant::fromValue<void*>(texture));
-            actions.push_back(action);
-            connect(action, SIGNAL(triggered()), this, SLOT(onSpecularTextureChanged()));
-            contextMenu.addAction(action);
-        }
+        auto action = new QAction(texture->name, this);
+        action->setProperty("texture", QVariant::fromValue<void*>(texture));
+        actions.push_back(action);
+        connect(action, SIGNAL(triggered()), this, SLOT(onSpecularTextureChanged()));
+        contextMenu.addAction(action);
     }
 
     contextMenu.exec(mapToGlobal( ((QPushButton*)sender())->pos() ) );
@@ -219,7 +215,9 @@ void MaterialWidget::onSpecularTextureChanged()
     QAction *action = (QAction*)sender();
     Texture *texture = (Texture*)action->property("texture").value<void*>();
     material->specularTexture = texture;
+    material->referenceTextures();
     ui->buttonSpecularTexture->setText(material->specularTexture->name);
+    material->requestUpdate();
     emit resourceChanged(material);
 }
 
@@ -228,17 +226,13 @@ void MaterialWidget::onButtonNormalTextureClicked()
     QMenu contextMenu(tr("Context menu"), (QPushButton*)sender());
 
     QVector<QAction*> actions;
-    for (int i = 0; i < resourceManager->resources.size(); ++i)
+    for (auto texture : resourceManager->textures())
     {
-        Texture * texture = resourceManager->resources[i]->asTexture();
-        if (texture != nullptr)
-        {
-            auto action = new QAction(texture->name, this);
-            action->setProperty("texture", QVariant::fromValue<void*>(texture));
-            actions.push_back(action);
-            connect(action, SIGNAL(triggered()), this, SLOT(onNormalTextureChanged()));
-            contextMenu.addAction(action);
-        }
+        auto action = new QAction(texture->name, this);
+        action->setProperty("texture", QVariant::fromValue<void*>(texture));
+        actions.push_back(action);
+        connect(action, SIGNAL(triggered()), this, SLOT(onNormalTextureChanged()));
+        contextMenu.addAction(action);
     }
 
     contextMenu.exec(mapToGlobal( ((QPushButton*)sender())->pos() ) );
@@ -250,7 +244,9 @@ void MaterialWidget::onNormalTextureChanged()
     QAction *action = (QAction*)sender();
     Texture *texture = (Texture*)action->property("texture").value<void*>();
     material->normalsTexture = texture;
+    material->referenceTextures();
     ui->buttonNormalTexture->setText(material->normalsTexture->name);
+    material->requestUpdate();
     emit resourceChanged(material);
 }
 
@@ -259,17 +255,13 @@ void MaterialWidget::onButtonBumpTextureClicked()
     QMenu contextMenu(tr("Context menu"), (QPushButton*)sender());
 
     QVector<QAction*> actions;
-    for (int i = 0; i < resourceManager->resources.size(); ++i)
+    for (auto texture : resourceManager->textures())
     {
-        Texture * texture = resourceManager->resources[i]->asTexture();
-        if (texture != nullptr)
-        {
-            auto action = new QAction(texture->name, this);
-            action->setProperty("texture", QVariant::fromValue<void*>(texture));
-            actions.push_back(action);
-            connect(action, SIGNAL(triggered()), this, SLOT(onBumpTextureChanged()));
-            contextMenu.addAction(action);
-        }
+        auto action = new QAction(texture->name, this);
+        action->setProperty("texture", QVariant::fromValue<void*>(texture));
+        actions.push_back(action);
+        connect(action, SIGNAL(triggered()), this, SLOT(onBumpTextureChanged()));
+        contextMenu.addAction(action);
     }
 
     contextMenu.exec(mapToGlobal( ((QPushButton*)sender())->pos() ) );
@@ -281,30 +273,36 @@ void MaterialWidget::onBumpTextureChanged()
     QAction *action = (QAction*)sender();
     Texture *texture = (Texture*)action->property("texture").value<void*>();
     material->bumpTexture = texture;
+    material->referenceTextures();
     ui->buttonBumpTexture->setText(material->bumpTexture->name);
+    material->requestUpdate();
     emit resourceChanged(material);
 }
 
 void MaterialWidget::onSmoothnessChanged(int value)
 {
     material->smoothness = value / 255.0f;
+    material->requestUpdate();
     emit resourceChanged(material);
 }
 
 void MaterialWidget::onMetalnessChanged(int value)
 {
     material->metalness = value / 255.0f;
+    material->requestUpdate();
     emit resourceChanged(material);
 }
 
 void MaterialWidget::onBumpinessChanged(double value)
 {
     material->bumpiness = value;
+    material->requestUpdate();
     emit resourceChanged(material);
 }
 
 void MaterialWidget::onTilingChanged(double)
 {
     material->tiling = QVector2D(ui->spinTilingX->value(), ui->spinTilingY->value());
+    material->requestUpdate();
     emit resourceChanged(material);
 }
@@ -2,8 +2,12 @@
 #include <QOpenGLDebugLogger>
 #include "rendering/forwardrenderer.h"
 #include "rendering/deferredrenderer.h"
+#include "rendering/framebufferobject.h"
+#include "rendering/framesnapshot.h"
+#include "rendering/renderthread.h"
 #include "resources/resourcemanager.h"
 #include "resources/texture.h"
+#include "resources/shaderprogram.h"
 #include "globals.h"
 #include "input/input.h"
 #include "input/interaction.h"
@@ -21,6 +25,10 @@ OpenGLWidget::OpenGLWidget(QWidget *parent)
     setMouseTracking(true);
     gl = this;
 
+    // The render thread draws every pixel, and grabFramebuffer has to find
+    // the last frame in the framebuffer
+    setUpdateBehavior(QOpenGLWidget::PartialUpdate);
+
     // Configure the timer
     connect(&timer, SIGNAL(timeout()), this, SLOT(frame()));
     if(format().swapInterval() == -1)
@@ -56,6 +64,8 @@ OpenGLWidget::OpenGLWidget(QWidget *parent)
 
 OpenGLWidget::~OpenGLWidget()
 {
+    stopRendering();
+
     delete miscSettings;
     delete renderer;
     delete selection;
@@ -77,11 +87,19 @@ void OpenGLWidget::initializeGL()
         QOpenGLDebugLogger *logger = new QOpenGLDebugLogger(this);
         logger->initialize(); // initializes in the current context, i.e. ctx
 
+        // Messages arrive in the render thread
         connect(logger, SIGNAL(messageLogged(const QOpenGLDebugMessage &)),
-                this, SLOT(handleLoggedMessage(const QOpenGLDebugMessage &)));
+                this, SLOT(handleLoggedMessage(const QOpenGLDebugMessage &)), Qt::DirectConnection);
         logger->startLogging();
     }
 
+    // Block-compressed textures (RGTC is core, S3TC and BPTC are extensions)
+    resourceManager->compressTextures = context()->hasExtension(QByteArrayLiteral("GL_EXT_texture_compression_s3tc"));
+    resourceManager->compressHdrTextures = context()->hasExtension(QByteArrayLiteral("GL_ARB_texture_compression_bptc"));
+
+    // Shader compilation functions, before the renderers create their programs
+    ShaderProgram::initialize(context());
+
     // Handle context destructions
     connect(context(), SIGNAL(aboutToBeDestroyed()), this, SLOT(finalizeGL()));
 
@@ -93,41 +111,104 @@ void OpenGLWidget::initializeGL()
 
     forwardRenderer->initialize();
     deferredRenderer->initialize();
+
+    // The frames are drawn by the render thread from now on. Qt composes or
+    // resizes the widget framebuffer in the main thread, after the frame in
+    // flight is finished.
+    renderThread = new RenderThread(this);
+    connect(renderThread, SIGNAL(frameRendered()), this, SLOT(update()));
+    connect(this, SIGNAL(aboutToCompose()), renderThread, SLOT(finishFrame()));
+    connect(this, SIGNAL(aboutToResize()), renderThread, SLOT(finishFrame()));
+    renderThread->start();
 }
 
 void OpenGLWidget::resizeGL(int w, int h)
 {
+    // The renderers are resized by the render thread
     camera->viewportWidth = w;
     camera->viewportHeight = h;
-    forwardRenderer->resize(w, h);
-    deferredRenderer->resize(w, h);
+    framebufferWidth = int(w * devicePixelRatioF());
+    framebufferHeight = int(h * devicePixelRatioF());
+    requestFrame();
+}
+
+void OpenGLWidget::paintEvent(QPaintEvent *)
+{
 }
 
-void OpenGLWidget::paintGL()
+void OpenGLWidget::renderFrame()
 {
-    resourceManager->updateResources();
+    if (renderThread == nullptr)
+    {
+        return;
+    }
+
+    scene->updateTransforms();
+    scene->updateSpatialIndex();
 
     camera->prepareMatrices();
 
-    renderer->render(camera);
-    if (interaction->renderIdentifiers)
+    // Captured while the previous frame is being drawn
+    renderThread->nextFrame().capture(renderer);
+    interaction->renderIdentifiers = false;
+
+    renderThread->finishFrame();
+
+    // Entity clicked in the previous frame
+    if (pickPending)
     {
-        ((DeferredRenderer*)deferredRenderer)->renderIdentifiers(camera);
-        unsigned int objectId = ((DeferredRenderer*)deferredRenderer)->getClickedIdentifier(input->mousex, camera->viewportHeight - input->mousey);
+        pickPending = false;
         for (auto entity : scene->entities)
         {
-            if (entity->active && entity->id == objectId)
+            if (entity->active && entity->id == pickedIdentifier)
             {
-                selection->select((entity));
+                selection->select(entity);
+                break;
             }
-         }
+        }
+    }
+
+    renderThread->submitFrame();
+}
 
-        interaction->renderIdentifiers = false;
+void OpenGLWidget::renderSnapshot(const FrameSnapshot &frame)
+{
+    // Outside of paintGL neither the framebuffer nor the viewport are set
+    FramebufferObject::setDefault(defaultFramebufferObject());
+    gl->glViewport(0, 0, framebufferWidth, framebufferHeight);
+
+    const int w = frame.camera.viewportWidth;
+    const int h = frame.camera.viewportHeight;
+    if (w != renderWidth || h != renderHeight)
+    {
+        renderWidth = w;
+        renderHeight = h;
+        forwardRenderer->resize(w, h);
+        deferredRenderer->resize(w, h);
+    }
+
+    frame.renderer->render(frame);
+    if (frame.pickIdentifiers)
+    {
+        ((DeferredRenderer*)deferredRenderer)->renderIdentifiers(frame);
+        pickedIdentifier = ((DeferredRenderer*)deferredRenderer)->getClickedIdentifier(frame.mouseX, h - frame.mouseY);
+        pickPending = true;
+    }
+}
+
+void OpenGLWidget::stopRendering()
+{
+    if (renderThread != nullptr)
+    {
+        renderThread->stop();
+        delete renderThread;
+        renderThread = nullptr;
     }
 }
 
 void OpenGLWidget::finalizeGL()
 {
+    stopRendering();
     makeCurrent();
 
     forwardRenderer->finalize();
@@ -186,6 +267,7 @@ void OpenGLWidget::handleLoggedMessage(const QOpenGLDebugMessage &debugMessage)
 
 QString OpenGLWidget::getOpenGLInfo()
 {
+    if (renderThread != nullptr) { renderThread->finishFrame(); }
     makeCurrent();
 
     QString info;
@@ -233,6 +315,7 @@ QString OpenGLWidget::getOpenGLInfo()
 
 QImage OpenGLWidget::getScreenshot()
 {
+    if (renderThread != nullptr) { renderThread->finishFrame(); }
     makeCurrent();
     return grabFramebuffer();
 }
@@ -240,7 +323,6 @@ QImage OpenGLWidget::getScreenshot()
 
 void OpenGLWidget::setRenderer(QString renderType){
 
-
     if(renderType == "Forward renderer")
         renderer = forwardRenderer;
     else if(renderType == "Deferred renderer")
@@ -264,6 +346,7 @@ QVector<QString> OpenGLWidget::getTextureNames()
 
 void OpenGLWidget::showTextureWithName(QString textureName)
 {
+    if (renderThread != nullptr) { renderThread->finishFrame(); }
     renderer->showTexture(textureName);
 }
 void OpenGLWidget::frame()
@@ -271,11 +354,17 @@ void OpenGLWidget::frame()
     static int framesSinceLastInteraction = 0;
     bool didInteraction = interaction->update();
     if (didInteraction) { framesSinceLastInteraction = 0; }
-    if (framesSinceLastInteraction < 5)
+    if (framesSinceLastInteraction < 5 || resourceManager->isLoading() || frameRequested)
     {
-        update();
+        frameRequested = false;
+        renderFrame();
     }
     framesSinceLastInteraction++;
     input->postUpdate();
     interaction->postUpdate();
 }
+
+void OpenGLWidget::requestFrame()
+{
+    frameRequested = true;
+}
@@ -11,6 +11,8 @@ class Camera;
 class Interaction;
 class Selection;
 class Renderer;
+class RenderThread;
+class FrameSnapshot;
 
 class OpenGLWidget :
         public QOpenGLWidget,
@@ -24,7 +26,9 @@ public:
     // Virtual OpenGL methods
     void initializeGL() override;
     void resizeGL(int w, int h) override;
-    void paintGL() override;
+
+    // The frames are drawn by the render thread, the widget is only composed
+    void paintEvent(QPaintEvent *event) override;
 
     // Virtual event methods
     void keyPressEvent(QKeyEvent *event) override;
@@ -46,6 +50,12 @@ public:
     QVector<QString> getTextureNames();
     void showTextureWithName(QString textureName);
 
+    // Called by the render thread with the context current
+    void renderSnapshot(const FrameSnapshot &frame);
+
+    // Finishes the frame in flight and ends the render thread
+    void stopRendering();
+
 signals:
 
     void interacted();
@@ -54,13 +64,17 @@ public slots:
 
     // Not virtual
     void frame();
+    void requestFrame(); // Drawn in the next frame()
     void finalizeGL();
 
     void handleLoggedMessage(const QOpenGLDebugMessage &debugMessage);
 
 private:
 
+    void renderFrame();
+
     QTimer timer;
+    bool frameRequested = true;
 
     Input *input = nullptr;
     Camera *camera = nullptr;
@@ -70,6 +84,17 @@ private:
     Renderer *deferredRenderer = nullptr;
     Renderer *renderer = nullptr;
 
+    RenderThread *renderThread = nullptr;
+
+    // Widget framebuffer in device pixels (set by resizeGL)
+    int framebufferWidth = 0;
+    int framebufferHeight = 0;
+
+    // Written by the render thread, read once it is idle
+    int renderWidth = 0; // Size the renderers were resized to
+    int renderHeight = 0;
+    bool pickPending = false; // Identifier clicked in the last frame
+    unsigned int pickedIdentifier = 0;
 
 };
 
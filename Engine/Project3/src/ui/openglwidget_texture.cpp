@@ -2,6 +2,7 @@
 #include <QVector3D>
 #include <iostream>
 #include "resources/texture.h"
+#include "resources/texturearray.h"
 #include "resources/resourcemanager.h"
 #include "globals.h"
 #include <QVector3D>
@@ -19,7 +20,7 @@ OpenGLWidgetTexture::~OpenGLWidgetTexture()
 
 void OpenGLWidgetTexture::setTexture(Texture *t)
 {
-    texture = t;
+    texture = resourceManager->textures().handle(t);
     update();
 }
 
@@ -68,15 +69,13 @@ void OpenGLWidgetTexture::initializeGL()
 
 void OpenGLWidgetTexture::paintGL()
 {
-    resourceManager->updateResources();
-
     glClearDepth(1.0);
     glClearColor(0.15f, 0.15f, 0.15f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
     glDisable(GL_DEPTH_TEST);
 
-    Texture *tex = texture;
-    if (tex == nullptr) {
+    Texture *tex = resourceManager->textures().get(texture);
+    if (tex == nullptr || !tex->isReady()) {
         tex = resourceManager->texWhite;
     }
 
@@ -100,8 +99,12 @@ void OpenGLWidgetTexture::paintGL()
         program.setUniformValue("scale", scale);
 
         const int textureUnit = 0;
-        tex->bind(textureUnit);
+        const int arrayUnit = 1;
+        TextureArray::resetBindings();
+        const int layer = Texture::bindMaterialTexture(tex, arrayUnit, textureUnit);
         program.setUniformValue("colorMap", textureUnit);
+        program.setUniformValue("colorMapArray", arrayUnit);
+        program.setUniformValue("colorMapLayer", layer);
 
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
@@ -6,6 +6,7 @@
 #include <QOpenGLBuffer>
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLShaderProgram>
+#include "resources/resourcepool.h"
 
 class Texture;
 
@@ -28,7 +29,7 @@ public:
 
 private:
 
-    Texture *texture = nullptr;
+    ResourceHandle<Texture> texture; // Null once the texture is removed
     QOpenGLShaderProgram program;
     QOpenGLVertexArrayObject vao;
     QOpenGLBuffer vbo;
@@ -46,7 +46,7 @@ void ResourcesWidget::addResource()
         if (path.endsWith(".png") || path.endsWith(".jpg"))
         {
             Texture *tex = resourceManager->createTexture();
-            tex->name = path;
+            resourceManager->rename(tex, path);
             tex->loadTexture(path.toLatin1());
             res = tex;
         }
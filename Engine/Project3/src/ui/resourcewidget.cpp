@@ -1,6 +1,8 @@
 #include "ui/resourcewidget.h"
 #include "ui_resourcewidget.h"
 #include "resources/resource.h"
+#include "resources/resourcemanager.h"
+#include "globals.h"
 
 ResourceWidget::ResourceWidget(QWidget *parent) :
     QWidget(parent),
@@ -29,7 +31,7 @@ void ResourceWidget::setResource(Resource *r)
 
 void ResourceWidget::onReturnPressed()
 {
-    resource->name = ui->nameText->text();
+    resourceManager->rename(resource, ui->nameText->text());
     ui->nameText->clearFocus();
     emit resourceChanged(resource);
 }
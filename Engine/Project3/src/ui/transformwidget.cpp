@@ -59,17 +59,17 @@ void TransformWidget::onValueChanged(double)
     float tx = ui->spinTx->value();
     float ty = ui->spinTy->value();
     float tz = ui->spinTz->value();
-    transform->position = QVector3D(tx, ty, tz);
+    transform->setPosition(QVector3D(tx, ty, tz));
 
     float rx = ui->spinRx->value(); // pitch
     float ry = ui->spinRy->value(); // yaw
     float rz = ui->spinRz->value(); // roll
-    transform->rotation = QQuaternion::fromEulerAngles(rx, ry, rz);
+    transform->setRotation(QQuaternion::fromEulerAngles(rx, ry, rz));
 
     float sx = ui->spinSx->value();
     float sy = ui->spinSy->value();
     float sz = ui->spinSz->value();
-    transform->scale = QVector3D(sx, sy, sz);
+    transform->setScale(QVector3D(sx, sy, sz));
 
     emit componentChanged(transform);
 }
@@ -0,0 +1,102 @@
+#include "util/hash.h"
+#include <cstring>
+
+
+static const quint64 PRIME1 = 11400714785074694791ULL;
+static const quint64 PRIME2 = 14029467366897019727ULL;
+static const quint64 PRIME3 =  1609587929392839161ULL;
+static const quint64 PRIME4 =  9650029242287828579ULL;
+static const quint64 PRIME5 =  2870177450012600261ULL;
+
+static inline quint64 rotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline quint64 read64(const unsigned char *p)
+{
+    quint64 v;
+    memcpy(&v, p, sizeof(v));
+    return v; // Little endian targets only
+}
+
+static inline quint32 read32(const unsigned char *p)
+{
+    quint32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline quint64 xxRound(quint64 acc, quint64 input)
+{
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline quint64 mergeRound(quint64 acc, quint64 val)
+{
+    acc ^= xxRound(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+quint64 hash64(const void *data, size_t size, quint64 seed)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    const unsigned char *end = p + size;
+    quint64 h;
+
+    if (size >= 32)
+    {
+        const unsigned char *limit = end - 32;
+        quint64 v1 = seed + PRIME1 + PRIME2;
+        quint64 v2 = seed + PRIME2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - PRIME1;
+        do
+        {
+            v1 = xxRound(v1, read64(p)); p += 8;
+            v2 = xxRound(v2, read64(p)); p += 8;
+            v3 = xxRound(v3, read64(p)); p += 8;
+            v4 = xxRound(v4, read64(p)); p += 8;
+        } while (p <= limit);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    }
+    else
+    {
+        h = seed + PRIME5;
+    }
+
+    h += quint64(size);
+
+    while (p + 8 <= end)
+    {
+        h ^= xxRound(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= end)
+    {
+        h ^= quint64(read32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < end)
+    {
+        h ^= (*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,16 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+// 64-bit non-cryptographic content hash (XXH64), fast enough to hash
+// whole files and pixel buffers on load
+quint64 hash64(const void *data, size_t size, quint64 seed = 0);
+
+inline quint64 hash64(const QByteArray &data, quint64 seed = 0)
+{
+    return hash64(data.constData(), size_t(data.size()), seed);
+}
+
+#endif // HASH_H
@@ -0,0 +1,216 @@
+#include "util/hdrconverter.h"
+#include "globals.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HDRCONVERTER_SSE
+#include <emmintrin.h>
+#endif
+// AVX2 does not imply F16C, the compiler only allows it when enabled
+#if defined(__F16C__)
+#define HDRCONVERTER_F16C
+#include <immintrin.h>
+#endif
+
+
+// Splits [0, count) in ranges of a multiple of 8 elements for the job system
+template <typename Function>
+static void parallelRanges(int count, Function function)
+{
+    jobSystem->parallelFor("HDR conversion", count, 65536, function);
+}
+
+
+// RGB9E5 //////////////////////////////////////////////////////////////
+
+static const int RGB9E5_MANTISSA_BITS = 9;
+static const int RGB9E5_EXPONENT_BIAS = 15;
+static const float RGB9E5_MAX = 65408.0f; // (2^9 - 1) / 2^9 * 2^16
+
+static inline int floorLog2(float f)
+{
+    quint32 x;
+    memcpy(&x, &f, sizeof(x));
+    return int((x >> 23) & 0xff) - 127;
+}
+
+// As in the EXT_texture_shared_exponent specification
+static quint32 packRgb9e5(float r, float g, float b)
+{
+    const float rc = (r > 0.0f) ? qMin(r, RGB9E5_MAX) : 0.0f; // Also catches NaN
+    const float gc = (g > 0.0f) ? qMin(g, RGB9E5_MAX) : 0.0f;
+    const float bc = (b > 0.0f) ? qMin(b, RGB9E5_MAX) : 0.0f;
+    const float maxrgb = qMax(rc, qMax(gc, bc));
+
+    int exponent = qMax(-RGB9E5_EXPONENT_BIAS - 1, floorLog2(maxrgb)) + 1 + RGB9E5_EXPONENT_BIAS;
+    float scale = std::ldexp(1.0f, RGB9E5_EXPONENT_BIAS + RGB9E5_MANTISSA_BITS - exponent);
+    if (int(maxrgb * scale + 0.5f) == (1 << RGB9E5_MANTISSA_BITS))
+    {
+        exponent++;
+        scale *= 0.5f;
+    }
+
+    const quint32 rs = quint32(rc * scale + 0.5f);
+    const quint32 gs = quint32(gc * scale + 0.5f);
+    const quint32 bs = quint32(bc * scale + 0.5f);
+    return rs | (gs << 9) | (bs << 18) | (quint32(exponent) << 27);
+}
+
+#ifdef HDRCONVERTER_SSE
+static inline __m128i maxEpi32(__m128i a, __m128i b)
+{
+    const __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+
+// Same as packRgb9e5 for four pixels
+static inline __m128i packRgb9e5(__m128 r, __m128 g, __m128 b)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 maxValue = _mm_set1_ps(RGB9E5_MAX);
+    const __m128 half = _mm_set1_ps(0.5f);
+
+    // _mm_max_ps returns the second operand for NaN
+    r = _mm_min_ps(_mm_max_ps(r, zero), maxValue);
+    g = _mm_min_ps(_mm_max_ps(g, zero), maxValue);
+    b = _mm_min_ps(_mm_max_ps(b, zero), maxValue);
+    const __m128 maxrgb = _mm_max_ps(r, _mm_max_ps(g, b));
+
+    const __m128i biasedLog2 = _mm_and_si128(_mm_srli_epi32(_mm_castps_si128(maxrgb), 23), _mm_set1_epi32(0xff));
+    const __m128i log2 = _mm_sub_epi32(biasedLog2, _mm_set1_epi32(127));
+    __m128i exponent = _mm_add_epi32(maxEpi32(log2, _mm_set1_epi32(-RGB9E5_EXPONENT_BIAS - 1)),
+                                     _mm_set1_epi32(1 + RGB9E5_EXPONENT_BIAS));
+
+    // 2^(B + N - exponent) built from its exponent bits
+    const __m128i scaleExponent = _mm_sub_epi32(_mm_set1_epi32(RGB9E5_EXPONENT_BIAS + RGB9E5_MANTISSA_BITS + 127), exponent);
+    __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(scaleExponent, 23));
+
+    const __m128i maxMantissa = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(maxrgb, scale), half));
+    const __m128i overflow = _mm_cmpeq_epi32(maxMantissa, _mm_set1_epi32(1 << RGB9E5_MANTISSA_BITS));
+    exponent = _mm_sub_epi32(exponent, overflow); // overflow is -1 where true
+    scale = _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(overflow), _mm_mul_ps(scale, half)),
+                      _mm_andnot_ps(_mm_castsi128_ps(overflow), scale));
+
+    const __m128i rs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), half));
+    const __m128i gs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, scale), half));
+    const __m128i bs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, scale), half));
+    return _mm_or_si128(_mm_or_si128(rs, _mm_slli_epi32(gs, 9)),
+                        _mm_or_si128(_mm_slli_epi32(bs, 18), _mm_slli_epi32(exponent, 27)));
+}
+#endif
+
+QByteArray HdrConverter::toRgb9e5(const float *rgb, int pixelCount)
+{
+    QByteArray packed(pixelCount * int(sizeof(quint32)), Qt::Uninitialized);
+    quint32 *out = reinterpret_cast<quint32 *>(packed.data());
+
+    parallelRanges(pixelCount, [rgb, out](int begin, int end)
+    {
+        int i = begin;
+#ifdef HDRCONVERTER_SSE
+        for (; i + 4 <= end; i += 4)
+        {
+            const float *p = rgb + i * 3;
+            const __m128 r = _mm_setr_ps(p[0], p[3], p[6], p[9]);
+            const __m128 g = _mm_setr_ps(p[1], p[4], p[7], p[10]);
+            const __m128 b = _mm_setr_ps(p[2], p[5], p[8], p[11]);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), packRgb9e5(r, g, b));
+        }
+#endif
+        for (; i < end; ++i)
+        {
+            out[i] = packRgb9e5(rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2]);
+        }
+    });
+
+    return packed;
+}
+
+
+// Half floats /////////////////////////////////////////////////////////
+
+static quint16 floatToHalf(float f)
+{
+    quint32 x;
+    memcpy(&x, &f, sizeof(x));
+    const quint16 sign = quint16((x >> 16) & 0x8000);
+    const int exponent = int((x >> 23) & 0xff) - 127 + 15;
+    quint32 mantissa = x & 0x7fffff;
+
+    if (((x >> 23) & 0xff) == 0xff) return sign | (mantissa ? 0x7e00 : 0x7c00); // NaN and infinity
+    if (exponent >= 31) return sign | 0x7c00;
+    if (exponent <= 0)
+    {
+        if (exponent < -10) return sign;
+        mantissa |= 0x800000;
+        const int shift = 14 - exponent;
+        quint32 half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half++;
+        return sign | quint16(half);
+    }
+    quint32 half = quint32(exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) half++; // It carries into the exponent when needed
+    return sign | quint16(half);
+}
+
+#ifdef HDRCONVERTER_SSE
+// Same as floatToHalf for four values, when all of them are normal half
+// floats (the others are rare, the caller converts them one by one)
+static inline bool floatsToHalves(const float *values, quint16 *out)
+{
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values));
+    const __m128i magnitude = _mm_and_si128(x, _mm_set1_epi32(0x7fffffff));
+    const __m128i normal = _mm_andnot_si128(_mm_cmplt_epi32(magnitude, _mm_set1_epi32(113 << 23)),
+                                            _mm_cmplt_epi32(magnitude, _mm_set1_epi32(143 << 23)));
+    if (_mm_movemask_ps(_mm_castsi128_ps(normal)) != 0xf)
+    {
+        return false;
+    }
+
+    // Rebiased exponent and mantissa, rounded (it carries into the exponent when needed)
+    const __m128i half = _mm_srli_epi32(_mm_add_epi32(_mm_sub_epi32(magnitude, _mm_set1_epi32(112 << 23)), _mm_set1_epi32(0x1000)), 13);
+    const __m128i sign = _mm_and_si128(_mm_srli_epi32(x, 16), _mm_set1_epi32(0x8000));
+
+    // The pack saturates signed values, so they are offset around it
+    const __m128i packed = _mm_packs_epi32(_mm_sub_epi32(_mm_or_si128(half, sign), _mm_set1_epi32(0x8000)), _mm_setzero_si128());
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(out), _mm_xor_si128(packed, _mm_set1_epi16(short(0x8000))));
+    return true;
+}
+#endif
+
+QByteArray HdrConverter::toHalf(const float *values, int valueCount)
+{
+    QByteArray packed(valueCount * int(sizeof(quint16)), Qt::Uninitialized);
+    quint16 *out = reinterpret_cast<quint16 *>(packed.data());
+
+    parallelRanges(valueCount, [values, out](int begin, int end)
+    {
+        int i = begin;
+#ifdef HDRCONVERTER_F16C
+        for (; i + 8 <= end; i += 8)
+        {
+            const __m256 v = _mm256_loadu_ps(values + i);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+        }
+#endif
+#ifdef HDRCONVERTER_SSE
+        for (; i + 4 <= end; i += 4)
+        {
+            if (!floatsToHalves(values + i, out + i))
+            {
+                for (int j = i; j < i + 4; ++j)
+                {
+                    out[j] = floatToHalf(values[j]);
+                }
+            }
+        }
+#endif
+        for (; i < end; ++i)
+        {
+            out[i] = floatToHalf(values[i]);
+        }
+    });
+
+    return packed;
+}
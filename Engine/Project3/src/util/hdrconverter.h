@@ -0,0 +1,21 @@
+#ifndef HDRCONVERTER_H
+#define HDRCONVERTER_H
+
+#include <QByteArray>
+
+// Packs the RGB float pixels of HDR images into the compact formats sampled
+// by the shaders. The pixels are split in ranges converted in parallel.
+class HdrConverter
+{
+public:
+
+    // Shared exponent pixels (GL_RGB9_E5, GL_UNSIGNED_INT_5_9_9_9_REV),
+    // negative values are clamped to zero. Four pixels at a time with SSE2.
+    static QByteArray toRgb9e5(const float *rgb, int pixelCount);
+
+    // Half floats (GL_HALF_FLOAT), eight values at a time with F16C and
+    // four with SSE2 otherwise
+    static QByteArray toHalf(const float *values, int valueCount);
+};
+
+#endif // HDRCONVERTER_H
@@ -0,0 +1,292 @@
+#include "util/jobsystem.h"
+#include "util/profiler.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThread>
+#include <deque>
+
+
+// Deque of the current thread (0 for threads that are not workers)
+static thread_local int currentQueue = 0;
+
+
+JobCounter::~JobCounter()
+{
+    // A worker may still be releasing the mutex after the last decrement
+    QMutexLocker locker(&mutex);
+}
+
+
+struct JobSystem::Queue
+{
+    QMutex mutex;
+    std::deque<Job> jobs;
+};
+
+class JobSystem::Worker : public QThread
+{
+public:
+
+    Worker(JobSystem *s, int index) : system(s), queueIndex(index) { }
+
+    void run() override { system->workerLoop(queueIndex); }
+
+private:
+
+    JobSystem *system;
+    int queueIndex;
+};
+
+
+JobSystem::JobSystem(int threadCount)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = qMax(1, QThread::idealThreadCount());
+    }
+
+    queues.push_back(new Queue);
+    for (int i = 1; i < threadCount; ++i)
+    {
+        queues.push_back(new Queue);
+        workers.push_back(new Worker(this, i));
+    }
+    for (auto worker : workers)
+    {
+        worker->start();
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    quitting.storeRelease(1);
+    {
+        QMutexLocker locker(&sleepMutex);
+        wakeUp.wakeAll();
+    }
+    for (auto worker : workers)
+    {
+        worker->wait();
+        delete worker;
+    }
+    for (auto queue : queues)
+    {
+        delete queue;
+    }
+}
+
+void JobSystem::run(const char *name, std::function<void()> function, JobCounter *counter)
+{
+    if (counter != nullptr)
+    {
+        counter->pending.ref();
+    }
+
+    Job job;
+    job.name = name;
+    job.function = std::move(function);
+    job.counter = counter;
+    job.capture = Profiler::current();
+    push(std::move(job));
+}
+
+void JobSystem::then(JobCounter &dependency, const char *name, std::function<void()> function, JobCounter *counter)
+{
+    if (counter != nullptr)
+    {
+        counter->pending.ref();
+    }
+
+    Job job;
+    job.name = name;
+    job.function = std::move(function);
+    job.counter = counter;
+    job.capture = Profiler::current();
+    {
+        QMutexLocker locker(&dependency.mutex);
+        if (!dependency.isDone())
+        {
+            dependency.continuations.push_back(std::move(job));
+            return;
+        }
+    }
+    push(std::move(job));
+}
+
+void JobSystem::parallelFor(const char *name, int count, int grainSize, std::function<void(int, int)> function, JobCounter *counter)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    grainSize = qMax(1, grainSize);
+
+    // A single range runs right here
+    if (counter == nullptr && count <= grainSize)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        function(0, count);
+        Profiler::recordJob(name, timer.nsecsElapsed());
+        return;
+    }
+
+    JobCounter done;
+    JobCounter *rangesCounter = counter != nullptr ? counter : &done;
+    for (int begin = 0; begin < count; begin += grainSize)
+    {
+        const int end = qMin(count, begin + grainSize);
+        run(name, [function, begin, end]() { function(begin, end); }, rangesCounter);
+    }
+
+    if (counter == nullptr)
+    {
+        wait(done);
+    }
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+    // Without workers nothing else would run the jobs it depends on
+    const JobCounter *only = workers.isEmpty() ? nullptr : &counter;
+    while (!counter.isDone())
+    {
+        if (runOne(only))
+        {
+            continue;
+        }
+
+        QMutexLocker locker(&counter.mutex);
+        if (!counter.isDone() && counter.queued.loadAcquire() == 0 && (only != nullptr || queuedJobs.loadAcquire() == 0))
+        {
+            counter.changed.wait(&counter.mutex);
+        }
+    }
+}
+
+void JobSystem::push(Job &&job)
+{
+    // Threads waiting for the counter are woken before the job can be taken
+    // (once it finishes the counter may no longer exist)
+    if (job.counter != nullptr)
+    {
+        job.counter->queued.ref();
+        QMutexLocker locker(&job.counter->mutex);
+        job.counter->changed.wakeAll();
+    }
+
+    Queue *queue = queues[currentQueue];
+    {
+        QMutexLocker locker(&queue->mutex);
+        queue->jobs.push_back(std::move(job));
+    }
+    queuedJobs.ref();
+
+    QMutexLocker locker(&sleepMutex);
+    wakeUp.wakeOne();
+}
+
+bool JobSystem::runOne(const JobCounter *only)
+{
+    Job job;
+    if (!take(job, only))
+    {
+        return false;
+    }
+    execute(job);
+    return true;
+}
+
+bool JobSystem::take(Job &job, const JobCounter *only)
+{
+    auto taken = [this, &job](std::deque<Job> &jobs, std::deque<Job>::iterator it) {
+        job = std::move(*it);
+        jobs.erase(it);
+        queuedJobs.deref();
+        if (job.counter != nullptr)
+        {
+            job.counter->queued.deref();
+        }
+        return true;
+    };
+
+    // Newest job of the own deque (its data is likely still in the cache)
+    Queue *own = queues[currentQueue];
+    {
+        QMutexLocker locker(&own->mutex);
+        for (auto it = own->jobs.end(); it != own->jobs.begin(); )
+        {
+            --it;
+            if (only == nullptr || it->counter == only)
+            {
+                return taken(own->jobs, it);
+            }
+        }
+    }
+
+    // Oldest job of another deque
+    for (int i = 1; i < queues.size(); ++i)
+    {
+        Queue *victim = queues[(currentQueue + i) % queues.size()];
+        QMutexLocker locker(&victim->mutex);
+        for (auto it = victim->jobs.begin(); it != victim->jobs.end(); ++it)
+        {
+            if (only == nullptr || it->counter == only)
+            {
+                return taken(victim->jobs, it);
+            }
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(Job &job)
+{
+    QElapsedTimer timer;
+    timer.start();
+    ProfilerCapturePtr previous = Profiler::setCurrent(job.capture);
+    job.function();
+    Profiler::recordJob(job.name, timer.nsecsElapsed());
+    Profiler::setCurrent(previous);
+    finish(job.counter);
+}
+
+void JobSystem::finish(JobCounter *counter)
+{
+    if (counter == nullptr)
+    {
+        return;
+    }
+
+    QVector<Job> ready;
+    {
+        QMutexLocker locker(&counter->mutex);
+        if (!counter->pending.deref())
+        {
+            ready.swap(counter->continuations);
+            counter->changed.wakeAll();
+        }
+    }
+    for (Job &job : ready)
+    {
+        push(std::move(job));
+    }
+}
+
+void JobSystem::workerLoop(int queueIndex)
+{
+    currentQueue = queueIndex;
+    while (!quitting.loadAcquire())
+    {
+        if (runOne())
+        {
+            continue;
+        }
+
+        QMutexLocker locker(&sleepMutex);
+        if (queuedJobs.loadAcquire() == 0 && !quitting.loadAcquire())
+        {
+            wakeUp.wait(&sleepMutex);
+        }
+    }
+}
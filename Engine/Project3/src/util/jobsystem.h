@@ -0,0 +1,100 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include "util/profiler.h"
+#include <QAtomicInt>
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+#include <functional>
+
+class JobCounter;
+
+struct Job
+{
+    const char *name = nullptr; // Jobs of the same name are profiled together
+    std::function<void()> function;
+    JobCounter *counter = nullptr;
+    ProfilerCapturePtr capture; // Of the thread that queued it, gets its time
+};
+
+// Number of jobs still running. Jobs given a counter increment it when they
+// are queued and decrement it when they finish. Continuations (see
+// JobSystem::then) are queued once it reaches zero. Threads waiting for it
+// sleep on it while none of its jobs is queued.
+class JobCounter
+{
+public:
+
+    JobCounter() { }
+    ~JobCounter();
+
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    bool isDone() const { return pending.loadAcquire() == 0; }
+
+private:
+
+    QAtomicInt pending;
+    QAtomicInt queued; // Jobs of the counter in the deques
+    QMutex mutex; // Protects the continuations (and the last decrement)
+    QWaitCondition changed; // Reached zero or one of its jobs was queued
+    QVector<Job> continuations;
+
+    friend class JobSystem;
+};
+
+// Worker threads (one less than the cores, the thread that waits runs jobs
+// too) with a deque each. A worker takes the newest job of its own deque
+// and, if it is empty, steals the oldest one of another deque. Threads that
+// are not workers queue into a shared deque. A thread that waits for a
+// counter only runs the jobs of that counter, so it is never held up by a
+// long background job (as a texture decode), which only workers run.
+class JobSystem
+{
+public:
+
+    explicit JobSystem(int threadCount = 0); // 0 = number of cores
+    ~JobSystem();
+
+    int threadCount() const { return workers.size() + 1; }
+
+    void run(const char *name, std::function<void()> function, JobCounter *counter = nullptr);
+
+    // Queues the job once the dependency reaches zero (now if it is zero)
+    void then(JobCounter &dependency, const char *name, std::function<void()> function, JobCounter *counter = nullptr);
+
+    // Calls function(begin, end) for ranges of about grainSize items that
+    // cover [0, count). It returns when they are done unless it is given a
+    // counter (the function and what it references must outlive the jobs).
+    void parallelFor(const char *name, int count, int grainSize, std::function<void(int, int)> function, JobCounter *counter = nullptr);
+
+    // Runs the queued jobs of the counter until it reaches zero, and sleeps
+    // while there are none (they are running in other threads)
+    void wait(JobCounter &counter);
+
+private:
+
+    struct Queue;
+    class Worker;
+
+    // With a counter only its jobs are taken (any if there are no workers)
+    void push(Job &&job);
+    bool runOne(const JobCounter *only = nullptr);
+    bool take(Job &job, const JobCounter *only);
+    void execute(Job &job);
+    void finish(JobCounter *counter);
+    void workerLoop(int queueIndex);
+
+    QVector<Queue*> queues; // The shared one first, then one per worker
+    QVector<Worker*> workers;
+
+    // Idle workers sleep until a job is queued
+    QAtomicInt queuedJobs;
+    QMutex sleepMutex;
+    QWaitCondition wakeUp;
+    QAtomicInt quitting;
+};
+
+#endif // JOBSYSTEM_H
@@ -1,4 +1,6 @@
 #include "util/modelimporter.h"
+#include "util/objloader.h"
+#include "util/profiler.h"
 #include "resources/resourcemanager.h"
 #include "resources/mesh.h"
 #include "resources/material.h"
@@ -7,12 +9,24 @@
 #include "globals.h"
 #include <QFile>
 #include <QFileInfo>
+#include <QElapsedTimer>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <iostream>
 
 
+// Geometry of one aiMesh converted by a worker thread
+struct ImportedSubMesh
+{
+    const aiMesh *mesh = nullptr;
+    VertexFormat vertexFormat;
+    QByteArray vertices;
+    QVector<unsigned int> indices;
+    QVector<Meshlet> meshlets;
+};
+
+
 ModelImporter::ModelImporter()
 {
 
@@ -25,6 +39,14 @@ ModelImporter::~ModelImporter()
 
 Entity* ModelImporter::import(const QString &path)
 {
+    // The timings of the import (also of its jobs) are kept apart from the rest
+    PROFILE_CAPTURE(QFileInfo(path).fileName());
+
+    if (QFileInfo(path).suffix().toLower() == "obj")
+    {
+        return importObj(path);
+    }
+
     Assimp::Importer import;
 
     QFile file(path);
@@ -35,28 +57,32 @@ Entity* ModelImporter::import(const QString &path)
 
     QFileInfo fileInfo(file);
 
+    const aiScene *scene = nullptr;
+    {
+        PROFILE_SCOPE("Assimp read");
 #if 0
-    QByteArray data = file.readAll();
-
-    const aiScene *scene = import.ReadFileFromMemory(
-                data.data(), data.size(),
-                aiProcess_Triangulate |
-                aiProcess_GenSmoothNormals |
-                aiProcess_OptimizeMeshes |
-                aiProcess_PreTransformVertices |
-                aiProcess_ImproveCacheLocality |
-                aiProcess_CalcTangentSpace,
-                fileInfo.suffix().toLatin1());
+        QByteArray data = file.readAll();
+
+        scene = import.ReadFileFromMemory(
+                    data.data(), data.size(),
+                    aiProcess_Triangulate |
+                    aiProcess_GenSmoothNormals |
+                    aiProcess_OptimizeMeshes |
+                    aiProcess_ImproveCacheLocality |
+                    aiProcess_CalcTangentSpace,
+                    fileInfo.suffix().toLatin1());
 #else
-    const aiScene *scene = import.ReadFile(
-                path.toStdString(),
-                aiProcess_Triangulate |
-                aiProcess_GenSmoothNormals |
-                aiProcess_OptimizeMeshes |
-                aiProcess_PreTransformVertices |
-                aiProcess_ImproveCacheLocality |
-                aiProcess_CalcTangentSpace);
+        // The node graph is kept (no aiProcess_PreTransformVertices), so
+        // meshes instanced by several nodes are stored once
+        scene = import.ReadFile(
+                    path.toStdString(),
+                    aiProcess_Triangulate |
+                    aiProcess_GenSmoothNormals |
+                    aiProcess_OptimizeMeshes |
+                    aiProcess_ImproveCacheLocality |
+                    aiProcess_CalcTangentSpace);
 #endif
+    }
 
     // Other flags
     // - aiProcess_JoinIdenticalVertices
@@ -73,76 +99,168 @@ Entity* ModelImporter::import(const QString &path)
     // Used to find material files
     directory = fileInfo.path();
 
+    // Convert the meshes in worker threads (textures decode in the background)
+    QVector<ImportedSubMesh> submeshes(int(scene->mNumMeshes));
+    for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+    {
+        submeshes[int(i)].mesh = scene->mMeshes[i];
+    }
+    QElapsedTimer conversionTimer;
+    conversionTimer.start();
+    JobCounter conversion;
+    jobSystem->parallelFor("Mesh conversion", submeshes.size(), 1, [&submeshes](int begin, int end) {
+        for (int i = begin; i < end; ++i) processMesh(submeshes[i]);
+    }, &conversion);
+
+    // The conversion time is taken when the last mesh is done
+    JobCounter converted;
+    jobSystem->then(conversion, "Mesh conversion end", [conversionTimer]() {
+        Profiler::record("Mesh conversion", conversionTimer.nsecsElapsed());
+    }, &converted);
+
     // Create a list of materials
     QVector<Material*> myMaterials(scene->mNumMaterials, nullptr);
-    QVector<Material*> mySubmeshMaterials(1024, nullptr);
+    QVector<QString> texturePaths;
+    QVector<Texture**> textureSlots;
+    QVector<TextureUsage> textureUsages;
     for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
     {
         myMaterials[i] = resourceManager->createMaterial();
-        processMaterial(scene->mMaterials[i], myMaterials[i]);
+        processMaterial(scene->mMaterials[i], myMaterials[i], texturePaths, textureSlots, textureUsages);
     }
 
-    // Create the mesh and process the submeshes read by Assimp
-    Mesh *myMesh = resourceManager->createMesh();
-    myMesh->name = fileInfo.baseName();
-    myMesh->filePath = fileInfo.filePath();
-    processNode(scene->mRootNode, scene, myMesh, &myMaterials[0], &mySubmeshMaterials[0]);
+    {
+        PROFILE_SCOPE("Texture requests");
+        QVector<Texture*> textures = resourceManager->loadTextures(texturePaths, textureUsages);
+        for (int i = 0; i < textures.size(); ++i)
+        {
+            *textureSlots[i] = textures[i];
+        }
+    }
 
-    // Create an entity showing the mesh
-    Entity *entity = ::scene->addEntity();
-    entity->name = fileInfo.baseName();
-    entity->addComponent(ComponentType::MeshRenderer);
-    entity->meshRenderer->mesh = myMesh;
-    for (int i = 0; i < myMesh->submeshes.size(); ++i)
+    // Identical materials (also from previous imports) share a single resource
+    for (auto &material : myMaterials)
+    {
+        material = resourceManager->shareMaterial(material);
+    }
+
+    for (auto material : myMaterials)
     {
-        entity->meshRenderer->materials.push_back(mySubmeshMaterials[i]);
+        material->referenceTextures();
+        material->createNormalFromBump();
+    }
+
+    // The conversion first, waiting only for the continuation would leave it to the workers
+    jobSystem->wait(conversion);
+    jobSystem->wait(converted);
+
+    // One mesh per aiMesh, shared by all the nodes that reference it
+    QVector<Mesh*> myMeshes(submeshes.size(), nullptr);
+    {
+        PROFILE_SCOPE("Submesh creation");
+        for (int i = 0; i < submeshes.size(); ++i)
+        {
+            ImportedSubMesh &submesh = submeshes[i];
+            myMeshes[i] = resourceManager->createMesh();
+            myMeshes[i]->name = submesh.mesh->mName.length > 0 ?
+                        QString::fromUtf8(submesh.mesh->mName.C_Str()) :
+                        QString::fromLatin1("%0_%1").arg(fileInfo.baseName()).arg(i);
+            myMeshes[i]->filePath = fileInfo.filePath();
+            myMeshes[i]->addSubMesh(submesh.vertexFormat, std::move(submesh.vertices), std::move(submesh.indices), std::move(submesh.meshlets));
+        }
+    }
+
+    // Create an entity per node
+    Entity *entity = nullptr;
+    {
+        PROFILE_SCOPE("Node entities");
+        entity = processNode(scene->mRootNode, nullptr, scene, myMeshes, myMaterials);
+        entity->name = fileInfo.baseName();
     }
 
     return entity;
 }
 
-void ModelImporter::loadMesh(Mesh *mesh, const QString &path)
+Entity *ModelImporter::importObj(const QString &path)
 {
-    Assimp::Importer import;
+    QFileInfo fileInfo(path);
 
-    QFile file(path);
-    if (!file.open(QIODevice::ReadOnly)) {
-        std::cout << "Could not open file for read: " << path.toStdString() << std::endl;
-        return;
+    ObjModel model;
+    if (!ObjLoader::load(path, model))
+    {
+        return nullptr;
     }
 
-    QFileInfo fileInfo(file);
-
+    // Create a list of materials
+    QVector<Material*> myMaterials(model.materials.size(), nullptr);
+    QVector<QString> texturePaths;
+    QVector<Texture**> textureSlots;
+    QVector<TextureUsage> textureUsages;
+    for (int i = 0; i < model.materials.size(); ++i)
+    {
+        const ObjMaterial &material = model.materials[i];
+        myMaterials[i] = resourceManager->createMaterial();
+        myMaterials[i]->name = material.name;
+        myMaterials[i]->albedo = material.albedo;
+        myMaterials[i]->emissive = material.emissive;
+        myMaterials[i]->smoothness = material.shininess / 256.0f;
+
+        const QString *maps[] = { &material.albedoMap, &material.emissiveMap, &material.specularMap, &material.normalsMap, &material.bumpMap };
+        Texture **slots[] = { &myMaterials[i]->albedoTexture, &myMaterials[i]->emissiveTexture, &myMaterials[i]->specularTexture, &myMaterials[i]->normalsTexture, &myMaterials[i]->bumpTexture };
+        const TextureUsage usages[] = { TextureUsage::Color, TextureUsage::Color, TextureUsage::Color, TextureUsage::Normals, TextureUsage::Bump };
+        for (int j = 0; j < 5; ++j)
+        {
+            if (!maps[j]->isEmpty())
+            {
+                texturePaths.push_back(*maps[j]);
+                textureSlots.push_back(slots[j]);
+                textureUsages.push_back(usages[j]);
+            }
+        }
+    }
 
-    const aiScene *scene = import.ReadFile(
-                path.toStdString(),
-                aiProcess_Triangulate |
-                aiProcess_GenSmoothNormals |
-                aiProcess_OptimizeMeshes |
-                aiProcess_PreTransformVertices |
-                aiProcess_ImproveCacheLocality |
-                aiProcess_CalcTangentSpace);
+    {
+        PROFILE_SCOPE("Texture requests");
+        QVector<Texture*> textures = resourceManager->loadTextures(texturePaths, textureUsages);
+        for (int i = 0; i < textures.size(); ++i)
+        {
+            *textureSlots[i] = textures[i];
+        }
+    }
 
-    // Other flags
-    // - aiProcess_JoinIdenticalVertices
-    // - aiProcess_SortByPType
-    // - aiProcess_RemoveRedundantMaterials
-    // - https://www.ics.com/blog/qt-and-opengl-loading-3d-model-open-asset-import-library-assimp
+    // Identical materials (also from previous imports) share a single resource
+    for (auto &material : myMaterials)
+    {
+        material = resourceManager->shareMaterial(material);
+    }
 
-    if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    for (auto material : myMaterials)
     {
-        std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
-        return;
+        material->referenceTextures();
+        material->createNormalFromBump();
     }
 
-    // Used to find material files
-    directory = fileInfo.path();
+    // Create the mesh and move the parsed submeshes into it
+    Mesh *myMesh = resourceManager->createMesh();
+    myMesh->name = fileInfo.baseName();
+    myMesh->filePath = fileInfo.filePath();
+
+    // Create an entity showing the mesh
+    Entity *entity = ::scene->addEntity();
+    entity->name = fileInfo.baseName();
+    entity->addComponent(ComponentType::MeshRenderer);
+    entity->meshRenderer->mesh = myMesh;
+
+    for (ObjSubMesh &submesh : model.submeshes)
+    {
+        myMesh->addSubMesh(submesh.vertexFormat, std::move(submesh.vertices), std::move(submesh.indices), std::move(submesh.meshlets));
+        entity->meshRenderer->materials.push_back(submesh.materialIndex >= 0 ? myMaterials[submesh.materialIndex] : nullptr);
+    }
 
-    // Create the mesh and process the submeshes read by Assimp
-    processNode(scene->mRootNode, scene, mesh, nullptr, nullptr);
+    return entity;
 }
 
-void ModelImporter::processMaterial(aiMaterial *material, Material *myMaterial)
+void ModelImporter::processMaterial(aiMaterial *material, Material *myMaterial, QVector<QString> &texturePaths, QVector<Texture**> &textureSlots, QVector<TextureUsage> &textureUsages)
 {
     aiString name;
     aiColor3D diffuseColor;
@@ -160,88 +278,129 @@ void ModelImporter::processMaterial(aiMaterial *material, Material *myMaterial)
     myMaterial->emissive = QColor::fromRgbF(emissiveColor.r, emissiveColor.g, emissiveColor.b);
     myMaterial->smoothness = shininess / 256.0f;
 
+    // Texture paths are only gathered here, they get decoded in a batch later
+    const aiTextureType types[] = {
+        aiTextureType_DIFFUSE,
+        aiTextureType_EMISSIVE,
+        aiTextureType_SPECULAR,
+        aiTextureType_NORMALS,
+        aiTextureType_HEIGHT
+    };
+    Texture **slots[] = {
+        &myMaterial->albedoTexture,
+        &myMaterial->emissiveTexture,
+        &myMaterial->specularTexture,
+        &myMaterial->normalsTexture,
+        &myMaterial->bumpTexture
+    };
+    const TextureUsage usages[] = {
+        TextureUsage::Color,
+        TextureUsage::Color,
+        TextureUsage::Color,
+        TextureUsage::Normals,
+        TextureUsage::Bump
+    };
+
     aiString filename;
-    if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
-    {
-        material->GetTexture(aiTextureType_DIFFUSE, 0, &filename);
-        QString filepath = QString::fromLatin1("%0/%1").arg(directory.toLatin1().data()).arg(filename.C_Str());
-        myMaterial->albedoTexture = resourceManager->loadTexture(filepath);
-    }
-    if (material->GetTextureCount(aiTextureType_EMISSIVE) > 0)
-    {
-        material->GetTexture(aiTextureType_EMISSIVE, 0, &filename);
-        QString filepath = QString::fromLatin1("%0/%1").arg(directory.toLatin1().data()).arg(filename.C_Str());
-        myMaterial->emissiveTexture = resourceManager->loadTexture(filepath);
-    }
-    if (material->GetTextureCount(aiTextureType_SPECULAR) > 0)
-    {
-        material->GetTexture(aiTextureType_SPECULAR, 0, &filename);
-        QString filepath = QString::fromLatin1("%0/%1").arg(directory.toLatin1().data()).arg(filename.C_Str());
-        myMaterial->specularTexture = resourceManager->loadTexture(filepath);
-    }
-    if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
+    for (int i = 0; i < 5; ++i)
     {
-        material->GetTexture(aiTextureType_NORMALS, 0, &filename);
-        QString filepath = QString::fromLatin1("%0/%1").arg(directory.toLatin1().data()).arg(filename.C_Str());
-        myMaterial->normalsTexture = resourceManager->loadTexture(filepath);
-    }
-    if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
-    {
-        material->GetTexture(aiTextureType_HEIGHT, 0, &filename);
-        QString filepath = QString::fromLatin1("%0/%1").arg(directory.toLatin1().data()).arg(filename.C_Str());
-        myMaterial->bumpTexture = resourceManager->loadTexture(filepath);
+        if (material->GetTextureCount(types[i]) > 0)
+        {
+            material->GetTexture(types[i], 0, &filename);
+            QString filepath = QString::fromLatin1("%0/%1").arg(directory.toLatin1().data()).arg(filename.C_Str());
+            texturePaths.push_back(filepath);
+            textureSlots.push_back(slots[i]);
+            textureUsages.push_back(usages[i]);
+        }
     }
-
-    myMaterial->createNormalFromBump();
 }
 
-void ModelImporter::processNode(aiNode *node, const aiScene *scene, Mesh *myMesh, Material **myMaterials, Material **mySubmeshMaterials)
+Entity *ModelImporter::processNode(aiNode *node, Entity *parent, const aiScene *scene, const QVector<Mesh*> &meshes, const QVector<Material*> &materials)
 {
-    // process all the node's meshes (if any)
-    for(unsigned int i = 0; i < node->mNumMeshes; i++)
+    Entity *entity = ::scene->addEntity();
+    entity->name = QString::fromUtf8(node->mName.C_Str());
+    entity->setParent(parent);
+
+    aiVector3D scaling;
+    aiQuaternion rotation;
+    aiVector3D position;
+    node->mTransformation.Decompose(scaling, rotation, position);
+    entity->transform->setPosition(QVector3D(position.x, position.y, position.z));
+    entity->transform->setRotation(QQuaternion(rotation.w, rotation.x, rotation.y, rotation.z));
+    entity->transform->setScale(QVector3D(scaling.x, scaling.y, scaling.z));
+
+    // Nodes with several meshes get a child entity for each one
+    for (unsigned int i = 0; i < node->mNumMeshes; ++i)
     {
-        aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-        processMesh(mesh, scene, myMesh, myMaterials, mySubmeshMaterials);
+        Entity *meshEntity = entity;
+        if (node->mNumMeshes > 1)
+        {
+            meshEntity = ::scene->addEntity();
+            meshEntity->setParent(entity);
+        }
+
+        const int meshIndex = int(node->mMeshes[i]);
+        meshEntity->addComponent(ComponentType::MeshRenderer);
+        meshEntity->meshRenderer->mesh = meshes[meshIndex];
+        meshEntity->meshRenderer->materials.push_back(materials[int(scene->mMeshes[meshIndex]->mMaterialIndex)]);
+        if (meshEntity != entity)
+        {
+            meshEntity->name = meshes[meshIndex]->name;
+        }
     }
 
-    // then do the same for each of its children
-    for(unsigned int i = 0; i < node->mNumChildren; i++)
+    for (unsigned int i = 0; i < node->mNumChildren; ++i)
     {
-        processNode(node->mChildren[i], scene, myMesh, myMaterials, mySubmeshMaterials);
+        processNode(node->mChildren[i], entity, scene, meshes, materials);
     }
+
+    return entity;
 }
 
-void ModelImporter::processMesh(aiMesh *mesh, const aiScene *scene, Mesh *myMesh, Material **myMaterials, Material **mySubmeshMaterials)
+void ModelImporter::processMesh(ImportedSubMesh &submesh)
 {
-    QVector<float> vertices;
-    QVector<unsigned int> indices;
+    const aiMesh *mesh = submesh.mesh;
 
-    bool hasTexCoords = false;
-    bool hasTangentSpace = false;
+    const bool hasTexCoords = mesh->mTextureCoords[0] != nullptr;
+    const bool hasTangentSpace = mesh->mTangents != nullptr && mesh->mBitangents != nullptr;
+
+    // create the vertex format
+    VertexFormat &vertexFormat = submesh.vertexFormat;
+    vertexFormat.setVertexAttribute(0, 0, 3);
+    vertexFormat.setVertexAttribute(1, 3 * sizeof(float), 3);
+    if (hasTexCoords)
+    {
+        vertexFormat.setVertexAttribute(2, vertexFormat.size, 2);
+    }
+    if (hasTangentSpace)
+    {
+        vertexFormat.setVertexAttribute(3, vertexFormat.size, 3);
+        vertexFormat.setVertexAttribute(4, vertexFormat.size, 3);
+    }
 
-    // process vertices
+    // process vertices (the buffer is sized up front and written in place)
+    submesh.vertices.resize(int(mesh->mNumVertices) * vertexFormat.size);
+    float *vertex = reinterpret_cast<float*>(submesh.vertices.data());
     for(unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
-        vertices.push_back(mesh->mVertices[i].x);
-        vertices.push_back(mesh->mVertices[i].y);
-        vertices.push_back(mesh->mVertices[i].z);
-        vertices.push_back(mesh->mNormals[i].x);
-        vertices.push_back(mesh->mNormals[i].y);
-        vertices.push_back(mesh->mNormals[i].z);
-
-        if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+        *vertex++ = mesh->mVertices[i].x;
+        *vertex++ = mesh->mVertices[i].y;
+        *vertex++ = mesh->mVertices[i].z;
+        *vertex++ = mesh->mNormals[i].x;
+        *vertex++ = mesh->mNormals[i].y;
+        *vertex++ = mesh->mNormals[i].z;
+
+        if(hasTexCoords) // does the mesh contain texture coordinates?
         {
-            hasTexCoords = true;
-            vertices.push_back(mesh->mTextureCoords[0][i].x);
-            vertices.push_back(mesh->mTextureCoords[0][i].y);
+            *vertex++ = mesh->mTextureCoords[0][i].x;
+            *vertex++ = mesh->mTextureCoords[0][i].y;
         }
 
-        if(mesh->mTangents != nullptr && mesh->mBitangents)
+        if(hasTangentSpace)
         {
-            hasTangentSpace = true;
-            vertices.push_back(mesh->mTangents[i].x);
-            vertices.push_back(mesh->mTangents[i].y);
-            vertices.push_back(mesh->mTangents[i].z);
+            *vertex++ = mesh->mTangents[i].x;
+            *vertex++ = mesh->mTangents[i].y;
+            *vertex++ = mesh->mTangents[i].z;
 
             // For some reason ASSIMP gives me the bitangents flipped.
             // Maybe it's my fault, but when I generate my own geometry
@@ -251,45 +410,32 @@ void ModelImporter::processMesh(aiMesh *mesh, const aiScene *scene, Mesh *myMesh
             // I think that (even if the documentation says the opposite)
             // it returns a left-handed tangent space matrix.
             // SOLUTION: I invert the components of the bitangent here.
-            vertices.push_back(-mesh->mBitangents[i].x);
-            vertices.push_back(-mesh->mBitangents[i].y);
-            vertices.push_back(-mesh->mBitangents[i].z);
+            *vertex++ = -mesh->mBitangents[i].x;
+            *vertex++ = -mesh->mBitangents[i].y;
+            *vertex++ = -mesh->mBitangents[i].z;
         }
     }
 
     // process indices
+    int indexCount = 0;
     for(unsigned int i = 0; i < mesh->mNumFaces; i++)
     {
-        aiFace face = mesh->mFaces[i];
+        indexCount += int(mesh->mFaces[i].mNumIndices);
+    }
+    submesh.indices.resize(indexCount);
+    unsigned int *index = submesh.indices.data();
+    for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+    {
+        const aiFace &face = mesh->mFaces[i];
         for(unsigned int j = 0; j < face.mNumIndices; j++)
         {
-            indices.push_back(face.mIndices[j]);
+            *index++ = face.mIndices[j];
         }
     }
 
-    // store the proper (previously proceessed) material for this mesh
-    if(mesh->mMaterialIndex >= 0 && mySubmeshMaterials != nullptr && myMaterials != nullptr)
+    // split triangle lists into meshlets for culling (reorders the indices)
+    if (indexCount == int(mesh->mNumFaces) * 3)
     {
-        mySubmeshMaterials[myMesh->submeshes.size()] = myMaterials[mesh->mMaterialIndex];
+        submesh.meshlets = buildMeshlets(submesh.vertices, vertexFormat.size, submesh.indices);
     }
-
-    // create the vertex format
-    VertexFormat vertexFormat;
-    vertexFormat.setVertexAttribute(0, 0, 3);
-    vertexFormat.setVertexAttribute(1, 3 * sizeof(float), 3);
-    if (hasTexCoords)
-    {
-        vertexFormat.setVertexAttribute(2, 6 * sizeof(float), 2);
-    }
-    if (hasTangentSpace)
-    {
-        vertexFormat.setVertexAttribute(3, 8 * sizeof(float), 3);
-        vertexFormat.setVertexAttribute(4, 11 * sizeof(float), 3);
-    }
-
-    // add the submesh into the mesh
-    myMesh->addSubMesh(
-            vertexFormat,
-            &vertices[0], vertices.size() * sizeof(float),
-            &indices[0], indices.size());
 }
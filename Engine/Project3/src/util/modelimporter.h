@@ -2,10 +2,14 @@
 #define MODELIMPORTER_H
 
 #include <QString>
+#include <QVector>
 
 class Entity;
 class Mesh;
 class Material;
+class Texture;
+enum class TextureUsage;
+struct ImportedSubMesh;
 struct aiMesh;
 struct aiNode;
 struct aiScene;
@@ -18,18 +22,19 @@ public:
     ModelImporter();
     ~ModelImporter();
 
-    // It loads a model and creates an entity with it
+    // It loads a model and creates an entity with it (with a child entity
+    // per node for formats read by Assimp)
     Entity *import(const QString &path);
 
-    // It only loads the mesh geometry into a mesh
-    void loadMesh(Mesh *mesh, const QString &path);
-
 private:
 
+    // Native OBJ path (see ObjLoader)
+    Entity *importObj(const QString &path);
+
     // Assimp stuff
-    void processMaterial(aiMaterial *material, Material *myMaterial);
-    void processNode(aiNode *node, const aiScene *scene, Mesh *myMesh, Material **myMaterials, Material **mySubmeshMaterials);
-    void processMesh(aiMesh *mesh, const aiScene *scene, Mesh *myMesh, Material **myMaterials, Material **mySubmeshMaterials);
+    void processMaterial(aiMaterial *material, Material *myMaterial, QVector<QString> &texturePaths, QVector<Texture**> &textureSlots, QVector<TextureUsage> &textureUsages);
+    Entity *processNode(aiNode *node, Entity *parent, const aiScene *scene, const QVector<Mesh*> &meshes, const QVector<Material*> &materials);
+    static void processMesh(ImportedSubMesh &submesh);
 
     QString directory; /**< Directory in which the file to import is located. */
 };
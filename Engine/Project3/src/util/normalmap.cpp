@@ -0,0 +1,130 @@
+#include "util/normalmap.h"
+#include "globals.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NORMALMAP_SSE
+#include <emmintrin.h>
+#endif
+
+
+// Heights of a row in 0..1, padded with the wrapped pixel at each side
+static void readHeights(const QImage &image, int y, int bytesPerPixel, float *heights)
+{
+    const int w = image.width();
+    const uchar *row = image.constScanLine(y);
+    for (int x = 0; x < w; ++x)
+    {
+        heights[x + 1] = row[x * bytesPerPixel] * (1.0f / 255.0f);
+    }
+    heights[0] = heights[w];
+    heights[w + 1] = heights[1];
+}
+
+static inline uchar toByte(float n)
+{
+    return uchar(int((n * 0.5f + 0.5f) * 255.0f + 0.5f));
+}
+
+// Sobel filter of one row, horizontal and vertical sums are computed once
+// per column and shared by the three pixels that read them
+static void normalRow(const float *top, const float *center, const float *bottom, int w, float dZ,
+                      float *vertical, float *difference, uchar *out)
+{
+    for (int i = 0; i < w + 2; ++i)
+    {
+        vertical[i] = top[i] + 2.0f * center[i] + bottom[i];
+        difference[i] = bottom[i] - top[i];
+    }
+
+    int x = 0;
+#ifdef NORMALMAP_SSE
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 zero = _mm_set1_ps(dZ);
+    const __m128 zz = _mm_set1_ps(dZ * dZ);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    for (; x + 4 <= w; x += 4)
+    {
+        // dX = (tl + 2l + bl) - (tr + 2r + br), dY = (bl + 2b + br) - (tl + 2t + tr)
+        const __m128 dX = _mm_sub_ps(_mm_loadu_ps(vertical + x), _mm_loadu_ps(vertical + x + 2));
+        const __m128 dY = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(difference + x), _mm_loadu_ps(difference + x + 2)),
+                                     _mm_mul_ps(two, _mm_loadu_ps(difference + x + 1)));
+        const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dX, dX), _mm_mul_ps(dY, dY)), zz));
+        const __m128 factor = _mm_div_ps(_mm_mul_ps(half, scale), length);
+        const __m128 offset = _mm_add_ps(_mm_mul_ps(half, scale), half);
+
+        alignas(16) int r[4], g[4], b[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(r), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(dX, factor), offset)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(g), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(dY, factor), offset)));
+        _mm_store_si128(reinterpret_cast<__m128i *>(b), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(zero, factor), offset)));
+        for (int i = 0; i < 4; ++i)
+        {
+            *out++ = uchar(r[i]);
+            *out++ = uchar(g[i]);
+            *out++ = uchar(b[i]);
+        }
+    }
+#endif
+    for (; x < w; ++x)
+    {
+        const float dX = vertical[x] - vertical[x + 2];
+        const float dY = difference[x] + 2.0f * difference[x + 1] + difference[x + 2];
+        const float invLength = 1.0f / std::sqrt(dX * dX + dY * dY + dZ * dZ);
+        *out++ = toByte(dX * invLength);
+        *out++ = toByte(dY * invLength);
+        *out++ = toByte(dZ * invLength);
+    }
+}
+
+QImage NormalMap::fromBump(const QImage &bumpMap, float bumpiness)
+{
+    // Formats whose red channel is the first byte of every pixel
+    QImage source = bumpMap;
+    if (source.format() != QImage::Format_RGBA8888 && source.format() != QImage::Format_RGB888 &&
+        source.format() != QImage::Format_Grayscale8)
+    {
+        source = source.convertToFormat(QImage::Format_RGBA8888);
+    }
+    const int bytesPerPixel = source.depth() / 8;
+
+    const int w = source.width();
+    const int h = source.height();
+    QImage normalMap(w, h, QImage::Format_RGB888);
+    if (w == 0 || h == 0)
+    {
+        return normalMap;
+    }
+
+    const float dZ = 1.0f / bumpiness;
+    uchar *bits = normalMap.bits();
+    const int bytesPerLine = normalMap.bytesPerLine();
+
+    // Ranges of rows, every one writes its own scanlines
+    const int rowsPerRange = 32;
+    jobSystem->parallelFor("Normal map rows", h, rowsPerRange, [&](int firstRow, int lastRow)
+    {
+        // Three rolling rows of heights (the row above is the next one)
+        QVector<float> buffer((w + 2) * 5);
+        float *bottom = buffer.data();
+        float *center = bottom + (w + 2);
+        float *top = center + (w + 2);
+        float *vertical = top + (w + 2);
+        float *difference = vertical + (w + 2);
+
+        readHeights(source, (firstRow + h - 1) % h, bytesPerPixel, bottom);
+        readHeights(source, firstRow, bytesPerPixel, center);
+        for (int y = firstRow; y < lastRow; ++y)
+        {
+            readHeights(source, (y + 1) % h, bytesPerPixel, top);
+            normalRow(top, center, bottom, w, dZ, vertical, difference, bits + y * bytesPerLine);
+
+            float *oldBottom = bottom;
+            bottom = center;
+            center = top;
+            top = oldBottom;
+        }
+    });
+
+    return normalMap;
+}
@@ -0,0 +1,18 @@
+#ifndef NORMALMAP_H
+#define NORMALMAP_H
+
+#include <QImage>
+
+// Normal maps generated from height maps with a Sobel filter (the image
+// wraps around at the borders, as tiled textures do)
+class NormalMap
+{
+public:
+
+    // Reads the red channel of the bump map (rows from bottom to top, as
+    // uploaded to OpenGL) and returns an RGB888 image in the same order.
+    // Rows are processed in jobs, four pixels at a time with SSE.
+    static QImage fromBump(const QImage &bumpMap, float bumpiness);
+};
+
+#endif // NORMALMAP_H
@@ -0,0 +1,715 @@
+#include "util/objloader.h"
+#include "util/profiler.h"
+#include "globals.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QPair>
+#include <QStringList>
+#include <QThread>
+#include <QVector3D>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+
+// Parsing helpers /////////////////////////////////////////////////////
+
+static inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+static inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+static inline void skipSpaces(const char *&p, const char *end)
+{
+    while (p < end && isSpace(*p)) ++p;
+}
+
+static inline const char *findLineEnd(const char *p, const char *end)
+{
+    const void *newline = memchr(p, '\n', size_t(end - p));
+    return newline != nullptr ? static_cast<const char *>(newline) : end;
+}
+
+static const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Decimal float parser without locale handling nor allocations
+static inline float parseFloat(const char *&p, const char *end)
+{
+    skipSpaces(p, end);
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) { negative = (*p == '-'); ++p; }
+
+    quint64 mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    while (p < end && isDigit(*p))
+    {
+        if (digits < 19) { mantissa = mantissa * 10 + quint64(*p - '0'); if (mantissa > 0) digits++; }
+        else { exponent++; }
+        ++p;
+    }
+    if (p < end && *p == '.')
+    {
+        ++p;
+        while (p < end && isDigit(*p))
+        {
+            if (digits < 19) { mantissa = mantissa * 10 + quint64(*p - '0'); if (mantissa > 0) digits++; exponent--; }
+            ++p;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) { negativeExponent = (*p == '-'); ++p; }
+        int e = 0;
+        while (p < end && isDigit(*p))
+        {
+            if (e < 1000) e = e * 10 + (*p - '0');
+            ++p;
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+
+    double value = double(mantissa);
+    if (exponent < 0)
+    {
+        value /= (-exponent <= 22) ? powersOfTen[-exponent] : std::pow(10.0, -exponent);
+    }
+    else if (exponent > 0)
+    {
+        value *= (exponent <= 22) ? powersOfTen[exponent] : std::pow(10.0, exponent);
+    }
+
+    return float(negative ? -value : value);
+}
+
+static inline int parseInt(const char *&p, const char *end)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) { negative = (*p == '-'); ++p; }
+    int value = 0;
+    while (p < end && isDigit(*p))
+    {
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+    return negative ? -value : value;
+}
+
+static inline QString parseName(const char *p, const char *end)
+{
+    while (end > p && isSpace(end[-1])) --end;
+    skipSpaces(p, end);
+    return QString::fromUtf8(p, int(end - p));
+}
+
+// Runs function(i) for i in [0, count) in the job system
+template <typename Function>
+static void parallelFor(int count, Function function)
+{
+    jobSystem->parallelFor("OBJ vertices", count, 16384, [&function](int begin, int end) {
+        for (int i = begin; i < end; ++i) function(i);
+    });
+}
+
+// Runs function(item) for every item in the job system, one job each
+template <typename T, typename Function>
+static void parallelForEach(const char *name, QVector<T> &items, Function function)
+{
+    jobSystem->parallelFor(name, items.size(), 1, [&items, &function](int begin, int end) {
+        for (int i = begin; i < end; ++i) function(items[i]);
+    });
+}
+
+
+// Chunk parsing ///////////////////////////////////////////////////////
+
+struct ObjCorner
+{
+    int v = -1;
+    int vt = -1;
+    int vn = -1;
+};
+
+static inline bool operator==(const ObjCorner &a, const ObjCorner &b)
+{
+    return a.v == b.v && a.vt == b.vt && a.vn == b.vn;
+}
+
+static inline uint qHash(const ObjCorner &c, uint seed = 0)
+{
+    return (uint(c.v) * 73856093u) ^ (uint(c.vt) * 19349663u) ^ (uint(c.vn) * 83492791u) ^ seed;
+}
+
+struct ObjMaterialRun
+{
+    int firstTriangle = 0;
+    QString name;
+};
+
+struct ObjChunk
+{
+    const char *begin = nullptr;
+    const char *end = nullptr;
+
+    // Elements declared before this chunk (so indices resolve globally)
+    int positionBase = 0;
+    int texCoordBase = 0;
+    int normalBase = 0;
+
+    // Elements declared in this chunk
+    int positionCount = 0;
+    int texCoordCount = 0;
+    int normalCount = 0;
+
+    QVector<float> positions;
+    QVector<float> texCoords;
+    QVector<float> normals;
+    QVector<ObjCorner> corners; // 3 per triangle
+    QVector<ObjMaterialRun> materialRuns;
+    QVector<QString> materialLibraries;
+};
+
+// First pass: counts the vertex elements so that all the chunks know
+// their index bases before parsing faces (OBJ allows relative indices)
+static void countChunk(ObjChunk &chunk)
+{
+    const char *p = chunk.begin;
+    while (p < chunk.end)
+    {
+        const char *lineEnd = findLineEnd(p, chunk.end);
+        skipSpaces(p, lineEnd);
+        if (lineEnd - p >= 2 && p[0] == 'v' && isSpace(p[1])) chunk.positionCount++;
+        else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2])) chunk.texCoordCount++;
+        else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) chunk.normalCount++;
+        p = lineEnd + 1;
+    }
+}
+
+static inline int resolveIndex(int index, int base, int count)
+{
+    if (index > 0) return index - 1;
+    if (index < 0) return base + count + index;
+    return -1;
+}
+
+static void parseChunk(ObjChunk &chunk)
+{
+    chunk.positions.reserve(chunk.positionCount * 3);
+    chunk.texCoords.reserve(chunk.texCoordCount * 2);
+    chunk.normals.reserve(chunk.normalCount * 3);
+
+    int positions = 0;
+    int texCoords = 0;
+    int normals = 0;
+
+    QVector<ObjCorner> face;
+
+    const char *p = chunk.begin;
+    while (p < chunk.end)
+    {
+        const char *lineEnd = findLineEnd(p, chunk.end);
+        skipSpaces(p, lineEnd);
+
+        if (lineEnd - p >= 2 && p[0] == 'v' && isSpace(p[1]))
+        {
+            p += 2;
+            chunk.positions.push_back(parseFloat(p, lineEnd));
+            chunk.positions.push_back(parseFloat(p, lineEnd));
+            chunk.positions.push_back(parseFloat(p, lineEnd));
+            positions++;
+        }
+        else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2]))
+        {
+            p += 3;
+            chunk.texCoords.push_back(parseFloat(p, lineEnd));
+            chunk.texCoords.push_back(parseFloat(p, lineEnd));
+            texCoords++;
+        }
+        else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+        {
+            p += 3;
+            chunk.normals.push_back(parseFloat(p, lineEnd));
+            chunk.normals.push_back(parseFloat(p, lineEnd));
+            chunk.normals.push_back(parseFloat(p, lineEnd));
+            normals++;
+        }
+        else if (lineEnd - p >= 2 && p[0] == 'f' && isSpace(p[1]))
+        {
+            p += 2;
+            face.clear();
+            while (true)
+            {
+                skipSpaces(p, lineEnd);
+                if (p >= lineEnd || !(isDigit(*p) || *p == '-' || *p == '+')) break;
+
+                ObjCorner corner;
+                corner.v = resolveIndex(parseInt(p, lineEnd), chunk.positionBase, positions);
+                if (p < lineEnd && *p == '/')
+                {
+                    ++p;
+                    if (p < lineEnd && *p != '/')
+                    {
+                        corner.vt = resolveIndex(parseInt(p, lineEnd), chunk.texCoordBase, texCoords);
+                    }
+                    if (p < lineEnd && *p == '/')
+                    {
+                        ++p;
+                        corner.vn = resolveIndex(parseInt(p, lineEnd), chunk.normalBase, normals);
+                    }
+                }
+                face.push_back(corner);
+            }
+
+            // Triangulate polygons as a fan
+            for (int i = 2; i < face.size(); ++i)
+            {
+                chunk.corners.push_back(face[0]);
+                chunk.corners.push_back(face[i - 1]);
+                chunk.corners.push_back(face[i]);
+            }
+        }
+        else if (lineEnd - p >= 7 && strncmp(p, "usemtl", 6) == 0 && isSpace(p[6]))
+        {
+            ObjMaterialRun run;
+            run.firstTriangle = chunk.corners.size() / 3;
+            run.name = parseName(p + 7, lineEnd);
+            chunk.materialRuns.push_back(run);
+        }
+        else if (lineEnd - p >= 7 && strncmp(p, "mtllib", 6) == 0 && isSpace(p[6]))
+        {
+            chunk.materialLibraries.push_back(parseName(p + 7, lineEnd));
+        }
+
+        p = lineEnd + 1;
+    }
+}
+
+
+// Materials ///////////////////////////////////////////////////////////
+
+static void loadMaterialLibrary(const QString &path, QVector<ObjMaterial> &materials)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cout << "Could not open file for read: " << path.toStdString() << std::endl;
+        return;
+    }
+
+    const QByteArray contents = file.readAll();
+    const QString directory = QFileInfo(path).path();
+
+    // Texture statements may have options before the file name (e.g. -bm 1.0)
+    auto mapPath = [&directory](const QString &args) {
+        const QString simplified = args.simplified();
+        if (simplified.isEmpty()) return QString();
+        const QString filename = simplified.section(QLatin1Char(' '), -1);
+        return QString::fromLatin1("%0/%1").arg(directory).arg(filename);
+    };
+    auto color = [](const char *p, const char *end) {
+        const float r = parseFloat(p, end);
+        const float g = parseFloat(p, end);
+        const float b = parseFloat(p, end);
+        return QColor::fromRgbF(qBound(0.0f, r, 1.0f), qBound(0.0f, g, 1.0f), qBound(0.0f, b, 1.0f));
+    };
+
+    ObjMaterial *material = nullptr;
+    const char *p = contents.constData();
+    const char *end = p + contents.size();
+    while (p < end)
+    {
+        const char *lineEnd = findLineEnd(p, end);
+        skipSpaces(p, lineEnd);
+
+        const char *keyEnd = p;
+        while (keyEnd < lineEnd && !isSpace(*keyEnd)) ++keyEnd;
+        const QByteArray key = QByteArray::fromRawData(p, int(keyEnd - p));
+
+        if (key == "newmtl")
+        {
+            materials.push_back(ObjMaterial());
+            material = &materials.back();
+            material->name = parseName(keyEnd, lineEnd);
+        }
+        else if (material != nullptr && keyEnd < lineEnd)
+        {
+            if (key == "Kd") material->albedo = color(keyEnd, lineEnd);
+            else if (key == "Ke") material->emissive = color(keyEnd, lineEnd);
+            else if (key == "Ns") { const char *q = keyEnd; material->shininess = parseFloat(q, lineEnd); }
+            else if (key == "map_Kd") material->albedoMap = mapPath(parseName(keyEnd, lineEnd));
+            else if (key == "map_Ke") material->emissiveMap = mapPath(parseName(keyEnd, lineEnd));
+            else if (key == "map_Ks") material->specularMap = mapPath(parseName(keyEnd, lineEnd));
+            else if (key == "norm" || key == "map_Kn") material->normalsMap = mapPath(parseName(keyEnd, lineEnd));
+            else if (key == "bump" || key == "map_bump" || key == "map_Bump") material->bumpMap = mapPath(parseName(keyEnd, lineEnd));
+        }
+
+        p = lineEnd + 1;
+    }
+}
+
+
+// Submesh creation ////////////////////////////////////////////////////
+
+struct ObjGroup
+{
+    int materialIndex = -1;
+    QVector<ObjCorner> corners;
+    ObjSubMesh *submesh = nullptr;
+};
+
+struct ObjAttributes
+{
+    QVector<float> positions;
+    QVector<float> texCoords;
+    QVector<float> normals;
+};
+
+static inline QVector3D readVector3(const float *v) { return QVector3D(v[0], v[1], v[2]); }
+static inline void writeVector3(float *v, const QVector3D &value) { v[0] = value.x(); v[1] = value.y(); v[2] = value.z(); }
+
+// Triangles around each key (a vertex or a position) given the key of every
+// corner, in triangle order so their sums match adding them up serially
+static void trianglesAround(const unsigned int *cornerKeys, int cornerCount, int keyCount, QVector<int> &offsets, QVector<int> &triangles)
+{
+    offsets.fill(0, keyCount + 1);
+    for (int c = 0; c < cornerCount; ++c)
+    {
+        offsets[int(cornerKeys[c]) + 1]++;
+    }
+    for (int k = 0; k < keyCount; ++k)
+    {
+        offsets[k + 1] += offsets[k];
+    }
+    QVector<int> next = offsets;
+    triangles.resize(cornerCount);
+    for (int c = 0; c < cornerCount; ++c)
+    {
+        triangles[next[int(cornerKeys[c])]++] = c / 3;
+    }
+}
+
+static void buildSubMesh(ObjGroup &group, const ObjAttributes &attributes)
+{
+    ObjSubMesh &submesh = *group.submesh;
+    submesh.materialIndex = group.materialIndex;
+
+    const int positionCount = attributes.positions.size() / 3;
+    const int texCoordCount = attributes.texCoords.size() / 2;
+    const int normalCount = attributes.normals.size() / 3;
+
+    // Drop triangles referencing missing positions
+    QVector<ObjCorner> &corners = group.corners;
+    bool hasTexCoords = false;
+    bool hasNormals = true;
+    int validCorners = 0;
+    for (int i = 0; i < corners.size(); i += 3)
+    {
+        bool valid = true;
+        for (int j = 0; j < 3; ++j)
+        {
+            ObjCorner &c = corners[i + j];
+            valid = valid && c.v >= 0 && c.v < positionCount;
+            if (c.vt >= texCoordCount) c.vt = -1;
+            if (c.vn >= normalCount) c.vn = -1;
+        }
+        if (!valid) continue;
+        for (int j = 0; j < 3; ++j)
+        {
+            const ObjCorner &c = corners[i + j];
+            hasTexCoords = hasTexCoords || c.vt >= 0;
+            hasNormals = hasNormals && c.vn >= 0;
+            corners[validCorners++] = c;
+        }
+    }
+    corners.resize(validCorners);
+
+    // Deduplicate the v/vt/vn triples into indexed vertices
+    QVector<ObjCorner> uniqueCorners;
+    {
+        QHash<ObjCorner, unsigned int> vertexIndices;
+        vertexIndices.reserve(corners.size() / 4);
+        submesh.indices.resize(corners.size());
+        for (int i = 0; i < corners.size(); ++i)
+        {
+            ObjCorner c = corners[i];
+            if (!hasNormals) c.vn = -1;
+            auto it = vertexIndices.constFind(c);
+            if (it == vertexIndices.constEnd())
+            {
+                it = vertexIndices.insert(c, unsigned(uniqueCorners.size()));
+                uniqueCorners.push_back(c);
+            }
+            submesh.indices[i] = it.value();
+        }
+        corners = QVector<ObjCorner>();
+    }
+
+    // Same layout as ModelImporter::processMesh
+    VertexFormat &vertexFormat = submesh.vertexFormat;
+    vertexFormat.setVertexAttribute(0, 0, 3);
+    vertexFormat.setVertexAttribute(1, 3 * sizeof(float), 3);
+    if (hasTexCoords)
+    {
+        vertexFormat.setVertexAttribute(2, vertexFormat.size, 2);
+        vertexFormat.setVertexAttribute(3, vertexFormat.size, 3);
+        vertexFormat.setVertexAttribute(4, vertexFormat.size, 3);
+    }
+
+    const int vertexCount = uniqueCorners.size();
+    const int floatsPerVertex = vertexFormat.size / int(sizeof(float));
+    submesh.vertices.resize(vertexCount * vertexFormat.size);
+    float *vertices = reinterpret_cast<float *>(submesh.vertices.data());
+
+    parallelFor(vertexCount, [&](int i) {
+        const ObjCorner &c = uniqueCorners[i];
+        float *vertex = vertices + size_t(i) * size_t(floatsPerVertex);
+        memcpy(vertex, &attributes.positions[c.v * 3], 3 * sizeof(float));
+        if (c.vn >= 0) memcpy(vertex + 3, &attributes.normals[c.vn * 3], 3 * sizeof(float));
+        else memset(vertex + 3, 0, 3 * sizeof(float));
+        if (hasTexCoords)
+        {
+            if (c.vt >= 0) memcpy(vertex + 6, &attributes.texCoords[c.vt * 2], 2 * sizeof(float));
+            else memset(vertex + 6, 0, 2 * sizeof(float));
+        }
+    });
+
+    const unsigned int *indices = submesh.indices.constData();
+    const int triangleCount = submesh.indices.size() / 3;
+
+    // The face vectors are computed per triangle and summed per vertex (or
+    // position) from the triangles around it, both in parallel
+
+    // Smooth normals shared by all the vertices at the same position
+    if (!hasNormals)
+    {
+        QVector<unsigned int> vertexPositions(vertexCount);
+        int usedPositionCount = 0;
+        {
+            QHash<int, unsigned int> positionSlots;
+            for (int i = 0; i < vertexCount; ++i)
+            {
+                auto it = positionSlots.constFind(uniqueCorners[i].v);
+                if (it == positionSlots.constEnd())
+                {
+                    it = positionSlots.insert(uniqueCorners[i].v, unsigned(usedPositionCount++));
+                }
+                vertexPositions[i] = it.value();
+            }
+        }
+
+        QVector<QVector3D> faceNormals(triangleCount);
+        parallelFor(triangleCount, [&](int t) {
+            const QVector3D p0 = readVector3(vertices + indices[t * 3 + 0] * floatsPerVertex);
+            const QVector3D p1 = readVector3(vertices + indices[t * 3 + 1] * floatsPerVertex);
+            const QVector3D p2 = readVector3(vertices + indices[t * 3 + 2] * floatsPerVertex);
+            faceNormals[t] = QVector3D::crossProduct(p1 - p0, p2 - p0);
+        });
+
+        QVector<unsigned int> cornerPositions(submesh.indices.size());
+        parallelFor(cornerPositions.size(), [&](int c) {
+            cornerPositions[c] = vertexPositions[int(indices[c])];
+        });
+        QVector<int> offsets, around;
+        trianglesAround(cornerPositions.constData(), cornerPositions.size(), usedPositionCount, offsets, around);
+
+        QVector<QVector3D> positionNormals(usedPositionCount);
+        parallelFor(usedPositionCount, [&](int p) {
+            QVector3D n;
+            for (int k = offsets[p]; k < offsets[p + 1]; ++k) n += faceNormals[around[k]];
+            positionNormals[p] = n.normalized();
+        });
+        parallelFor(vertexCount, [&](int i) {
+            writeVector3(vertices + size_t(i) * size_t(floatsPerVertex) + 3, positionNormals[int(vertexPositions[i])]);
+        });
+    }
+
+    // Tangent space (bitangent pointing along +v, as processMesh stores it)
+    if (hasTexCoords)
+    {
+        QVector<QVector3D> faceTangents(triangleCount);
+        QVector<QVector3D> faceBitangents(triangleCount);
+        parallelFor(triangleCount, [&](int t) {
+            const float *v0 = vertices + indices[t * 3 + 0] * floatsPerVertex;
+            const float *v1 = vertices + indices[t * 3 + 1] * floatsPerVertex;
+            const float *v2 = vertices + indices[t * 3 + 2] * floatsPerVertex;
+            const QVector3D e1 = readVector3(v1) - readVector3(v0);
+            const QVector3D e2 = readVector3(v2) - readVector3(v0);
+            const float du1 = v1[6] - v0[6], dv1 = v1[7] - v0[7];
+            const float du2 = v2[6] - v0[6], dv2 = v2[7] - v0[7];
+            const float det = du1 * dv2 - du2 * dv1;
+            if (std::fabs(det) < 1e-12f) return; // Left as zero
+            const float r = 1.0f / det;
+            faceTangents[t] = (e1 * dv2 - e2 * dv1) * r;
+            faceBitangents[t] = (e2 * du1 - e1 * du2) * r;
+        });
+
+        QVector<int> offsets, around;
+        trianglesAround(indices, submesh.indices.size(), vertexCount, offsets, around);
+
+        parallelFor(vertexCount, [&](int i) {
+            float *vertex = vertices + size_t(i) * size_t(floatsPerVertex);
+            const QVector3D n = readVector3(vertex + 3);
+            QVector3D tangentSum, bitangentSum;
+            for (int k = offsets[i]; k < offsets[i + 1]; ++k)
+            {
+                tangentSum += faceTangents[around[k]];
+                bitangentSum += faceBitangents[around[k]];
+            }
+            QVector3D tangent = tangentSum - n * QVector3D::dotProduct(n, tangentSum);
+            QVector3D bitangent = bitangentSum - n * QVector3D::dotProduct(n, bitangentSum);
+            if (tangent.lengthSquared() < 1e-12f)
+            {
+                // Any direction perpendicular to the normal
+                tangent = QVector3D::crossProduct(n, std::fabs(n.x()) < 0.9f ? QVector3D(1, 0, 0) : QVector3D(0, 1, 0));
+            }
+            tangent.normalize();
+            if (bitangent.lengthSquared() < 1e-12f)
+            {
+                bitangent = QVector3D::crossProduct(n, tangent);
+            }
+            bitangent.normalize();
+            writeVector3(vertex + 8, tangent);
+            writeVector3(vertex + 11, bitangent);
+        });
+    }
+
+    submesh.meshlets = buildMeshlets(submesh.vertices, vertexFormat.size, submesh.indices);
+}
+
+
+// Loader //////////////////////////////////////////////////////////////
+
+bool ObjLoader::load(const QString &path, ObjModel &model)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cout << "Could not open file for read: " << path.toStdString() << std::endl;
+        return false;
+    }
+
+    const qint64 fileSize = file.size();
+    const char *data = reinterpret_cast<const char *>(file.map(0, fileSize));
+    if (data == nullptr) {
+        std::cout << "Could not map file: " << path.toStdString() << std::endl;
+        return false;
+    }
+
+    // Split the file in newline aligned chunks
+    const qint64 minChunkSize = 1 << 20;
+    const int chunkCount = int(qBound(qint64(1), fileSize / minChunkSize, qint64(QThread::idealThreadCount() * 4)));
+    QVector<ObjChunk> chunks(chunkCount);
+    const char *begin = data;
+    const char *end = data + fileSize;
+    for (int i = 0; i < chunkCount; ++i)
+    {
+        const char *chunkEnd = (i == chunkCount - 1) ? end : data + fileSize * (i + 1) / chunkCount;
+        if (chunkEnd < begin) chunkEnd = begin;
+        if (chunkEnd < end) chunkEnd = findLineEnd(chunkEnd, end);
+        if (chunkEnd < end) chunkEnd++;
+        chunks[i].begin = begin;
+        chunks[i].end = chunkEnd;
+        begin = chunkEnd;
+    }
+
+    ObjAttributes attributes;
+    {
+        PROFILE_SCOPE("OBJ parse");
+
+        parallelForEach("OBJ count", chunks, countChunk);
+
+        int positionCount = 0, texCoordCount = 0, normalCount = 0;
+        for (ObjChunk &chunk : chunks)
+        {
+            chunk.positionBase = positionCount;
+            chunk.texCoordBase = texCoordCount;
+            chunk.normalBase = normalCount;
+            positionCount += chunk.positionCount;
+            texCoordCount += chunk.texCoordCount;
+            normalCount += chunk.normalCount;
+        }
+
+        parallelForEach("OBJ chunk", chunks, parseChunk);
+
+        // Gather the vertex elements of all the chunks
+        attributes.positions.resize(positionCount * 3);
+        attributes.texCoords.resize(texCoordCount * 2);
+        attributes.normals.resize(normalCount * 3);
+        parallelForEach("OBJ gather", chunks, [&attributes](ObjChunk &chunk) {
+            memcpy(attributes.positions.data() + chunk.positionBase * 3, chunk.positions.constData(), size_t(chunk.positions.size()) * sizeof(float));
+            memcpy(attributes.texCoords.data() + chunk.texCoordBase * 2, chunk.texCoords.constData(), size_t(chunk.texCoords.size()) * sizeof(float));
+            memcpy(attributes.normals.data() + chunk.normalBase * 3, chunk.normals.constData(), size_t(chunk.normals.size()) * sizeof(float));
+            chunk.positions = QVector<float>();
+            chunk.texCoords = QVector<float>();
+            chunk.normals = QVector<float>();
+        });
+    }
+
+    file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+    file.close();
+
+    // Materials
+    const QString directory = QFileInfo(path).path();
+    QHash<QString, int> materialIndices;
+    for (const ObjChunk &chunk : chunks)
+    {
+        for (const QString &library : chunk.materialLibraries)
+        {
+            loadMaterialLibrary(QString::fromLatin1("%0/%1").arg(directory).arg(library), model.materials);
+        }
+    }
+    for (int i = 0; i < model.materials.size(); ++i)
+    {
+        materialIndices.insert(model.materials[i].name, i);
+    }
+
+    // Group the triangles by material (in order of first use)
+    QVector<ObjGroup> groups;
+    QHash<int, int> groupIndices;
+    auto appendTriangles = [&](int materialIndex, const ObjChunk &chunk, int first, int last) {
+        if (first >= last) return;
+        if (!groupIndices.contains(materialIndex))
+        {
+            groupIndices.insert(materialIndex, groups.size());
+            groups.push_back(ObjGroup());
+            groups.back().materialIndex = materialIndex;
+        }
+        QVector<ObjCorner> &corners = groups[groupIndices.value(materialIndex)].corners;
+        const int offset = corners.size();
+        corners.resize(offset + (last - first) * 3);
+        memcpy(corners.data() + offset, chunk.corners.constData() + first * 3, size_t(last - first) * 3 * sizeof(ObjCorner));
+    };
+
+    int currentMaterial = -1;
+    for (ObjChunk &chunk : chunks)
+    {
+        int first = 0;
+        for (const ObjMaterialRun &run : chunk.materialRuns)
+        {
+            appendTriangles(currentMaterial, chunk, first, run.firstTriangle);
+            currentMaterial = materialIndices.value(run.name, -1);
+            first = run.firstTriangle;
+        }
+        appendTriangles(currentMaterial, chunk, first, chunk.corners.size() / 3);
+        chunk.corners = QVector<ObjCorner>();
+    }
+
+    // Build the submeshes in parallel
+    {
+        PROFILE_SCOPE("OBJ submeshes");
+
+        model.submeshes.resize(groups.size());
+        for (int i = 0; i < groups.size(); ++i)
+        {
+            groups[i].submesh = &model.submeshes[i];
+        }
+        parallelForEach("OBJ submesh", groups, [&attributes](ObjGroup &group) {
+            buildSubMesh(group, attributes);
+        });
+    }
+
+    return true;
+}
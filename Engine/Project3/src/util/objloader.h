@@ -0,0 +1,50 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include "resources/mesh.h"
+#include <QByteArray>
+#include <QColor>
+#include <QString>
+#include <QVector>
+
+struct ObjMaterial
+{
+    QString name;
+    QColor albedo = QColor(255, 255, 255);
+    QColor emissive = QColor(0, 0, 0);
+    float shininess = 0.0f;
+
+    // Full paths to the texture files (empty if not used)
+    QString albedoMap;
+    QString emissiveMap;
+    QString specularMap;
+    QString normalsMap;
+    QString bumpMap;
+};
+
+struct ObjSubMesh
+{
+    int materialIndex = -1; // -1 if the face group had no known material
+    VertexFormat vertexFormat;
+    QByteArray vertices;
+    QVector<unsigned int> indices;
+    QVector<Meshlet> meshlets;
+};
+
+struct ObjModel
+{
+    QVector<ObjMaterial> materials;
+    QVector<ObjSubMesh> submeshes;
+};
+
+// Wavefront OBJ/MTL reader. The file is memory mapped and parsed in
+// parallel chunks; the submeshes (one per material) use the same vertex
+// layout as the Assimp importer: position, normal, [uv, tangent, bitangent].
+class ObjLoader
+{
+public:
+
+    static bool load(const QString &path, ObjModel &model);
+};
+
+#endif // OBJLOADER_H
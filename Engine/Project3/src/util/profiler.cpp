@@ -0,0 +1,107 @@
+#include "util/profiler.h"
+#include <QMutexLocker>
+
+
+#define MAX_ENDED_CAPTURES 16
+
+static thread_local ProfilerCapturePtr currentCapture;
+
+static QMutex endedMutex;
+static QVector<ProfilerCapturePtr> endedCaptures;
+
+
+QVector<ProfilerSample> ProfilerCapture::takeSamples()
+{
+    QMutexLocker locker(&mutex);
+    QVector<ProfilerSample> taken;
+    taken.swap(samples);
+    for (const ProfilerSample &sample : jobSamples)
+    {
+        taken.push_back(sample);
+    }
+    jobSamples.clear();
+    return taken;
+}
+
+ProfilerCapturePtr Profiler::begin(const QString &title)
+{
+    ProfilerCapturePtr capture(new ProfilerCapture(title));
+    capture->previous = currentCapture;
+    currentCapture = capture;
+    return capture;
+}
+
+void Profiler::end()
+{
+    ProfilerCapturePtr capture = currentCapture;
+    if (capture.isNull())
+    {
+        return;
+    }
+    currentCapture = capture->previous;
+    capture->previous.reset();
+
+    QMutexLocker locker(&endedMutex);
+    endedCaptures.push_back(capture);
+    if (endedCaptures.size() > MAX_ENDED_CAPTURES)
+    {
+        endedCaptures.removeFirst();
+    }
+}
+
+ProfilerCapturePtr Profiler::current()
+{
+    return currentCapture;
+}
+
+ProfilerCapturePtr Profiler::setCurrent(ProfilerCapturePtr capture)
+{
+    ProfilerCapturePtr previous = currentCapture;
+    currentCapture = capture;
+    return previous;
+}
+
+void Profiler::record(const QString &name, qint64 nsecs)
+{
+    ProfilerCapture *capture = currentCapture.data();
+    if (capture == nullptr)
+    {
+        return;
+    }
+
+    ProfilerSample sample;
+    sample.name = name;
+    sample.nsecs = nsecs;
+
+    QMutexLocker locker(&capture->mutex);
+    capture->samples.push_back(sample);
+}
+
+void Profiler::recordJob(const char *name, qint64 nsecs)
+{
+    ProfilerCapture *capture = currentCapture.data();
+    if (capture == nullptr)
+    {
+        return;
+    }
+
+    QMutexLocker locker(&capture->mutex);
+    auto it = capture->jobSamples.find(name);
+    if (it == capture->jobSamples.end())
+    {
+        ProfilerSample sample;
+        sample.name = QString::fromLatin1(name != nullptr ? name : "Job");
+        sample.count = 0;
+        it = capture->jobSamples.insert(name, sample);
+    }
+    it->nsecs += nsecs;
+    it->count++;
+}
+
+QVector<ProfilerCapturePtr> Profiler::takeCaptures()
+{
+    QMutexLocker locker(&endedMutex);
+    QVector<ProfilerCapturePtr> taken;
+    taken.swap(endedCaptures);
+    return taken;
+}
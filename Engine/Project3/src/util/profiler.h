@@ -0,0 +1,102 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+struct ProfilerSample
+{
+    QString name;
+    qint64 nsecs = 0;
+    int count = 1; // Jobs whose times were added together
+};
+
+// Samples of a single event (as an import): the stages timed while it is
+// the current capture of a thread and the totals of the jobs queued from
+// them. Jobs still running when it ends add their time later.
+class ProfilerCapture
+{
+public:
+
+    explicit ProfilerCapture(const QString &t) : title(t) { }
+
+    // Returns the samples recorded so far (the job totals last) and forgets them
+    QVector<ProfilerSample> takeSamples();
+
+    const QString title;
+
+private:
+
+    QMutex mutex;
+    QVector<ProfilerSample> samples;
+    QHash<const char*, ProfilerSample> jobSamples;
+    QSharedPointer<ProfilerCapture> previous; // Current one when it began
+
+    friend class Profiler;
+};
+
+typedef QSharedPointer<ProfilerCapture> ProfilerCapturePtr;
+
+// Times are only kept while the calling thread has a capture, anything
+// recorded outside of one (as the per frame jobs) is dropped
+class Profiler
+{
+public:
+
+    // Makes a new capture the current one of the calling thread
+    static ProfilerCapturePtr begin(const QString &title);
+
+    // Ends the current capture of the calling thread (the previous one is
+    // current again) and keeps it for takeCaptures
+    static void end();
+
+    // Current capture of the calling thread, null if there is none
+    static ProfilerCapturePtr current();
+
+    // Replaces the current capture of the calling thread and returns the
+    // previous one (jobs run with the capture of the thread that queued them)
+    static ProfilerCapturePtr setCurrent(ProfilerCapturePtr capture);
+
+    // Stores the time spent in a named stage into the current capture
+    static void record(const QString &name, qint64 nsecs);
+
+    // Adds the time of a job to the total of the jobs with the same name
+    static void recordJob(const char *name, qint64 nsecs);
+
+    // Returns the last ended captures, oldest first, and forgets them
+    static QVector<ProfilerCapturePtr> takeCaptures();
+};
+
+// Records the time elapsed between its construction and destruction
+class ProfilerScope
+{
+public:
+
+    explicit ProfilerScope(const char *n) : name(n) { timer.start(); }
+    ~ProfilerScope() { Profiler::record(QString::fromLatin1(name), timer.nsecsElapsed()); }
+
+private:
+
+    const char *name;
+    QElapsedTimer timer;
+};
+
+// Captures what is recorded between its construction and destruction
+class ProfilerCaptureScope
+{
+public:
+
+    explicit ProfilerCaptureScope(const QString &title) { Profiler::begin(title); }
+    ~ProfilerCaptureScope() { Profiler::end(); }
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name) ProfilerScope PROFILE_CONCAT(profilerScope, __LINE__)(name)
+#define PROFILE_CAPTURE(title) ProfilerCaptureScope PROFILE_CONCAT(profilerCapture, __LINE__)(title)
+
+#endif // PROFILER_H
@@ -0,0 +1,592 @@
+#include "util/texturecompressor.h"
+#include "globals.h"
+#include <QFile>
+#include <QSaveFile>
+#include <cmath>
+#include <cstring>
+
+
+// Mip generation //////////////////////////////////////////////////////
+
+struct ImageLevel
+{
+    int w = 0;
+    int h = 0;
+    QVector<float> pixels; // 4 channels (LDR, 0..255) or 3 channels (HDR)
+};
+
+static QVector<ImageLevel> buildMipChain(ImageLevel level0, int channels)
+{
+    QVector<ImageLevel> levels;
+    levels.push_back(std::move(level0));
+    while (levels.last().w > 1 || levels.last().h > 1)
+    {
+        const ImageLevel &src = levels.last();
+        ImageLevel dst;
+        dst.w = qMax(1, src.w / 2);
+        dst.h = qMax(1, src.h / 2);
+        dst.pixels.resize(dst.w * dst.h * channels);
+        for (int y = 0; y < dst.h; ++y)
+        {
+            const int y0 = qMin(y * 2, src.h - 1);
+            const int y1 = qMin(y * 2 + 1, src.h - 1);
+            for (int x = 0; x < dst.w; ++x)
+            {
+                const int x0 = qMin(x * 2, src.w - 1);
+                const int x1 = qMin(x * 2 + 1, src.w - 1);
+                for (int c = 0; c < channels; ++c)
+                {
+                    dst.pixels[(y * dst.w + x) * channels + c] = 0.25f * (
+                                src.pixels[(y0 * src.w + x0) * channels + c] +
+                                src.pixels[(y0 * src.w + x1) * channels + c] +
+                                src.pixels[(y1 * src.w + x0) * channels + c] +
+                                src.pixels[(y1 * src.w + x1) * channels + c]);
+                }
+            }
+        }
+        levels.push_back(std::move(dst));
+    }
+    return levels;
+}
+
+
+// Block helpers ///////////////////////////////////////////////////////
+
+static int blockBytes(TextureCompression compression)
+{
+    return (compression == TextureCompression::BC1 || compression == TextureCompression::BC4) ? 8 : 16;
+}
+
+// Gathers the 4x4 block (clamping at the borders)
+static void fetchBlock(const ImageLevel &level, int channels, int bx, int by, float block[16][4])
+{
+    for (int j = 0; j < 4; ++j)
+    {
+        const int y = qMin(by * 4 + j, level.h - 1);
+        for (int i = 0; i < 4; ++i)
+        {
+            const int x = qMin(bx * 4 + i, level.w - 1);
+            const float *p = level.pixels.constData() + (y * level.w + x) * channels;
+            for (int c = 0; c < channels; ++c)
+            {
+                block[j * 4 + i][c] = p[c];
+            }
+        }
+    }
+}
+
+// Main direction of the colors (power iteration on the covariance matrix)
+static void principalAxis(const float colors[16][4], float mean[3], float axis[3])
+{
+    mean[0] = mean[1] = mean[2] = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 3; ++c) mean[c] += colors[i][c] / 16.0f;
+    }
+
+    float cov[6] = {};
+    for (int i = 0; i < 16; ++i)
+    {
+        const float r = colors[i][0] - mean[0];
+        const float g = colors[i][1] - mean[1];
+        const float b = colors[i][2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    float v[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        const float x = cov[0] * v[0] + cov[1] * v[1] + cov[2] * v[2];
+        const float y = cov[1] * v[0] + cov[3] * v[1] + cov[4] * v[2];
+        const float z = cov[2] * v[0] + cov[4] * v[1] + cov[5] * v[2];
+        const float m = qMax(qAbs(x), qMax(qAbs(y), qAbs(z)));
+        if (m <= 0.0f) break;
+        v[0] = x / m; v[1] = y / m; v[2] = z / m;
+    }
+
+    const float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int c = 0; c < 3; ++c) axis[c] = v[c] / length;
+}
+
+// Endpoints at the extremes of the colors projected onto the main axis
+static void axisEndpoints(const float colors[16][4], float inset, float e0[3], float e1[3])
+{
+    float mean[3], axis[3];
+    principalAxis(colors, mean, axis);
+
+    float tmin = 0.0f, tmax = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        const float t = (colors[i][0] - mean[0]) * axis[0] +
+                        (colors[i][1] - mean[1]) * axis[1] +
+                        (colors[i][2] - mean[2]) * axis[2];
+        tmin = qMin(tmin, t);
+        tmax = qMax(tmax, t);
+    }
+
+    const float range = (tmax - tmin) * inset;
+    tmin += range;
+    tmax -= range;
+    for (int c = 0; c < 3; ++c)
+    {
+        e0[c] = mean[c] + axis[c] * tmax;
+        e1[c] = mean[c] + axis[c] * tmin;
+    }
+}
+
+static quint16 to565(const float c[3])
+{
+    const int r = qBound(0, int(c[0] * 31.0f / 255.0f + 0.5f), 31);
+    const int g = qBound(0, int(c[1] * 63.0f / 255.0f + 0.5f), 63);
+    const int b = qBound(0, int(c[2] * 31.0f / 255.0f + 0.5f), 31);
+    return quint16((r << 11) | (g << 5) | b);
+}
+
+static void from565(quint16 v, int c[3])
+{
+    const int r = (v >> 11) & 31;
+    const int g = (v >> 5) & 63;
+    const int b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+static void encodeBC1Block(const float block[16][4], uchar *out)
+{
+    float e0[3], e1[3];
+    axisEndpoints(block, 1.0f / 16.0f, e0, e1);
+
+    quint16 c0 = to565(e0);
+    quint16 c1 = to565(e1);
+    if (c0 < c1) qSwap(c0, c1); // Four color mode
+
+    quint32 indices = 0;
+    if (c0 != c1)
+    {
+        int palette[4][3];
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0;
+            float bestError = 1e30f;
+            for (int p = 0; p < 4; ++p)
+            {
+                const float dr = block[i][0] - palette[p][0];
+                const float dg = block[i][1] - palette[p][1];
+                const float db = block[i][2] - palette[p][2];
+                const float error = dr * dr + dg * dg + db * db;
+                if (error < bestError) { bestError = error; best = p; }
+            }
+            indices |= quint32(best) << (2 * i);
+        }
+    }
+
+    out[0] = uchar(c0 & 0xff); out[1] = uchar(c0 >> 8);
+    out[2] = uchar(c1 & 0xff); out[3] = uchar(c1 >> 8);
+    for (int i = 0; i < 4; ++i) out[4 + i] = uchar((indices >> (8 * i)) & 0xff);
+}
+
+// Encodes one channel of the block
+static void encodeBC4Block(const float block[16][4], int channel, uchar *out)
+{
+    float mn = 255.0f, mx = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        mn = qMin(mn, block[i][channel]);
+        mx = qMax(mx, block[i][channel]);
+    }
+    const int e0 = qBound(0, int(mx + 0.5f), 255);
+    const int e1 = qBound(0, int(mn + 0.5f), 255);
+
+    quint64 indices = 0;
+    if (e0 != e1) // Eight value mode (e0 > e1)
+    {
+        int palette[8] = { e0, e1 };
+        for (int k = 2; k < 8; ++k)
+        {
+            palette[k] = ((8 - k) * e0 + (k - 1) * e1) / 7;
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0;
+            float bestError = 1e30f;
+            for (int p = 0; p < 8; ++p)
+            {
+                const float error = qAbs(block[i][channel] - palette[p]);
+                if (error < bestError) { bestError = error; best = p; }
+            }
+            indices |= quint64(best) << (3 * i);
+        }
+    }
+
+    out[0] = uchar(e0);
+    out[1] = uchar(e1);
+    for (int i = 0; i < 6; ++i) out[2 + i] = uchar((indices >> (8 * i)) & 0xff);
+}
+
+
+// BC6H (mode 11: one region, 10 bit endpoints, 4 bit indices) ////////
+
+static quint16 floatToHalf(float f)
+{
+    if (!(f > 0.0f)) return 0; // Unsigned format (also catches NaN)
+    quint32 x;
+    memcpy(&x, &f, sizeof(x));
+    const int exponent = int((x >> 23) & 0xff) - 127 + 15;
+    quint32 mantissa = x & 0x7fffff;
+    if (exponent >= 31) return 0x7bff;
+    if (exponent <= 0)
+    {
+        if (exponent < -10) return 0;
+        mantissa |= 0x800000;
+        const int shift = 14 - exponent;
+        quint32 half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half++;
+        return quint16(half);
+    }
+    quint32 half = quint32(exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) half++;
+    return quint16(qMin(half, quint32(0x7bff)));
+}
+
+static int unquantize10(int e)
+{
+    if (e == 0) return 0;
+    if (e == 1023) return 0xffff;
+    return ((e << 16) + 0x8000) >> 10;
+}
+
+static int finishUnquantize(int c)
+{
+    return (c * 31) >> 6;
+}
+
+static int quantize10(float half)
+{
+    const int e = qBound(0, int(half / 31.0f), 1022);
+    const float d0 = qAbs(finishUnquantize(unquantize10(e)) - half);
+    const float d1 = qAbs(finishUnquantize(unquantize10(e + 1)) - half);
+    return d1 < d0 ? e + 1 : e;
+}
+
+static void writeBits(quint64 bits[2], int &position, quint64 value, int count)
+{
+    for (int i = 0; i < count; ++i, ++position)
+    {
+        if ((value >> i) & 1)
+        {
+            bits[position / 64] |= quint64(1) << (position % 64);
+        }
+    }
+}
+
+static void encodeBC6HBlock(const float block[16][4], uchar *out)
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // The hardware interpolates the bit patterns of the half floats
+    float halves[16][4];
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c = 0; c < 3; ++c) halves[i][c] = floatToHalf(block[i][c]);
+    }
+
+    float e0[3], e1[3];
+    axisEndpoints(halves, 0.0f, e0, e1);
+
+    int q[2][3];
+    for (int c = 0; c < 3; ++c)
+    {
+        q[0][c] = quantize10(e1[c]);
+        q[1][c] = quantize10(e0[c]);
+    }
+
+    int palette[16][3];
+    for (int p = 0; p < 16; ++p)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            const int a = unquantize10(q[0][c]);
+            const int b = unquantize10(q[1][c]);
+            palette[p][c] = finishUnquantize(((64 - weights[p]) * a + weights[p] * b + 32) >> 6);
+        }
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0;
+        float bestError = 1e30f;
+        for (int p = 0; p < 16; ++p)
+        {
+            const float dr = halves[i][0] - palette[p][0];
+            const float dg = halves[i][1] - palette[p][1];
+            const float db = halves[i][2] - palette[p][2];
+            const float error = dr * dr + dg * dg + db * db;
+            if (error < bestError) { bestError = error; best = p; }
+        }
+        indices[i] = best;
+    }
+
+    // The most significant bit of the first index is implicitly zero
+    if (indices[0] & 8)
+    {
+        for (int c = 0; c < 3; ++c) qSwap(q[0][c], q[1][c]);
+        for (int i = 0; i < 16; ++i) indices[i] = 15 - indices[i];
+    }
+
+    quint64 bits[2] = {};
+    int position = 0;
+    writeBits(bits, position, 0x03, 5);
+    for (int e = 0; e < 2; ++e)
+    {
+        for (int c = 0; c < 3; ++c) writeBits(bits, position, quint64(q[e][c]), 10);
+    }
+    writeBits(bits, position, quint64(indices[0]), 3);
+    for (int i = 1; i < 16; ++i) writeBits(bits, position, quint64(indices[i]), 4);
+
+    for (int i = 0; i < 16; ++i)
+    {
+        out[i] = uchar((bits[i / 8] >> (8 * (i % 8))) & 0xff);
+    }
+}
+
+
+// Encoding ////////////////////////////////////////////////////////////
+
+struct BlockRow
+{
+    int level;
+    int row;
+};
+
+static QVector<QByteArray> encodeLevels(const QVector<ImageLevel> &levels, int channels, TextureCompression compression)
+{
+    const int bytes = blockBytes(compression);
+
+    QVector<QByteArray> mips(levels.size());
+    QVector<uchar *> outputs(levels.size());
+    QVector<BlockRow> rows;
+    for (int l = 0; l < levels.size(); ++l)
+    {
+        const int bw = (levels[l].w + 3) / 4;
+        const int bh = (levels[l].h + 3) / 4;
+        mips[l] = QByteArray(bw * bh * bytes, Qt::Uninitialized);
+        outputs[l] = reinterpret_cast<uchar *>(mips[l].data());
+        for (int r = 0; r < bh; ++r)
+        {
+            rows.push_back(BlockRow{ l, r });
+        }
+    }
+
+    // Every block row writes its own range of the output
+    const auto encodeRow = [&](const BlockRow &blockRow)
+    {
+        const ImageLevel &level = levels[blockRow.level];
+        const int bw = (level.w + 3) / 4;
+        uchar *out = outputs[blockRow.level] + blockRow.row * bw * bytes;
+        float block[16][4];
+        for (int bx = 0; bx < bw; ++bx, out += bytes)
+        {
+            fetchBlock(level, channels, bx, blockRow.row, block);
+            switch (compression)
+            {
+            case TextureCompression::BC1: encodeBC1Block(block, out); break;
+            case TextureCompression::BC3: encodeBC4Block(block, 3, out); encodeBC1Block(block, out + 8); break;
+            case TextureCompression::BC4: encodeBC4Block(block, 0, out); break;
+            case TextureCompression::BC5: encodeBC4Block(block, 0, out); encodeBC4Block(block, 1, out + 8); break;
+            case TextureCompression::BC6H: encodeBC6HBlock(block, out); break;
+            default: break;
+            }
+        }
+    };
+    jobSystem->parallelFor("Block compression", rows.size(), 4, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) encodeRow(rows[i]);
+    });
+
+    return mips;
+}
+
+QVector<QByteArray> TextureCompressor::compress(const QImage &image, TextureCompression compression)
+{
+    if (image.isNull() || compression == TextureCompression::None || compression == TextureCompression::BC6H)
+    {
+        return QVector<QByteArray>();
+    }
+
+    const QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+    ImageLevel level0;
+    level0.w = rgba.width();
+    level0.h = rgba.height();
+    level0.pixels.resize(level0.w * level0.h * 4);
+    for (int y = 0; y < level0.h; ++y)
+    {
+        const uchar *src = rgba.constScanLine(y);
+        float *dst = level0.pixels.data() + y * level0.w * 4;
+        for (int x = 0; x < level0.w * 4; ++x)
+        {
+            dst[x] = src[x];
+        }
+    }
+
+    return encodeLevels(buildMipChain(std::move(level0), 4), 4, compression);
+}
+
+QVector<QByteArray> TextureCompressor::compressHdr(const float *rgb, int w, int h)
+{
+    if (rgb == nullptr || w <= 0 || h <= 0)
+    {
+        return QVector<QByteArray>();
+    }
+
+    ImageLevel level0;
+    level0.w = w;
+    level0.h = h;
+    level0.pixels.resize(w * h * 3);
+    memcpy(level0.pixels.data(), rgb, size_t(w * h * 3) * sizeof(float));
+
+    return encodeLevels(buildMipChain(std::move(level0), 3), 3, TextureCompression::BC6H);
+}
+
+GLenum TextureCompressor::glFormat(TextureCompression compression)
+{
+    switch (compression)
+    {
+    case TextureCompression::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TextureCompression::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case TextureCompression::BC4: return GL_COMPRESSED_RED_RGTC1;
+    case TextureCompression::BC5: return GL_COMPRESSED_RG_RGTC2;
+    case TextureCompression::BC6H: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+    default: return 0;
+    }
+}
+
+bool TextureCompressor::hasAlpha(const QImage &image)
+{
+    if (!image.hasAlphaChannel())
+    {
+        return false;
+    }
+    const QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+    for (int y = 0; y < rgba.height(); ++y)
+    {
+        const uchar *line = rgba.constScanLine(y);
+        for (int x = 0; x < rgba.width(); ++x)
+        {
+            if (line[x * 4 + 3] != 255) return true;
+        }
+    }
+    return false;
+}
+
+
+// KTX files ///////////////////////////////////////////////////////////
+
+static const uchar ktxIdentifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+static GLenum baseInternalFormat(GLenum format)
+{
+    switch (format)
+    {
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return GL_RGBA;
+    case GL_COMPRESSED_RED_RGTC1: return GL_RED;
+    case GL_COMPRESSED_RG_RGTC2: return GL_RG;
+    default: return GL_RGB;
+    }
+}
+
+bool TextureCompressor::readKtx(const QString &path, GLenum &format, int &w, int &h, QVector<QByteArray> &mips)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    if (data.size() < 64 || memcmp(data.constData(), ktxIdentifier, 12) != 0)
+    {
+        return false;
+    }
+
+    quint32 header[13];
+    memcpy(header, data.constData() + 12, sizeof(header));
+    if (header[0] != 0x04030201 || header[1] != 0 || header[9] != 0 || header[10] != 1)
+    {
+        return false;
+    }
+
+    format = header[4];
+    w = int(header[6]);
+    h = int(header[7]);
+    const int levelCount = int(qMax(header[11], quint32(1)));
+    int offset = 64 + int(header[12]);
+
+    mips.clear();
+    for (int l = 0; l < levelCount; ++l)
+    {
+        if (offset + 4 > data.size()) return false;
+        quint32 size;
+        memcpy(&size, data.constData() + offset, 4);
+        offset += 4;
+        if (offset + int(size) > data.size()) return false;
+        mips.push_back(data.mid(offset, int(size)));
+        offset += (int(size) + 3) & ~3;
+    }
+    return true;
+}
+
+bool TextureCompressor::writeKtx(const QString &path, GLenum format, int w, int h, const QVector<QByteArray> &mips)
+{
+    const quint32 header[13] = {
+        0x04030201,                   // endianness
+        0, 1, 0,                      // glType, glTypeSize, glFormat (compressed)
+        quint32(format),
+        quint32(baseInternalFormat(format)),
+        quint32(w), quint32(h), 0,    // pixel width, height, depth
+        0, 1,                         // array elements, faces
+        quint32(mips.size()),
+        0                             // key/value data
+    };
+
+    // Written to a temporary file so readers never see it half done
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(ktxIdentifier), 12);
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    for (const QByteArray &mip : mips)
+    {
+        const quint32 size = quint32(mip.size());
+        file.write(reinterpret_cast<const char *>(&size), 4);
+        file.write(mip);
+        const char padding[3] = {};
+        file.write(padding, (4 - (mip.size() & 3)) & 3);
+    }
+    if (!file.commit())
+    {
+        return false;
+    }
+
+#ifndef QT_NO_DEBUG
+    // A file readKtx rejects would be compressed again on every load
+    GLenum readFormat = 0;
+    int readW = 0, readH = 0;
+    QVector<QByteArray> readMips;
+    const bool readBack = readKtx(path, readFormat, readW, readH, readMips);
+    Q_ASSERT(readBack && readFormat == format && readW == w && readH == h && readMips == mips);
+    Q_UNUSED(readBack);
+#endif
+    return true;
+}
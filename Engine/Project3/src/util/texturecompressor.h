@@ -0,0 +1,57 @@
+#ifndef TEXTURECOMPRESSOR_H
+#define TEXTURECOMPRESSOR_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <qopengl.h>
+
+// Block-compressed formats (not part of the OpenGL 3.3 core headers)
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RED_RGTC1
+#define GL_COMPRESSED_RED_RGTC1 0x8DBB
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+#ifndef GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT
+#define GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT 0x8E8F
+#endif
+
+enum class TextureCompression
+{
+    None,
+    BC1,  // RGB color
+    BC3,  // RGBA color
+    BC4,  // Single channel (bump maps)
+    BC5,  // Two channels (normal maps)
+    BC6H  // HDR color
+};
+
+// Software block encoder, the mip chain of every image is generated and
+// its block rows are encoded in parallel
+class TextureCompressor
+{
+public:
+
+    // Encodes an RGBA8888 image and its mips (index 0 is the full image)
+    static QVector<QByteArray> compress(const QImage &image, TextureCompression compression);
+
+    // Encodes RGB float pixels and their mips as BC6H
+    static QVector<QByteArray> compressHdr(const float *rgb, int w, int h);
+
+    static GLenum glFormat(TextureCompression compression);
+    static bool hasAlpha(const QImage &image);
+
+    // KTX 1.1 files with a single 2D image and its mips
+    static bool readKtx(const QString &path, GLenum &format, int &w, int &h, QVector<QByteArray> &mips);
+    static bool writeKtx(const QString &path, GLenum format, int w, int h, const QVector<QByteArray> &mips);
+};
+
+#endif // TEXTURECOMPRESSOR_H